@@ -0,0 +1,449 @@
+// IMSAR DMA parameter sweep benchmark
+//
+// Runs the stream for a fixed time at every combination of transfer length, queue depth and
+// processing thread count, and writes one CSV row (or JSON object) per point. A previous CSV
+// run can be given as a baseline; points that got slower than the tolerance are reported and
+// the exit code is 2.
+
+extern "C"
+{
+#include "libimdma-pool.h"
+#include "libimdma.h"
+}
+
+#include "imdma-histogram.h"
+#include "imdma-rusage.h"
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+typedef std::tuple<unsigned int, unsigned int, unsigned int> BenchKey; // length, depth, threads
+
+struct BenchPoint
+{
+	unsigned int lengthBytes{0};
+	unsigned int depth{0};
+	unsigned int threads{0}; // 0 = blocks are processed on the receiving thread
+
+	double seconds{0};
+	double bytesPerSecond{0};
+	double blocksPerSecond{0};
+	double cpuPercent{0};
+	double p50Us{0};
+	double p99Us{0};
+	double p999Us{0};
+	double maxUs{0};
+
+	BenchKey key() const { return std::make_tuple(lengthBytes, depth, threads); }
+};
+
+static const char *const kCsvHeader =
+    "length_bytes,depth,threads,seconds,bytes_per_s,blocks_per_s,cpu_percent,p50_us,p99_us,p999_us,max_us";
+
+volatile bool running = true;
+
+static void ctrlc(int)
+{
+	running = false;
+	signal(SIGINT, SIG_DFL);
+}
+
+// The processing work for every block: copy it out of the DMA buffer
+static int copyKernel(const imdma_stream_view_t *view, void *output, unsigned int outputBytes, void *)
+{
+	return imdma_transfer_copy_out(view->transfer, output, outputBytes);
+}
+
+// Run the stream for the given time and fill in the measured values of the point
+static bool runPoint(imdma_t *imdma, BenchPoint &point, double seconds, unsigned int timeoutMs)
+{
+	imdma_stream_t *stream = imdma_stream_open(imdma, point.depth, point.lengthBytes);
+	if (stream == NULL)
+	{
+		return false;
+	}
+	imdma_stream_set_timeout_ms(stream, timeoutMs);
+
+	imdma_pool_t *pool = NULL;
+	std::vector<unsigned char> output;
+	if (point.threads > 0)
+	{
+		pool = imdma_pool_create(stream, point.threads, 0, point.lengthBytes, copyKernel, NULL, NULL);
+		if (pool == NULL)
+		{
+			imdma_stream_close(stream);
+			return false;
+		}
+	}
+	else
+	{
+		output.resize(point.lengthBytes);
+	}
+
+	LatencyHistogram latency;
+	unsigned long long totalBytes = 0;
+	unsigned long long totalBlocks = 0;
+	bool ok = true;
+
+	CpuUsage cpu;
+	auto startTime = std::chrono::steady_clock::now();
+	auto stopTime = startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+	                                std::chrono::duration<double>(seconds));
+	while (running && std::chrono::steady_clock::now() < stopTime)
+	{
+		imdma_stream_view_t view;
+		if (imdma_stream_next(stream, &view) != 0)
+		{
+			ok = false;
+			break;
+		}
+
+		latency.record(view.complete_ns - view.submit_ns);
+		totalBytes += view.length_bytes;
+		totalBlocks++;
+
+		int rc;
+		if (pool != NULL)
+		{
+			rc = imdma_pool_submit(pool, &view);
+		}
+		else
+		{
+			copyKernel(&view, output.data(), point.lengthBytes, NULL);
+			rc = imdma_stream_done(stream, &view);
+		}
+		if (rc != 0)
+		{
+			ok = false;
+			break;
+		}
+	}
+
+	if (pool != NULL)
+	{
+		imdma_pool_drain(pool);
+	}
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	point.cpuPercent = cpu.percent();
+
+	if (pool != NULL)
+	{
+		imdma_pool_free(pool);
+	}
+	imdma_stream_close(stream);
+
+	point.seconds = elapsed;
+	point.bytesPerSecond = totalBytes / elapsed;
+	point.blocksPerSecond = totalBlocks / elapsed;
+	point.p50Us = latency.percentile(50) / 1e3;
+	point.p99Us = latency.percentile(99) / 1e3;
+	point.p999Us = latency.percentile(99.9) / 1e3;
+	point.maxUs = latency.max() / 1e3;
+
+	return ok;
+}
+
+static std::string toCsv(const BenchPoint &point)
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1);
+	out << point.lengthBytes << "," << point.depth << "," << point.threads << "," << std::setprecision(3)
+	    << point.seconds << "," << std::setprecision(1) << point.bytesPerSecond << "," << point.blocksPerSecond << ","
+	    << point.cpuPercent << "," << point.p50Us << "," << point.p99Us << "," << point.p999Us << "," << point.maxUs;
+	return out.str();
+}
+
+static std::string toJson(const BenchPoint &point)
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1);
+	out << "{\"length_bytes\": " << point.lengthBytes << ", \"depth\": " << point.depth
+	    << ", \"threads\": " << point.threads << ", \"seconds\": " << std::setprecision(3) << point.seconds
+	    << std::setprecision(1) << ", \"bytes_per_s\": " << point.bytesPerSecond
+	    << ", \"blocks_per_s\": " << point.blocksPerSecond << ", \"cpu_percent\": " << point.cpuPercent
+	    << ", \"p50_us\": " << point.p50Us << ", \"p99_us\": " << point.p99Us << ", \"p999_us\": " << point.p999Us
+	    << ", \"max_us\": " << point.maxUs << "}";
+	return out.str();
+}
+
+// Read a CSV file written by this tool
+static bool readBaseline(const char *path, std::map<BenchKey, BenchPoint> &baseline)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cerr << "failed to open baseline " << path << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.empty() || line.compare(0, 12, "length_bytes") == 0)
+		{
+			continue;
+		}
+
+		BenchPoint point;
+		char comma;
+		std::istringstream in(line);
+		in >> point.lengthBytes >> comma >> point.depth >> comma >> point.threads >> comma >> point.seconds >> comma >>
+		    point.bytesPerSecond >> comma >> point.blocksPerSecond >> comma >> point.cpuPercent >> comma >> point.p50Us >>
+		    comma >> point.p99Us >> comma >> point.p999Us >> comma >> point.maxUs;
+		if (!in)
+		{
+			std::cerr << "ignoring invalid baseline line: " << line << std::endl;
+			continue;
+		}
+		baseline[point.key()] = point;
+	}
+
+	return true;
+}
+
+// Parse a comma separated list of numbers
+static bool parseList(const char *text, std::vector<unsigned int> &values)
+{
+	values.clear();
+	std::istringstream in(text);
+	std::string item;
+	while (std::getline(in, item, ','))
+	{
+		char *end;
+		unsigned long value = strtoul(item.c_str(), &end, 0);
+		if (item.empty() || *end != '\0')
+		{
+			return false;
+		}
+		values.push_back(value);
+	}
+	return !values.empty();
+}
+
+// Powers of two from first up to last (last is always included)
+static std::vector<unsigned int> powersOfTwo(unsigned int first, unsigned int last)
+{
+	std::vector<unsigned int> values;
+	for (unsigned long value = first; value < last; value *= 2)
+	{
+		values.push_back(value);
+	}
+	values.push_back(last);
+	return values;
+}
+
+static void usage(const char *name)
+{
+	std::cout << "Usage: " << name << " [options] <device>\n";
+	std::cout << "  -l lengths     transfer lengths in bytes (default: powers of two from 256 to the buffer size)\n";
+	std::cout << "  -q depths      queue depths (default: powers of two from 1 to the buffer count)\n";
+	std::cout << "  -t threads     processing threads; 0 = process on the receiving thread (default: 0)\n";
+	std::cout << "  -s seconds     duration of each point (default: 1)\n";
+	std::cout << "  -f csv|json    output format (default: csv)\n";
+	std::cout << "  -o file        write the results to file instead of stdout\n";
+	std::cout << "  -b baseline    compare with a CSV written by a previous run\n";
+	std::cout << "  -T percent     throughput regression tolerance (default: 5)\n";
+	std::cout << "  -P percent     p99 latency regression tolerance (default: 25)\n";
+	std::cout << "  -w timeout_ms  finish timeout (default: 3000)\n";
+	std::cout << "Lists are comma separated, e.g. -q 1,2,4 -t 0,1,2\n";
+	std::cout << "Example: " << name << " -s 2 -t 0,2 -o baseline.csv /dev/imdma_downsampled\n";
+	std::cout << "Example: " << name << " -b baseline.csv sim:rate=800MBps\n";
+}
+
+int main(int argc, char *const argv[])
+{
+	std::vector<unsigned int> lengths;
+	std::vector<unsigned int> depths;
+	std::vector<unsigned int> threads{0};
+	double seconds = 1;
+	bool json = false;
+	const char *outputPath = NULL;
+	const char *baselinePath = NULL;
+	double throughputTolerance = 5;
+	double latencyTolerance = 25;
+	unsigned int timeoutMs = 3000;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "l:q:t:s:f:o:b:T:P:w:h")) != -1)
+	{
+		bool ok = true;
+		switch (opt)
+		{
+		case 'l':
+			ok = parseList(optarg, lengths);
+			break;
+		case 'q':
+			ok = parseList(optarg, depths);
+			break;
+		case 't':
+			ok = parseList(optarg, threads);
+			break;
+		case 's':
+			seconds = strtod(optarg, NULL);
+			ok = seconds > 0;
+			break;
+		case 'f':
+			json = std::string(optarg) == "json";
+			ok = json || std::string(optarg) == "csv";
+			break;
+		case 'o':
+			outputPath = optarg;
+			break;
+		case 'b':
+			baselinePath = optarg;
+			break;
+		case 'T':
+			throughputTolerance = strtod(optarg, NULL);
+			break;
+		case 'P':
+			latencyTolerance = strtod(optarg, NULL);
+			break;
+		case 'w':
+			timeoutMs = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			ok = false;
+			break;
+		}
+		if (!ok)
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind >= argc)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	std::map<BenchKey, BenchPoint> baseline;
+	if (baselinePath != NULL && !readBaseline(baselinePath, baseline))
+	{
+		return 1;
+	}
+
+	imdma_t *imdma = imdma_create(argv[optind]);
+	if (imdma == NULL)
+	{
+		return 1;
+	}
+	if (imdma_get_direction(imdma) == IMDMA_DIRECTION_TX)
+	{
+		// The sweep measures receive latency and copy-out; a transmit stream hands out unsent buffers first
+		std::cerr << argv[optind] << ": is a transmit (MM2S) channel (use imdma-perf -t to measure transmit)"
+		          << std::endl;
+		imdma_free(imdma);
+		return 1;
+	}
+
+	unsigned int bufferSize = imdma_get_buffer_size(imdma);
+	unsigned int bufferCount = imdma_get_buffer_count(imdma);
+	if (lengths.empty())
+	{
+		lengths = powersOfTwo(std::min(256u, bufferSize), bufferSize);
+	}
+	if (depths.empty())
+	{
+		depths = powersOfTwo(1, bufferCount);
+	}
+
+	std::ofstream outputFile;
+	if (outputPath != NULL)
+	{
+		outputFile.open(outputPath);
+		if (!outputFile)
+		{
+			std::cerr << "failed to open " << outputPath << std::endl;
+			imdma_free(imdma);
+			return 1;
+		}
+	}
+	std::ostream &output = outputPath != NULL ? outputFile : std::cout;
+
+	signal(SIGINT, ctrlc);
+
+	output << (json ? "[" : kCsvHeader) << std::endl;
+
+	int regressions = 0;
+	bool first = true;
+	for (unsigned int length : lengths)
+	{
+		for (unsigned int depth : depths)
+		{
+			for (unsigned int threadCount : threads)
+			{
+				if (!running)
+				{
+					break;
+				}
+
+				BenchPoint point;
+				point.lengthBytes = length;
+				point.depth = depth;
+				point.threads = threadCount;
+				if (!runPoint(imdma, point, seconds, timeoutMs))
+				{
+					std::cerr << "point length=" << length << " depth=" << depth << " threads=" << threadCount
+					          << " failed" << std::endl;
+					continue;
+				}
+
+				if (json)
+				{
+					output << (first ? "  " : ", ") << toJson(point) << std::endl;
+				}
+				else
+				{
+					output << toCsv(point) << std::endl;
+				}
+				first = false;
+
+				auto reference = baseline.find(point.key());
+				if (reference == baseline.end())
+				{
+					continue;
+				}
+
+				const BenchPoint &before = reference->second;
+				bool slower = point.bytesPerSecond < before.bytesPerSecond * (1 - throughputTolerance / 100);
+				bool laggier = point.p99Us > before.p99Us * (1 + latencyTolerance / 100);
+				if (slower || laggier)
+				{
+					regressions++;
+					std::cerr << std::fixed << std::setprecision(1) << "REGRESSION length=" << length
+					          << " depth=" << depth << " threads=" << threadCount << ": "
+					          << point.bytesPerSecond / 1e6 << " MB/s (baseline " << before.bytesPerSecond / 1e6
+					          << "), p99 " << point.p99Us << " us (baseline " << before.p99Us << ")" << std::endl;
+				}
+			}
+		}
+	}
+
+	if (json)
+	{
+		output << "]" << std::endl;
+	}
+
+	imdma_free(imdma);
+
+	if (baselinePath != NULL)
+	{
+		std::cerr << regressions << " regression(s) against " << baselinePath << std::endl;
+	}
+
+	return regressions > 0 ? 2 : 0;
+}
@@ -0,0 +1,278 @@
+// Micro-benchmark for the libimdma sample-format conversion kernels
+//
+// Runs every kernel with every instruction set supported by this CPU against a synthetic
+// buffer, checks each result against the scalar kernel and reports the source throughput.
+// With -d, the source is a block received from the given imdma device (the mmap'ed DMA buffer),
+// which shows the real cost of reading uncached memory (the scalar "copy" row is plain memcpy).
+
+#include "libimdma-convert.h"
+#include "libimdma.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_CHANNELS 2
+
+typedef struct bench_buffers_st
+{
+	const uint8_t *src;
+	size_t srcBytes;
+	uint8_t *dst;
+	int16_t *channels[BENCH_CHANNELS];
+} bench_buffers_t;
+
+typedef struct bench_kernel_st
+{
+	const char *name;
+	void (*run)(const bench_buffers_t *buffers);
+	size_t (*outputBytes)(const bench_buffers_t *buffers);
+} bench_kernel_t;
+
+static void run_s16_to_f32(const bench_buffers_t *b)
+{
+	imdma_convert_s16_to_f32((const int16_t *)b->src, (float *)b->dst, b->srcBytes / 2, 1.0f / 32768);
+}
+static size_t out_s16_to_f32(const bench_buffers_t *b) { return b->srcBytes / 2 * sizeof(float); }
+
+static void run_unpack12(const bench_buffers_t *b)
+{
+	imdma_convert_unpack12_to_s16(b->src, (int16_t *)b->dst, b->srcBytes / 3 * 2);
+}
+static size_t out_unpack12(const bench_buffers_t *b) { return b->srcBytes / 3 * 2 * sizeof(int16_t); }
+
+static void run_bswap16(const bench_buffers_t *b) { imdma_convert_bswap16(b->src, b->dst, b->srcBytes / 2); }
+static void run_bswap32(const bench_buffers_t *b) { imdma_convert_bswap32(b->src, b->dst, b->srcBytes / 4); }
+static void run_bswap64(const bench_buffers_t *b) { imdma_convert_bswap64(b->src, b->dst, b->srcBytes / 8); }
+static size_t out_same(const bench_buffers_t *b) { return b->srcBytes; }
+
+static void run_deinterleave(const bench_buffers_t *b)
+{
+	imdma_convert_deinterleave_s16((const int16_t *)b->src, b->channels, BENCH_CHANNELS,
+	                               b->srcBytes / sizeof(int16_t) / BENCH_CHANNELS);
+}
+static size_t out_deinterleave(const bench_buffers_t *) { return 0; } // compared per channel
+
+static void run_copy(const bench_buffers_t *b) { imdma_convert_copy(b->src, b->dst, b->srcBytes); }
+static void run_copy_to_device(const bench_buffers_t *b) { imdma_convert_copy_to_device(b->src, b->dst, b->srcBytes); }
+
+static const bench_kernel_t s_kernels[] = {
+    {"s16_to_f32", run_s16_to_f32, out_s16_to_f32},             //
+    {"unpack12_to_s16", run_unpack12, out_unpack12},            //
+    {"bswap16", run_bswap16, out_same},                         //
+    {"bswap32", run_bswap32, out_same},                         //
+    {"bswap64", run_bswap64, out_same},                         //
+    {"deinterleave_s16x2", run_deinterleave, out_deinterleave}, //
+    {"copy", run_copy, out_same},                               //
+    {"copy_to_device", run_copy_to_device, out_same},           //
+};
+
+static const imdma_convert_isa_t s_isas[] = {IMDMA_CONVERT_ISA_SCALAR, IMDMA_CONVERT_ISA_SSE4, IMDMA_CONVERT_ISA_AVX2,
+                                             IMDMA_CONVERT_ISA_NEON};
+
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int same_output(const bench_kernel_t *kernel, const bench_buffers_t *actual, const bench_buffers_t *expected)
+{
+	size_t bytes = kernel->outputBytes(actual);
+	if (bytes > 0)
+	{
+		return memcmp(actual->dst, expected->dst, bytes) == 0;
+	}
+
+	size_t channelBytes = actual->srcBytes / BENCH_CHANNELS;
+	for (int i = 0; i < BENCH_CHANNELS; i++)
+	{
+		if (memcmp(actual->channels[i], expected->channels[i], channelBytes) != 0)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int alloc_buffers(bench_buffers_t *buffers, const uint8_t *src, size_t srcBytes)
+{
+	buffers->src = src;
+	buffers->srcBytes = srcBytes;
+	buffers->dst = calloc(1, srcBytes * 2 + 64); // s16_to_f32 doubles the size
+	for (int i = 0; i < BENCH_CHANNELS; i++)
+	{
+		buffers->channels[i] = calloc(1, srcBytes / BENCH_CHANNELS + 64);
+		if (buffers->channels[i] == NULL)
+		{
+			return -1;
+		}
+	}
+	return buffers->dst == NULL ? -1 : 0;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-d device] [lengthBytes:16777216] [iterations:20]\n", name);
+	printf("Example: %s -d /dev/imdma_downsampled 4194304\n", name);
+}
+
+int main(int argc, char *const argv[])
+{
+	const char *devicePath = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "d:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			devicePath = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	size_t lengthBytes = 16777216; // 16 MiB
+	if (optind < argc)
+	{
+		lengthBytes = strtoul(argv[optind], NULL, 10);
+	}
+
+	unsigned int iterations = 20;
+	if (optind + 1 < argc)
+	{
+		iterations = strtoul(argv[optind + 1], NULL, 10);
+	}
+
+	imdma_t *imdma = NULL;
+	imdma_stream_t *stream = NULL;
+	imdma_stream_view_t view;
+	if (devicePath != NULL)
+	{
+		imdma = imdma_create(devicePath);
+		if (imdma == NULL)
+		{
+			return 1;
+		}
+
+		if (lengthBytes > imdma_get_buffer_size(imdma))
+		{
+			lengthBytes = imdma_get_buffer_size(imdma);
+		}
+	}
+
+	// Keep the length a multiple of every kernel's input group (3 bytes for unpack12, 8 bytes for bswap64)
+	lengthBytes -= lengthBytes % 24;
+	if (lengthBytes == 0 || iterations == 0)
+	{
+		fprintf(stderr, "length and iterations must be non-zero\n");
+		return 1;
+	}
+
+	const uint8_t *src;
+	if (imdma != NULL)
+	{
+		// Hold one received block for the whole run (the buffer cannot change while it is held)
+		stream = imdma_stream_open(imdma, 1, lengthBytes);
+		if (stream == NULL || imdma_stream_next(stream, &view) != 0)
+		{
+			fprintf(stderr, "failed to receive a block from %s\n", devicePath);
+			return 1;
+		}
+		src = (const uint8_t *)view.data;
+	}
+	else
+	{
+		// Synthetic "ADC" data (deterministic so runs are comparable)
+		uint8_t *synthetic = malloc(lengthBytes);
+		if (synthetic == NULL)
+		{
+			perror("malloc");
+			return 1;
+		}
+		uint32_t seed = 12345;
+		for (size_t i = 0; i < lengthBytes; i++)
+		{
+			seed = seed * 1103515245 + 12345;
+			synthetic[i] = seed >> 16;
+		}
+		src = synthetic;
+	}
+
+	bench_buffers_t expected, actual;
+	if (alloc_buffers(&expected, src, lengthBytes) != 0 || alloc_buffers(&actual, src, lengthBytes) != 0)
+	{
+		perror("calloc");
+		return 1;
+	}
+
+	printf("auto-selected: %s, source: %s, length: %zu bytes, iterations: %u\n",
+	       imdma_convert_isa_name(imdma_convert_get_isa()), devicePath ? devicePath : "synthetic", lengthBytes,
+	       iterations);
+	printf("%-20s %-8s %12s %9s\n", "kernel", "isa", "MiB/s", "speedup");
+
+	int failures = 0;
+	for (unsigned int k = 0; k < sizeof(s_kernels) / sizeof(s_kernels[0]); k++)
+	{
+		const bench_kernel_t *kernel = &s_kernels[k];
+		double scalarSeconds = 0;
+
+		imdma_convert_select_isa(IMDMA_CONVERT_ISA_SCALAR);
+		kernel->run(&expected);
+
+		for (unsigned int i = 0; i < sizeof(s_isas) / sizeof(s_isas[0]); i++)
+		{
+			if (imdma_convert_select_isa(s_isas[i]) != 0)
+			{
+				continue; // not supported by this build or CPU
+			}
+
+			// Warm up (and check the result)
+			kernel->run(&actual);
+			int ok = same_output(kernel, &actual, &expected);
+			failures += ok ? 0 : 1;
+
+			double start = now_seconds();
+			for (unsigned int n = 0; n < iterations; n++)
+			{
+				kernel->run(&actual);
+			}
+			double seconds = (now_seconds() - start) / iterations;
+
+			if (s_isas[i] == IMDMA_CONVERT_ISA_SCALAR)
+			{
+				scalarSeconds = seconds;
+			}
+
+			printf("%-20s %-8s %12.1f %8.2fx%s\n", kernel->name, imdma_convert_isa_name(s_isas[i]),
+			       lengthBytes / seconds / 1024 / 1024, scalarSeconds / seconds, ok ? "" : "  MISMATCH");
+		}
+	}
+
+	imdma_convert_select_isa(IMDMA_CONVERT_ISA_AUTO);
+
+	if (stream != NULL)
+	{
+		imdma_stream_done(stream, &view);
+		imdma_stream_close(stream);
+	}
+
+	if (imdma != NULL)
+	{
+		imdma_free(imdma);
+	}
+
+	if (failures > 0)
+	{
+		fprintf(stderr, "%d kernel(s) produced results that differ from the scalar kernel\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
@@ -2,201 +2,658 @@
 
 extern "C"
 {
+#include "libimdma-pool.h"
+#include "libimdma-verify.h"
 #include "libimdma.h"
 }
 
+#include "imdma-trigger.h"
+#include "imdma-writer.h"
+
 #include <signal.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstring>
-#include <fstream>
 #include <iomanip>
 #include <iostream>
-#include <queue>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
-class Transfer
+class Device
 {
 public:
-	Transfer(imdma_t *device) : transfer_{imdma_transfer_alloc(device)}
+	Device(const char *devicePath) : device_{imdma_create(devicePath)}
 	{
-		if (!transfer_)
+		if (!device_)
 		{
-			throw std::runtime_error("Cannot allocate transfer");
+			throw std::runtime_error("Cannot create device");
 		}
 	}
-	Transfer(const Transfer &&other) = delete;
-	~Transfer() { imdma_transfer_free(transfer_); }
-
-	int setTimeoutMs(unsigned int timeoutMs) { return imdma_transfer_set_timeout_ms(transfer_, timeoutMs); }
-
-	int setLengthBytesIn(unsigned int lengthBytes) { return imdma_transfer_set_length(transfer_, lengthBytes); }
-
-	int startTransferIn(unsigned int lengthBytes)
-	{
-		setLengthBytesIn(lengthBytes);
-		return start();
-	}
-
-	int finishTransfer(unsigned int timeoutMs)
-	{
-		setTimeoutMs(timeoutMs);
-		return finish();
-	}
-
-	int start() { return imdma_transfer_start_async(transfer_); }
-	int finish() { return imdma_transfer_finish(transfer_); }
+	Device(const Device &&other) = delete;
+	~Device() { imdma_free(device_); }
 
-	const unsigned int getDataLengthIn() { return imdma_transfer_get_length(transfer_); }
-	const void *getDataPointerIn() { return imdma_transfer_get_data_const(transfer_); }
+	imdma_t *get() { return device_; }
 
 private:
-	imdma_transfer_t *transfer_;
+	imdma_t *device_;
 };
 
-class Device
+class Stream
 {
 public:
-	Device(const char *devicePath) : device_{imdma_create(devicePath)}
+	Stream(Device &device, unsigned int lengthBytes) : stream_{imdma_stream_open(device.get(), 0, lengthBytes)}
 	{
-		if (!device_)
+		if (!stream_)
 		{
-			throw std::runtime_error("Cannot create device");
+			throw std::runtime_error("Cannot open stream");
 		}
 	}
-	Device(const Device &&other) = delete;
-	~Device() { imdma_free(device_); }
+	Stream(const Stream &&other) = delete;
+	~Stream() { imdma_stream_close(stream_); }
 
-	std::unique_ptr<Transfer> createTransfer()
-	{
-		try
-		{
-			return std::unique_ptr<Transfer>(new Transfer(device_));
-		}
-		catch (std::runtime_error &err)
-		{
-			return nullptr;
-		}
-	}
+	imdma_stream_t *get() { return stream_; }
+
+	int setTimeoutMs(unsigned int timeoutMs) { return imdma_stream_set_timeout_ms(stream_, timeoutMs); }
+
+	int next(imdma_stream_view_t &view) { return imdma_stream_next(stream_, &view); }
+	int done(const imdma_stream_view_t &view) { return imdma_stream_done(stream_, &view); }
 
 private:
-	imdma_t *device_;
+	imdma_stream_t *stream_;
 };
 
 volatile bool running = true;
+TriggerRing *triggerRing = NULL; // for the SIGUSR1 trigger
 
-static void ctrlc(int sig)
+static void ctrlc(int)
 {
 	running = false;
 	signal(SIGINT, SIG_DFL);
 }
 
-static bool finishTransfer(const char *filePrefix, unsigned int transferNumber, Transfer &transfer,
-                           unsigned int timeoutMs)
+static void usr1(int)
 {
-	int finishStatus = transfer.finishTransfer(timeoutMs);
-	if (finishStatus != 0)
+	if (triggerRing != NULL)
 	{
-		std::cerr << "transfer " << transferNumber << " failed with status " << finishStatus << std::endl;
-		return false;
+		triggerRing->trigger();
 	}
-	unsigned int transferredBytes = transfer.getDataLengthIn();
-	if (transferredBytes == 0)
+}
+
+// Parse a hex byte string ("deadbeef"); returns false if it is not valid
+static bool parseHex(const std::string &text, std::string &bytes)
+{
+	if (text.empty() || text.size() % 2 != 0 || text.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
 	{
-		std::cerr << "transfer " << transferNumber << " was empty" << std::endl;
 		return false;
 	}
+	for (size_t i = 0; i < text.size(); i += 2)
+	{
+		bytes.push_back(static_cast<char>(std::stoul(text.substr(i, 2), NULL, 16)));
+	}
+	return true;
+}
 
+static std::string blockFileName(const char *filePrefix, unsigned long long sequence)
+{
 	std::stringstream ss;
 	ss << filePrefix;
 	ss << std::setfill('0');
 	ss << std::setw(10);
-	ss << transferNumber;
-	std::string filename = ss.str();
-	std::ofstream file(filename);
-	if (!file.is_open())
+	ss << sequence;
+	return ss.str();
+}
+
+static std::string segmentFileName(const char *filePrefix, unsigned long long segmentIndex)
+{
+	std::stringstream ss;
+	ss << filePrefix << std::setfill('0') << std::setw(6) << segmentIndex << IMDMA_RECORD_SUFFIX;
+	return ss.str();
+}
+
+// Lays out the records of a recording in its segment files (called in sequence order, from one thread at a time)
+class Recording
+{
+public:
+	Recording(const char *filePrefix, const char *devicePath, unsigned int blockBytes, uint64_t segmentBytes)
+	    : filePrefix(filePrefix), devicePath(devicePath), blockBytes(blockBytes), segmentBytes(segmentBytes)
 	{
-		std::cerr << "failed to open file \"" << filename << "\"" << std::endl;
-		return false;
 	}
 
-	file.write(reinterpret_cast<const char *>(transfer.getDataPointerIn()), transfer.getDataLengthIn());
+	// Reserve the record in the current segment (starting a new one when it is full) and point the buffer at it;
+	// returns false if a segment could not be created
+	bool place(BlockWriter::Buffer &buffer, const imdma_record_block_header_t &header)
+	{
+		if (!segment || !segment->reserve(header, buffer.offset))
+		{
+			segment = RecordSegment::create(segmentFileName(filePrefix, segmentCount), segmentCount, header.sequence,
+			                                blockBytes, devicePath, segmentBytes);
+			if (!segment)
+			{
+				return false;
+			}
+			segmentCount++;
+			segment->reserve(header, buffer.offset);
+		}
+		buffer.length = imdma_record_block_stride(header.stored_bytes);
+		buffer.segment = segment;
+		return true;
+	}
+
+	// Drop the current segment (it is closed once every block in it has been written)
+	void close() { segment.reset(); }
+
+	unsigned long long segments() const { return segmentCount; }
+
+private:
+	const char *filePrefix;
+	const char *devicePath;
+	unsigned int blockBytes;
+	uint64_t segmentBytes;
+	std::shared_ptr<RecordSegment> segment;
+	unsigned long long segmentCount{0};
+};
+
+static imdma_record_block_header_t recordHeader(const imdma_stream_view_t &view)
+{
+	imdma_record_block_header_t header;
+	std::memset(&header, 0, sizeof(header));
+	header.magic = IMDMA_RECORD_BLOCK_MAGIC;
+	header.header_bytes = sizeof(header);
+	header.sequence = view.sequence;
+	header.timestamp_ns = view.complete_ns;
+	header.length_bytes = view.length_bytes;
+	header.stored_bytes = view.length_bytes;
+	header.codec = IMDMA_RECORD_CODEC_NONE;
+	return header;
+}
+
+// Compresses blocks on the imdma_pool worker threads and hands the records to the writer in sequence order
+struct Compressor
+{
+	uint32_t codec{IMDMA_RECORD_CODEC_NONE};
+	int level{1};
+	BlockWriter *writer{NULL};
+	Recording *recording{NULL};
+
+	// Set by the capture thread, read by emit
+	std::mutex mutex;
+	std::set<unsigned long long> verifyErrors; // sequence numbers of blocks that failed verification
+
+	// emit only
+	bool droppedBefore{false};
+	bool failed{false}; // a segment could not be created: stop capturing
+	unsigned long long blocks{0};
+	unsigned long long uncompressed{0}; // blocks stored as is (they did not get smaller)
+	unsigned long long lengthBytes{0};
+	unsigned long long storedBytes{0};
+
+	// Output layout: the record header, then the stored data
+	static int kernel(const imdma_stream_view_t *view, void *output, unsigned int outputBytes, void *userData)
+	{
+		Compressor *compressor = static_cast<Compressor *>(userData);
+		if (view->length_bytes == 0)
+		{
+			return 0;
+		}
+
+		// Compress a cached copy (the compressor reads its input more than once)
+		thread_local std::vector<unsigned char> block;
+		block.resize(view->length_bytes);
+		unsigned int length = imdma_transfer_copy_out(view->transfer, block.data(), view->length_bytes);
+
+		imdma_record_block_header_t header = recordHeader(*view);
+		header.length_bytes = length;
+		unsigned char *data = static_cast<unsigned char *>(output) + sizeof(header);
+		size_t stored = imdma_record_compress(compressor->codec, compressor->level, block.data(), length, data,
+		                                      outputBytes - sizeof(header));
+		if (stored != 0 && stored < length)
+		{
+			header.stored_bytes = stored;
+			header.codec = compressor->codec;
+		}
+		else
+		{
+			std::memcpy(data, block.data(), length);
+		}
+		std::memcpy(output, &header, sizeof(header));
+		return sizeof(header) + header.stored_bytes;
+	}
+
+	static void emit(unsigned long long sequence, const void *output, int result, void *userData)
+	{
+		Compressor *compressor = static_cast<Compressor *>(userData);
+		if (result <= 0 || compressor->failed)
+		{
+			return;
+		}
+
+		BlockWriter::Buffer *buffer = compressor->writer->acquire();
+		if (buffer == NULL)
+		{
+			compressor->droppedBefore = true;
+			return;
+		}
+
+		imdma_record_block_header_t header;
+		std::memcpy(&header, output, sizeof(header));
+		bool verifyError;
+		{
+			std::lock_guard<std::mutex> lock(compressor->mutex);
+			verifyError = compressor->verifyErrors.erase(sequence) != 0;
+		}
+		header.flags = (verifyError ? IMDMA_RECORD_FLAG_VERIFY_ERROR : 0) |
+		               (compressor->droppedBefore ? IMDMA_RECORD_FLAG_AFTER_DROP : 0);
+		if (!compressor->recording->place(*buffer, header))
+		{
+			compressor->writer->release(buffer);
+			compressor->failed = true;
+			return;
+		}
 
+		std::memcpy(buffer->data, &header, sizeof(header));
+		std::memcpy(buffer->data + sizeof(header), static_cast<const unsigned char *>(output) + sizeof(header),
+		            header.stored_bytes);
+		std::memset(buffer->data + sizeof(header) + header.stored_bytes, 0,
+		            buffer->length - sizeof(header) - header.stored_bytes);
+		compressor->writer->submit(buffer);
+
+		compressor->droppedBefore = false;
+		compressor->blocks++;
+		compressor->uncompressed += header.codec == IMDMA_RECORD_CODEC_NONE;
+		compressor->lengthBytes += header.length_bytes;
+		compressor->storedBytes += header.stored_bytes;
+	}
+};
+
+// Parse "lz4[:acceleration]" or "zstd[:level]"; returns false (with a message) if it is invalid or not built in
+static bool parseCodec(const std::string &spec, uint32_t &codec, int &level)
+{
+	std::string name = spec.substr(0, spec.find(':'));
+	char *end = NULL;
+	codec = name == "lz4" ? IMDMA_RECORD_CODEC_LZ4 : name == "zstd" ? IMDMA_RECORD_CODEC_ZSTD : IMDMA_RECORD_CODEC_NONE;
+	level = name.size() < spec.size() ? strtol(spec.c_str() + name.size() + 1, &end, 10) : 1;
+	if (codec == IMDMA_RECORD_CODEC_NONE || (end != NULL && *end != '\0') || level < 1)
+	{
+		std::cerr << "invalid codec: " << spec << std::endl;
+		return false;
+	}
+	if (!imdma_record_codec_available(codec))
+	{
+		std::cerr << name << " support is not built in (make " << (codec == IMDMA_RECORD_CODEC_LZ4 ? "LZ4" : "ZSTD")
+		          << "=1)" << std::endl;
+		return false;
+	}
 	return true;
 }
 
-int main(int argc, const char *const argv[])
+int main(int argc, char *const argv[])
 {
-	if (argc < 3)
+	bool verify = false;
+	unsigned int writerThreads = 2;
+	unsigned int queueDepth = 8;
+	bool dropWhenFull = false;
+	unsigned long long segmentBytes = 1ull << 30; // 0 = one file per block
+	bool triggered = false;
+	double preSeconds = 0;
+	double postSeconds = 0;
+	unsigned long long ringBytes = 256ull << 20;
+	std::string interruptPath;
+	std::string pattern;
+	Compressor compressor;
+	unsigned int compressThreads = 0; // one per CPU
+	bool badOption = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "vw:q:xs:z:c:T:r:i:m:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'v':
+			verify = true;
+			break;
+		case 'w':
+			writerThreads = strtoul(optarg, NULL, 10);
+			break;
+		case 'q':
+			queueDepth = strtoul(optarg, NULL, 10);
+			break;
+		case 'x':
+			dropWhenFull = true;
+			break;
+		case 's':
+			segmentBytes = strtoull(optarg, NULL, 10);
+			break;
+		case 'z':
+			if (!parseCodec(optarg, compressor.codec, compressor.level))
+			{
+				return 1;
+			}
+			break;
+		case 'c':
+			compressThreads = strtoul(optarg, NULL, 10);
+			break;
+		case 'T':
+		{
+			char *end;
+			triggered = true;
+			preSeconds = strtod(optarg, &end);
+			postSeconds = *end == ':' ? strtod(end + 1, &end) : 0;
+			badOption = badOption || *end != '\0' || preSeconds < 0 || postSeconds < 0;
+			break;
+		}
+		case 'r':
+			ringBytes = strtoull(optarg, NULL, 10);
+			break;
+		case 'i':
+			interruptPath = optarg;
+			break;
+		case 'm':
+			badOption = badOption || !parseHex(optarg, pattern);
+			break;
+		default:
+			argc = 0; // print the usage
+			break;
+		}
+	}
+
+	// Trigger sources need trigger mode, which writes segments (as does compression, not available with it)
+	bool compress = compressor.codec != IMDMA_RECORD_CODEC_NONE;
+	badOption = badOption || ((!interruptPath.empty() || !pattern.empty()) && !triggered) ||
+	            ((triggered || compress) && segmentBytes == 0) || (triggered && compress);
+	if (optind + 2 > argc || writerThreads == 0 || queueDepth == 0 || badOption)
 	{
-		std::cout << "Usage: " << argv[0]
-		          << " <device> <filename_prefix> [transfer_count=0] [length_bytes=5242880] [timeout_ms=3000]\n";
+		std::cout << "Usage: " << argv[0] << " [-v] [-w threads] [-q depth] [-x] [-s bytes] [-z codec [-c threads]]"
+		          << " [-T pre[:post] [-r bytes] [-i path] [-m hex]] <device> <filename_prefix>"
+		          << " [transfer_count=0] [length_bytes=5242880] [timeout_ms=3000]\n";
+		std::cout << "  -v        verify the u64 counter test pattern in every block before it is written\n";
+		std::cout << "  -w N      writer threads (default 2)\n";
+		std::cout << "  -q N      blocks buffered between capture and the writers (default 8)\n";
+		std::cout << "  -x        drop blocks when the writers fall behind (default: capture waits for them)\n";
+		std::cout << "  -s bytes  record into segment files of this size, <prefix>NNNNNN" IMDMA_RECORD_SUFFIX
+		             " (default 1073741824);\n";
+		std::cout << "            0 writes one file per block, <prefix>NNNNNNNNNN\n";
+		std::cout << "  -z codec  compress the blocks in the segments: lz4[:acceleration] or zstd[:level] (default 1)\n";
+		std::cout << "  -c N      compression threads (default one per CPU)\n";
+		std::cout << "Triggered capture (only the window around each trigger is written):\n";
+		std::cout << "  -T pre[:post]  keep the last pre seconds in a RAM ring; on a trigger write them and the\n";
+		std::cout << "                 next post seconds to <prefix>eventNNNN_NNNNNN" IMDMA_RECORD_SUFFIX
+		             " (SIGUSR1 triggers)\n";
+		std::cout << "  -r bytes       ring size (default 268435456; huge pages when available)\n";
+		std::cout << "  -i path        also trigger when path becomes readable (e.g. /dev/uioN user interrupt)\n";
+		std::cout << "  -m hex         also trigger on blocks containing these bytes (e.g. -m 0df0adba)\n";
 		std::cout << "Example: " << argv[0] << " /dev/imdma_downsampled /tmp/data_\n";
+		std::cout << "Example: " << argv[0] << " -T 5:2 -r 4294967296 -i /dev/uio0 /dev/imdma_raw /data/raw_\n";
 		return 1;
 	}
 
-	const char *devicePath = argv[1];
-	const char *filename = argv[2];
+	const char *devicePath = argv[optind];
+	const char *filename = argv[optind + 1];
 	unsigned int numberOfTransfers = 0; // 0 = unlimited
 	unsigned int lengthBytes = 5242880; // 5MB
 	unsigned int timeoutMs = 3000;      // 3 seconds
 
-	if (argc >= 4)
+	if (optind + 2 < argc)
 	{
-		numberOfTransfers = strtoul(argv[3], NULL, 10);
+		numberOfTransfers = strtoul(argv[optind + 2], NULL, 10);
 	}
 
-	if (argc >= 5)
+	if (optind + 3 < argc)
 	{
-		lengthBytes = strtoul(argv[4], NULL, 10);
+		lengthBytes = strtoul(argv[optind + 3], NULL, 10);
 	}
 
-	if (argc >= 6)
+	if (optind + 4 < argc)
 	{
-		timeoutMs = strtoul(argv[5], NULL, 10);
+		timeoutMs = strtoul(argv[optind + 4], NULL, 10);
 	}
 
+	imdma_verify_t verifyState;
+	imdma_verify_init(&verifyState);
+
 	signal(SIGINT, ctrlc);
 
 	Device device(devicePath);
+	Stream stream(device, lengthBytes);
+	stream.setTimeoutMs(timeoutMs);
+
+	// Files are written by the writer threads while capture continues; or, in triggered mode,
+	// blocks go to the RAM ring and only the trigger windows are written (by the ring's flush thread)
+	std::unique_ptr<BlockWriter> writer;
+	std::unique_ptr<TriggerRing> ring;
+	InterruptTrigger interrupt;
+	if (triggered)
+	{
+		ring.reset(new TriggerRing(ringBytes, lengthBytes, preSeconds, postSeconds, filename, devicePath,
+		                           segmentBytes));
+		std::cout << "Ring: " << ring->capacityBlocks() << " blocks"
+		          << (ring->usesHugePages() ? ", huge pages" : ", normal pages")
+		          << (ring->isLocked() ? ", locked" : ", not locked (RLIMIT_MEMLOCK)") << std::endl;
+
+		triggerRing = ring.get();
+		signal(SIGUSR1, usr1);
+		if (!interruptPath.empty())
+		{
+			if (!interrupt.open(interruptPath))
+			{
+				return 1;
+			}
+			interrupt.start(*ring);
+		}
+	}
+	else
+	{
+		// Compressed records are at most the codec's bound (or stored as is)
+		size_t storedBytes = std::max<size_t>(imdma_record_compress_bound(compressor.codec, lengthBytes), lengthBytes);
+		size_t recordBytes = segmentBytes != 0 ? imdma_record_block_stride(storedBytes) : lengthBytes;
+		writer.reset(new BlockWriter(writerThreads, queueDepth, recordBytes, dropWhenFull));
+	}
+	Recording recording(filename, devicePath, lengthBytes, segmentBytes);
+	bool droppedBefore = false; // a block was dropped since the last one recorded
 
-	std::queue<std::unique_ptr<Transfer>> pendingTransfers;
+	// With compression, blocks go through an ordered pool of compression threads on their way to the writer
+	imdma_pool_t *pool = NULL;
+	if (compress)
+	{
+		size_t storedBytes = std::max<size_t>(imdma_record_compress_bound(compressor.codec, lengthBytes), lengthBytes);
+		compressor.writer = writer.get();
+		compressor.recording = &recording;
+		pool = imdma_pool_create(stream.get(), compressThreads, 0, sizeof(imdma_record_block_header_t) + storedBytes,
+		                         Compressor::kernel, Compressor::emit, &compressor);
+		if (pool == NULL)
+		{
+			return 1;
+		}
+	}
 
-	unsigned int transferStartCount = 0;
 	unsigned int transferFinishCount = 0;
+	auto startTime = std::chrono::steady_clock::now();
 
-	while (running && (numberOfTransfers == 0 || transferStartCount < numberOfTransfers))
+	while (running && (numberOfTransfers == 0 || transferFinishCount < numberOfTransfers))
 	{
-		std::unique_ptr<Transfer> transfer = device.createTransfer();
-		if (transfer)
+		imdma_stream_view_t view;
+		int nextStatus = stream.next(view);
+		if (nextStatus != 0)
+		{
+			std::cerr << "transfer " << transferFinishCount << " failed with status " << nextStatus << std::endl;
+			break;
+		}
+
+		if (view.length_bytes == 0)
+		{
+			std::cerr << "transfer " << view.sequence << " was empty" << std::endl;
+		}
+
+		if (pool != NULL)
 		{
-			int result = transfer->startTransferIn(lengthBytes);
-			if (result != 0)
+			// Verify the block before it is handed over (the pool returns it to the stream)
+			if (verify && imdma_verify_counter_u64(&verifyState, view.data, view.length_bytes) != 0)
 			{
-				std::cerr << "failed to start transfer" << std::endl;
-				continue;
+				std::cerr << "transfer " << transferFinishCount << ": counter errors" << std::endl;
+				std::lock_guard<std::mutex> lock(compressor.mutex);
+				compressor.verifyErrors.insert(view.sequence);
 			}
-			pendingTransfers.push(std::move(transfer));
-			transferStartCount++;
+			if (compressor.failed || imdma_pool_submit(pool, &view) != 0)
+			{
+				std::cerr << "failed to record transfer" << std::endl;
+				break;
+			}
+			transferFinishCount++;
+			continue;
+		}
+
+		// Copy the block out of the DMA buffer so it can be re-armed before the write
+		BlockWriter::Buffer *buffer = NULL;
+		unsigned char *blockData = NULL;
+		unsigned int length = 0;
+		if (ring)
+		{
+			blockData = view.length_bytes != 0 ? ring->next() : NULL;
+			if (blockData != NULL)
+			{
+				length = imdma_transfer_copy_out(view.transfer, blockData, view.length_bytes);
+			}
+			droppedBefore = droppedBefore || (blockData == NULL && view.length_bytes != 0);
+		}
+		else if ((buffer = view.length_bytes != 0 ? writer->acquire() : NULL) == NULL)
+		{
+			droppedBefore = droppedBefore || view.length_bytes != 0;
+		}
+		else if (segmentBytes == 0)
+		{
+			blockData = buffer->data;
+			length = imdma_transfer_copy_out(view.transfer, blockData, view.length_bytes);
+			buffer->length = length;
+			buffer->path = blockFileName(filename, view.sequence);
+		}
+		else if (recording.place(*buffer, recordHeader(view)))
+		{
+			blockData = buffer->data + sizeof(imdma_record_block_header_t);
+			length = imdma_transfer_copy_out(view.transfer, blockData, view.length_bytes);
+			std::memset(blockData + length, 0, buffer->length - sizeof(imdma_record_block_header_t) - length);
 		}
 		else
 		{
-			std::unique_ptr<Transfer> &transfer = pendingTransfers.front();
-			finishTransfer(filename, transferFinishCount++, *transfer, timeoutMs);
-			pendingTransfers.pop();
+			break;
+		}
+
+		// Verify the cached copy (reading the DMA buffer again may be slow), or the block itself if dropped
+		unsigned long long errors = 0;
+		if (verify)
+		{
+			const void *data = blockData != NULL ? blockData : view.data;
+			errors = imdma_verify_counter_u64(&verifyState, data, view.length_bytes);
+			if (errors != 0)
+			{
+				std::cerr << "transfer " << transferFinishCount << ": " << errors << " counter errors" << std::endl;
+			}
+		}
+
+		uint32_t flags = (errors != 0 ? IMDMA_RECORD_FLAG_VERIFY_ERROR : 0) |
+		                 (droppedBefore ? IMDMA_RECORD_FLAG_AFTER_DROP : 0);
+		bool matched = blockData != NULL && !pattern.empty() &&
+		               memmem(blockData, length, pattern.data(), pattern.size()) != NULL;
+
+		if (buffer != NULL && buffer->segment)
+		{
+			imdma_record_block_header_t header = recordHeader(view);
+			header.flags = flags;
+			std::memcpy(buffer->data, &header, sizeof(header));
+			droppedBefore = false;
+		}
+
+		if (stream.done(view) != 0)
+		{
+			std::cerr << "failed to restart transfer" << std::endl;
+			break;
+		}
+
+		if (buffer != NULL)
+		{
+			writer->submit(buffer);
 		}
+		else if (ring && blockData != NULL)
+		{
+			ring->commit(view, length, flags, matched);
+			droppedBefore = false;
+		}
+		transferFinishCount++;
 	}
 
-	// Finishing remaining pending transfers
-	while (pendingTransfers.size() > 0)
+	if (pool != NULL)
 	{
-		std::unique_ptr<Transfer> &transfer = pendingTransfers.front();
-		finishTransfer(filename, transferFinishCount++, *transfer, timeoutMs);
-		pendingTransfers.pop();
+		imdma_pool_free(pool); // emits the blocks still being compressed
 	}
 
-	std::cout << "Completed " << transferStartCount << " transfers" << std::endl;
+	double captureSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << "Completed " << transferFinishCount << " transfers in " << captureSeconds << " seconds" << std::endl;
+
+	if (ring)
+	{
+		interrupt.stop();
+		triggerRing = NULL;
+		ring->finish(); // writes the rest of an event in progress
+		TriggerRing::Statistics events = ring->statistics();
+		std::cout << "Triggers: " << events.triggers << " triggers, " << events.events << " events written ("
+		          << events.deferred << " deferred, "
+		          << events.blocksWritten << " blocks, " << static_cast<double>(events.bytesWritten) / 1024 / 1024
+		          << " MiB), " << events.overruns << " overruns, " << events.writeErrors << " write errors"
+		          << std::endl;
+		ring.reset();
+	}
+	else
+	{
+		writer->finish();
+		recording.close(); // closes the last segment (every block in it has been written)
+		BlockWriter::Statistics writes = writer->statistics();
+		double writtenMiB = static_cast<double>(writes.writtenBytes) / 1024 / 1024;
+		std::cout << "Writer: " << writes.written << (segmentBytes != 0 ? " blocks in " : " files");
+		if (segmentBytes != 0)
+		{
+			std::cout << recording.segments() << " segments";
+		}
+		std::cout << " (" << writtenMiB << " MiB";
+		if (writes.writeSeconds > 0)
+		{
+			std::cout << ", " << writtenMiB / writes.writeSeconds << " MiB/s";
+		}
+		std::cout << "), " << writes.writeErrors << " write errors";
+		if (writes.buffered != 0)
+		{
+			std::cout << ", " << writes.buffered << " without O_DIRECT";
+		}
+		std::cout << std::endl;
+		std::cout << "Backpressure: queue high-water " << writes.maxQueued << " of " << queueDepth << ", "
+		          << writes.stalls << " capture stalls (" << writes.stallNs / 1e6 << " ms), " << writes.drops
+		          << " dropped blocks" << std::endl;
+		if (compress)
+		{
+			std::cout << "Compression: " << imdma_record_codec_name(compressor.codec) << " level " << compressor.level
+			          << ", " << compressor.blocks << " blocks, " << compressor.lengthBytes / 1024.0 / 1024
+			          << " MiB -> " << compressor.storedBytes / 1024.0 / 1024 << " MiB (ratio "
+			          << (compressor.storedBytes != 0 ? double(compressor.lengthBytes) / compressor.storedBytes : 0)
+			          << "), " << compressor.uncompressed << " blocks stored uncompressed" << std::endl;
+		}
+	}
+
+	if (verify)
+	{
+		// The error count includes a mismatch on the final word that no later block classified
+		std::cout << "Verify: " << verifyState.words << " words, " << verifyState.gaps << " gaps ("
+		          << verifyState.missing_words << " missing words), " << verifyState.duplicates << " duplicates, "
+		          << verifyState.corrupt_words << " corrupt words, " << imdma_verify_errors(&verifyState) << " errors";
+		if (verifyState.pending)
+		{
+			std::cout << " (1 mismatched final word)";
+		}
+		std::cout << std::endl;
+	}
 
 	return 0;
 }
+
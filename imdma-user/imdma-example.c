@@ -44,6 +44,7 @@ int main(int argc, const char *const argv[])
 	{
 		printf("Usage: %s <device> [lengthBytes:1000] [print:off|u64|x|fl]\n", argv[0]);
 		printf("Example: %s /dev/imdma_downsampled\n", argv[0]);
+		printf("Example: %s sim:block=4KiB,pattern=counter 64 u64\n", argv[0]);
 		return 1;
 	}
 
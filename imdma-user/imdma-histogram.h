@@ -0,0 +1,114 @@
+// IMSAR DMA latency histogram (header only, C++)
+//
+// Log-linear buckets in the style of HdrHistogram: values below 64 are counted exactly and every
+// power of two above that is split into 32 buckets, so any recorded value is reported with
+// less than 3.2% error. Recording is a couple of shifts and an increment (no allocation).
+
+#ifndef __IMDMA_HISTOGRAM_H
+#define __IMDMA_HISTOGRAM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+class LatencyHistogram
+{
+public:
+	LatencyHistogram() { reset(); }
+
+	void reset()
+	{
+		std::memset(counts, 0, sizeof(counts));
+		totalCount = 0;
+		minValue = UINT64_MAX;
+		maxValue = 0;
+		sum = 0;
+	}
+
+	void record(uint64_t value)
+	{
+		counts[bucketIndex(value)]++;
+		totalCount++;
+		minValue = std::min(minValue, value);
+		maxValue = std::max(maxValue, value);
+		sum += value;
+	}
+
+	void merge(const LatencyHistogram &other)
+	{
+		for (unsigned int i = 0; i < kBucketCount; i++)
+		{
+			counts[i] += other.counts[i];
+		}
+		totalCount += other.totalCount;
+		minValue = std::min(minValue, other.minValue);
+		maxValue = std::max(maxValue, other.maxValue);
+		sum += other.sum;
+	}
+
+	uint64_t count() const { return totalCount; }
+	uint64_t min() const { return totalCount ? minValue : 0; }
+	uint64_t max() const { return maxValue; }
+	double mean() const { return totalCount ? static_cast<double>(sum) / totalCount : 0; }
+
+	// Get the value at the given percentile (0..100); reported as the highest value of its bucket
+	uint64_t percentile(double percent) const
+	{
+		if (totalCount == 0)
+		{
+			return 0;
+		}
+
+		uint64_t target = static_cast<uint64_t>(percent / 100 * totalCount + 0.5);
+		target = std::max<uint64_t>(1, std::min(target, totalCount));
+
+		uint64_t seen = 0;
+		for (unsigned int i = 0; i < kBucketCount; i++)
+		{
+			seen += counts[i];
+			if (seen >= target)
+			{
+				return std::min(bucketHighestValue(i), maxValue);
+			}
+		}
+		return maxValue;
+	}
+
+private:
+	static constexpr unsigned int kLinearCount = 64;                  // values counted exactly
+	static constexpr unsigned int kSubBucketCount = kLinearCount / 2; // buckets per power of two above that
+	static constexpr unsigned int kBucketCount = kLinearCount + (64 - 6) * kSubBucketCount;
+
+	static unsigned int bucketIndex(uint64_t value)
+	{
+		if (value < kLinearCount)
+		{
+			return static_cast<unsigned int>(value);
+		}
+
+		// value >> shift is in [32, 64)
+		unsigned int shift = 63 - __builtin_clzll(value) - 5;
+		unsigned int subBucket = static_cast<unsigned int>(value >> shift) - kSubBucketCount;
+		return kLinearCount + (shift - 1) * kSubBucketCount + subBucket;
+	}
+
+	static uint64_t bucketHighestValue(unsigned int index)
+	{
+		if (index < kLinearCount)
+		{
+			return index;
+		}
+
+		unsigned int shift = (index - kLinearCount) / kSubBucketCount + 1;
+		uint64_t subBucket = (index - kLinearCount) % kSubBucketCount + kSubBucketCount;
+		return ((subBucket + 1) << shift) - 1;
+	}
+
+	uint64_t counts[kBucketCount];
+	uint64_t totalCount;
+	uint64_t minValue;
+	uint64_t maxValue;
+	uint64_t sum;
+};
+
+#endif
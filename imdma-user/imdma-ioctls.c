@@ -7,6 +7,7 @@
 int main()
 {
     printf("IMDMA_BUFFER_GET_SPEC  = %lu\n", IMDMA_BUFFER_GET_SPEC);
+    printf("IMDMA_CHANNEL_GET_DIRECTION = %lu\n", IMDMA_CHANNEL_GET_DIRECTION);
     printf("IMDMA_BUFFER_RESERVE = %lu\n", IMDMA_BUFFER_RESERVE);
     printf("IMDMA_TRANSFER_START = %lu\n", IMDMA_TRANSFER_START);
     printf("IMDMA_TRANSFER_FINISH = %lu\n", IMDMA_TRANSFER_FINISH);
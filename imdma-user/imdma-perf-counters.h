@@ -0,0 +1,180 @@
+// IMSAR DMA hardware/software event counters (header only, C++)
+//
+// Counts events for the whole process with perf_event_open(). The counters must be opened
+// before any worker threads are created (inherited counters only follow new threads), and
+// read after those threads have exited (their counts are added to ours when they exit).
+// Events the kernel or CPU does not provide (no PMU, perf_event_paranoid, no tracefs) are
+// reported as unavailable instead of failing.
+
+#ifndef __IMDMA_PERF_COUNTERS_H
+#define __IMDMA_PERF_COUNTERS_H
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+class PerfCounters
+{
+public:
+	enum Event
+	{
+		Cycles,
+		Instructions,
+		CacheMisses,
+		ContextSwitches,
+		Syscalls,
+		EventCount
+	};
+
+	PerfCounters()
+	{
+		for (int i = 0; i < EventCount; i++)
+		{
+			fds[i] = -1;
+			userOnly[i] = false;
+		}
+	}
+
+	~PerfCounters() { close(); }
+
+	// Open every available counter (disabled)
+	void open()
+	{
+		openEvent(Cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+		openEvent(Instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+		openEvent(CacheMisses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		openEvent(ContextSwitches, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+
+		long syscallId = tracepointId("raw_syscalls/sys_enter");
+		if (syscallId >= 0)
+		{
+			openEvent(Syscalls, PERF_TYPE_TRACEPOINT, syscallId);
+		}
+	}
+
+	void close()
+	{
+		for (int i = 0; i < EventCount; i++)
+		{
+			if (fds[i] >= 0)
+			{
+				::close(fds[i]);
+				fds[i] = -1;
+			}
+		}
+	}
+
+	void start()
+	{
+		for (int i = 0; i < EventCount; i++)
+		{
+			if (fds[i] >= 0)
+			{
+				ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+				ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+	}
+
+	void stop()
+	{
+		for (int i = 0; i < EventCount; i++)
+		{
+			if (fds[i] >= 0)
+			{
+				ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+			}
+		}
+	}
+
+	bool available(Event event) const { return fds[event] >= 0; }
+
+	// True if the event only counts user space (kernel counting is not permitted)
+	bool isUserOnly(Event event) const { return userOnly[event]; }
+
+	// Read the count (scaled if the counter was multiplexed); returns false if unavailable
+	bool read(Event event, uint64_t &value) const
+	{
+		if (fds[event] < 0)
+		{
+			return false;
+		}
+
+		uint64_t data[3]; // value, time enabled, time running
+		if (::read(fds[event], data, sizeof(data)) != sizeof(data))
+		{
+			return false;
+		}
+
+		value = data[0];
+		if (data[2] > 0 && data[2] < data[1])
+		{
+			value = static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+		}
+		return true;
+	}
+
+	static const char *name(Event event)
+	{
+		static const char *const names[EventCount] = {"cycles", "instructions", "cache misses", "context switches",
+		                                              "syscalls"};
+		return names[event];
+	}
+
+private:
+	void openEvent(Event event, uint32_t type, uint64_t config)
+	{
+		struct perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.inherit = 1; // follow threads created after this point
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		fds[event] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fds[event] < 0 && type != PERF_TYPE_TRACEPOINT)
+		{
+			// perf_event_paranoid may only allow user space counting
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fds[event] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+			userOnly[event] = fds[event] >= 0;
+		}
+	}
+
+	static long tracepointId(const char *event)
+	{
+		static const char *const roots[] = {"/sys/kernel/tracing/events/", "/sys/kernel/debug/tracing/events/"};
+		for (const char *root : roots)
+		{
+			char path[256];
+			snprintf(path, sizeof(path), "%s%s/id", root, event);
+			FILE *file = fopen(path, "r");
+			if (file == NULL)
+			{
+				continue;
+			}
+
+			long id = -1;
+			if (fscanf(file, "%ld", &id) != 1)
+			{
+				id = -1;
+			}
+			fclose(file);
+			return id;
+		}
+		return -1;
+	}
+
+	int fds[EventCount];
+	bool userOnly[EventCount];
+};
+
+#endif
@@ -2,235 +2,720 @@
 
 extern "C"
 {
+#include "libimdma-verify.h"
 #include "libimdma.h"
 }
 
+#include "imdma-histogram.h"
+#include "imdma-perf-counters.h"
+#include "imdma-rusage.h"
+#include "imdma-tx-source.h"
+
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
+#include <time.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <chrono>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
-#include <queue>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
+// Statistics for one device (updated by its worker thread, read by the main thread)
 struct StatisticsRecorder
 {
-	StatisticsRecorder() : nextPrintTime{std::chrono::steady_clock::now() + std::chrono::seconds(1)} {}
+	// Record one block (releaseNs is the time spent returning it to the stream; errors found by verification)
+	void addTransfer(const imdma_stream_view_t &view, uint64_t releaseNs, unsigned long long errors)
+	{
+		uint64_t latencyNs = view.complete_ns - view.submit_ns;
 
-	void start() { startTime = std::chrono::steady_clock::now(); }
+		std::lock_guard<std::mutex> lock(mutex);
+		if (view.length_bytes != 0)
+		{
+			totalBytes += view.length_bytes;
+			bytesInLastSecond += view.length_bytes;
+			totalTransfers += 1;
+			transfersInLastSecond += 1;
+		}
+		errorsInLastSecond += errors;
+		latencyInLastSecond.record(latencyNs);
+		latency.record(latencyNs);
+		startIoctl.record(view.start_ioctl_ns);
+		waitIoctl.record(view.wait_ns);
+		release.record(releaseNs);
+	}
 
-	void stop() { stopTime = std::chrono::steady_clock::now(); }
+	// Move the counts of the last second into the given recorder (and reset them here)
+	void takeLastSecond(StatisticsRecorder &target)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		target.bytesInLastSecond += bytesInLastSecond;
+		target.transfersInLastSecond += transfersInLastSecond;
+		target.errorsInLastSecond += errorsInLastSecond;
+		target.verifying = target.verifying || verifying;
+		target.latencyInLastSecond.merge(latencyInLastSecond);
+		bytesInLastSecond = 0;
+		transfersInLastSecond = 0;
+		errorsInLastSecond = 0;
+		latencyInLastSecond.reset();
+	}
 
-	void addTransfer(unsigned int lengthBytes)
+	// Add the totals into the given recorder
+	void mergeTotals(StatisticsRecorder &target)
 	{
-		totalBytes += lengthBytes;
-		bytesInLastSecond += lengthBytes;
-		totalTransfers += 1;
-		transfersInLastSecond += 1;
+		std::lock_guard<std::mutex> lock(mutex);
+		target.totalBytes += totalBytes;
+		target.totalTransfers += totalTransfers;
+		target.latency.merge(latency);
+		target.startIoctl.merge(startIoctl);
+		target.waitIoctl.merge(waitIoctl);
+		target.release.merge(release);
 	}
 
-	void printPeriodic()
+	void printLastSecond(const std::string &label)
 	{
-		auto now = std::chrono::steady_clock::now();
-		if (now < nextPrintTime)
+		std::cout << label << bytesInLastSecond << " B/s " << transfersInLastSecond << " Blocks/s";
+		if (latencyInLastSecond.count() > 0)
 		{
-			return;
+			std::cout << " latency(us) " << percentiles(latencyInLastSecond);
 		}
-
-		std::cout << bytesInLastSecond << " B/s " << transfersInLastSecond << " Blocks/s" << std::endl;
-
-		bytesInLastSecond = 0;
-		transfersInLastSecond = 0;
-
-		nextPrintTime = now + std::chrono::seconds(1);
+		if (verifying)
+		{
+			std::cout << " errors=" << errorsInLastSecond;
+		}
+		std::cout << std::endl;
 	}
 
-	void printFinal()
+	void printFinal(const std::string &label, double durationSeconds)
 	{
 		float totalMiB = static_cast<float>(totalBytes) / 1024 / 1024;    // MiB
 		float totalMb = static_cast<float>(totalBytes) * 8 / 1000 / 1000; // Mb
-		double durationSeconds = std::chrono::duration<double>(stopTime - startTime).count();
-		std::cout << "Totals: " << totalBytes << " B " << totalTransfers << " Blocks" << std::endl;
-		std::cout << durationSeconds << " seconds" << std::endl;
-		std::cout << (totalMiB / durationSeconds) << " MiB/s (" << (totalMb / durationSeconds) << " Mb/s)" << std::endl;
+		std::cout << label << "Totals: " << totalBytes << " B " << totalTransfers << " Blocks" << std::endl;
+		std::cout << label << durationSeconds << " seconds" << std::endl;
+		std::cout << label << (totalMiB / durationSeconds) << " MiB/s (" << (totalMb / durationSeconds) << " Mb/s)"
+		          << std::endl;
+
+		if (latency.count() > 0)
+		{
+			std::cout << label << "Latency (us):" << std::endl;
+			std::cout << label << "  submit to finish " << percentiles(latency) << std::endl;
+			std::cout << label << "  start ioctl      " << percentiles(startIoctl) << std::endl;
+			std::cout << label << "  finish ioctl     " << percentiles(waitIoctl) << std::endl;
+			std::cout << label << "  release/re-arm   " << percentiles(release) << std::endl;
+		}
+	}
+
+	static std::string percentiles(const LatencyHistogram &histogram)
+	{
+		std::ostringstream out;
+		out << std::fixed << std::setprecision(1);
+		out << "p50=" << histogram.percentile(50) / 1e3 << " p99=" << histogram.percentile(99) / 1e3
+		    << " p99.9=" << histogram.percentile(99.9) / 1e3 << " max=" << histogram.max() / 1e3;
+		return out.str();
 	}
 
-	std::chrono::steady_clock::time_point startTime;
-	std::chrono::steady_clock::time_point stopTime;
+	std::mutex mutex;
 
 	unsigned long totalBytes{0};
 	unsigned long totalTransfers{0};
 	unsigned long bytesInLastSecond{0};
 	unsigned long transfersInLastSecond{0};
-
-	std::chrono::steady_clock::time_point nextPrintTime;
+	unsigned long long errorsInLastSecond{0};
+	bool verifying{false}; // print the verification errors
+
+	LatencyHistogram latencyInLastSecond; // submit to finish (reset every second)
+	LatencyHistogram latency;             // submit to finish
+	LatencyHistogram startIoctl;          // time in the start ioctl
+	LatencyHistogram waitIoctl;           // time in the finish ioctl
+	LatencyHistogram release;             // time in imdma_stream_done() (re-arm)
 };
 
-struct TransferEntry
+// Round trip measurement across an MM2S channel looped back to an S2MM channel (FPGA loopback design)
+// The sender stamps the start of every block just before it is queued; the receiver matches the stamps.
+struct Loopback
 {
-	TransferEntry(imdma_transfer_t *transfer) : transfer{transfer}, startTime{std::chrono::steady_clock::now()} {}
-	imdma_transfer_t *transfer;
-	std::chrono::steady_clock::time_point startTime;
+	struct Stamp
+	{
+		uint64_t magic;
+		uint64_t sequence;
+		uint64_t sendNs; // CLOCK_MONOTONIC (the clock of imdma_stream_view_t)
+	};
+
+	static const uint64_t kMagic = 0x4f4f4c414d444d49ull; // "IMDMALOO" (little-endian)
+
+	// Sender thread: stamp the block about to be sent
+	void stamp(void *data)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		Stamp stamp = {kMagic, nextSequence++, static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec};
+		std::memcpy(data, &stamp, sizeof(stamp));
+	}
+
+	// Receiver thread: match a received block to the stamp it was sent with
+	void receive(const imdma_stream_view_t &view)
+	{
+		Stamp stamp;
+		std::memcpy(&stamp, view.data, sizeof(stamp));
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stamp.magic != kMagic)
+		{
+			unstamped++;
+			return;
+		}
+
+		if (stamp.sequence < expectedSequence)
+		{
+			reordered++; // out of order or repeated
+		}
+		else
+		{
+			lost += stamp.sequence - expectedSequence;
+			expectedSequence = stamp.sequence + 1;
+		}
+
+		uint64_t roundTripNs = view.complete_ns - stamp.sendNs;
+		roundTripInLastSecond.record(roundTripNs);
+		roundTrip.record(roundTripNs);
+		matched++;
+	}
+
+	void printLastSecond()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::cout << "[loopback] " << roundTripInLastSecond.count() << " matched";
+		if (roundTripInLastSecond.count() > 0)
+		{
+			std::cout << " round trip(us) " << StatisticsRecorder::percentiles(roundTripInLastSecond);
+		}
+		std::cout << std::endl;
+		roundTripInLastSecond.reset();
+	}
+
+	void printFinal()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::cout << "Loopback: " << nextSequence << " sent, " << matched << " matched, " << lost << " lost, "
+		          << reordered << " out of order, " << unstamped << " unstamped" << std::endl;
+		if (roundTrip.count() > 0)
+		{
+			std::cout << "Round trip (us): " << StatisticsRecorder::percentiles(roundTrip)
+			          << " mean=" << roundTrip.mean() / 1e3 << std::endl;
+		}
+	}
+
+	uint64_t nextSequence{0}; // sender thread only
+
+	std::mutex mutex;
+	uint64_t expectedSequence{0};
+	unsigned long matched{0};
+	unsigned long lost{0};
+	unsigned long reordered{0};
+	unsigned long unstamped{0};
+	LatencyHistogram roundTripInLastSecond;
+	LatencyHistogram roundTrip;
 };
 
-static bool start_transfer(imdma_transfer_t *dmaTransfer, unsigned int lengthBytes, unsigned int timeoutMs)
+// One device driven by its own thread: <path>[@cpu[:depth]]
+struct DeviceWorker
 {
-	// std::cout << dmaTransfer << " start" << std::endl;
+	// Parse the device specification; returns false if it is invalid
+	bool parse(const std::string &text)
+	{
+		path = text;
+		size_t at = text.rfind('@');
+		if (at == std::string::npos)
+		{
+			return !path.empty();
+		}
+
+		path = text.substr(0, at);
+		std::string options = text.substr(at + 1);
+		size_t colon = options.find(':');
+		std::string cpuText = options.substr(0, colon);
+		char *end;
+		if (!cpuText.empty())
+		{
+			cpu = strtol(cpuText.c_str(), &end, 10);
+			if (*end != '\0' || cpu < 0)
+			{
+				return false;
+			}
+		}
+		if (colon != std::string::npos)
+		{
+			depth = strtoul(options.c_str() + colon + 1, &end, 10);
+			if (*end != '\0')
+			{
+				return false;
+			}
+		}
+		return !path.empty();
+	}
 
-	int setLenRc = imdma_transfer_set_length(dmaTransfer, lengthBytes);
-	if (setLenRc != 0)
+	bool open(unsigned int lengthBytes, unsigned int timeoutMs)
 	{
-		std::cerr << "failed to set transfer buffer length" << std::endl;
-		return false;
+		imdma = imdma_create(path.c_str());
+		if (imdma == NULL)
+		{
+			return false;
+		}
+
+		if (!txSpec.empty())
+		{
+			if (imdma_get_direction(imdma) == IMDMA_DIRECTION_RX)
+			{
+				std::cerr << path << ": transmit mode needs a host-to-device (MM2S) channel" << std::endl;
+				return false;
+			}
+			if (!txSource.open(txSpec))
+			{
+				return false;
+			}
+
+			// Start generating before the stream opens so the first blocks are ready
+			prefill.reset(new TxPrefill(txSource, lengthBytes, kTxPrefillDepth));
+			prefill->start();
+		}
+
+		// depth 0 keeps every buffer queued for peak throughput
+		stream = imdma_stream_open(imdma, depth, lengthBytes);
+		if (stream == NULL)
+		{
+			return false;
+		}
+
+		imdma_stream_set_timeout_ms(stream, timeoutMs);
+		return true;
 	}
 
-	// Request a single transfer
-	int startRc = imdma_transfer_start_async(dmaTransfer);
-	if (startRc != 0)
+	void close()
 	{
-		std::cerr << "failed to start transfer" << std::endl;
-		return false;
+		if (prefill)
+		{
+			prefill->stop();
+		}
+		if (stream != NULL)
+		{
+			imdma_stream_close(stream);
+			stream = NULL;
+		}
+		if (imdma != NULL)
+		{
+			imdma_free(imdma);
+			imdma = NULL;
+		}
 	}
 
-	int timeoutRc = imdma_transfer_set_timeout_ms(dmaTransfer, timeoutMs);
-	if (timeoutRc != 0)
+	void run(const volatile bool &running, std::chrono::steady_clock::time_point stopTime, bool timed)
 	{
-		std::cerr << "failed to set transfer timeout" << std::endl;
-		return false;
+		if (cpu >= 0)
+		{
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(cpu, &cpus);
+			int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+			if (rc != 0)
+			{
+				std::cerr << path << ": failed to pin to CPU " << cpu << ": " << strerror(rc) << std::endl;
+			}
+		}
+
+		while (running)
+		{
+			imdma_stream_view_t view;
+			int nextRc = imdma_stream_next(stream, &view);
+			if (nextRc != 0)
+			{
+				std::cerr << path << ": failed to finish transfer" << std::endl;
+				break;
+			}
+
+			unsigned long long errors = 0;
+			if (stats.verifying)
+			{
+				errors = imdma_verify_counter_u64(&verify, view.data, view.length_bytes);
+			}
+
+			// Transmit: copy the prefilled block into the DMA buffer (the next one is filled meanwhile)
+			if (prefill)
+			{
+				const TxPrefill::Block *block = prefill->acquire();
+				if (block == NULL || imdma_transfer_write(view.transfer, block->data, view.length_bytes) != 0)
+				{
+					std::cerr << path << ": failed to fill transmit block" << std::endl;
+					break;
+				}
+				prefill->release();
+			}
+
+			if (loopback != NULL && prefill)
+			{
+				loopback->stamp(imdma_transfer_get_data(view.transfer));
+			}
+			else if (loopback != NULL)
+			{
+				loopback->receive(view);
+			}
+
+			auto releaseStart = std::chrono::steady_clock::now();
+			int doneRc = imdma_stream_done(stream, &view);
+			auto releaseTime = std::chrono::steady_clock::now() - releaseStart;
+			if (doneRc != 0)
+			{
+				std::cerr << path << ": failed to restart transfer" << std::endl;
+				break;
+			}
+
+			// A transmit buffer handed out for the first time has not been sent yet
+			if (view.complete_ns != 0)
+			{
+				uint64_t releaseNs = std::chrono::duration_cast<std::chrono::nanoseconds>(releaseTime).count();
+				stats.addTransfer(view, releaseNs, errors);
+			}
+
+			if (timed && std::chrono::steady_clock::now() > stopTime)
+			{
+				break;
+			}
+		}
+
+		finished = true;
 	}
 
-	return true;
-}
+	std::string path;
+	int cpu{-1};           // -1 = not pinned
+	unsigned int depth{0}; // 0 = every buffer
 
-static unsigned int finish_transfer(imdma_transfer_t *dmaTransfer)
-{
-	// std::cout << dmaTransfer << " wait for finish" << std::endl;
+	imdma_t *imdma{NULL};
+	imdma_stream_t *stream{NULL};
+	std::thread thread;
+	std::atomic<bool> finished{false};
+
+	StatisticsRecorder stats;
+	imdma_verify_t verify; // counter pattern check state (if stats.verifying)
 
-	imdma_transfer_finish(dmaTransfer);
+	std::string txSpec; // transmit source ("" = receive)
+	TxSource txSource;
+	std::unique_ptr<TxPrefill> prefill;
 
-	const void *dmaBuffer = imdma_transfer_get_data_const(dmaTransfer);
-	if (dmaBuffer == nullptr)
+	Loopback *loopback{NULL}; // stamps sent blocks (transmit) or matches received ones
+};
+
+// Print the counter pattern check results; errors is imdma_verify_errors() (summed for the totals), which also
+// counts a mismatch on the final word that no later block classified
+static void printVerify(const std::string &label, const imdma_verify_t &verify, unsigned long long errors)
+{
+	unsigned long long unclassified = errors - verify.gaps - verify.duplicates - verify.corrupt_words;
+	std::cout << label << "Verify: " << verify.words << " words in " << verify.blocks << " blocks, " << verify.gaps
+	          << " gaps (" << verify.missing_words << " missing words), " << verify.duplicates << " duplicates, "
+	          << verify.corrupt_words << " corrupt words, " << errors << " errors";
+	if (unclassified != 0)
 	{
-		std::cerr << "unable to get data buffer" << std::endl;
-		return 0;
+		std::cout << " (" << unclassified << " mismatched final words)";
 	}
+	std::cout << std::endl;
+}
+
+// Print CPU time and event counts normalized per block and per MiB
+static void printCpuCost(const CpuUsage &cpu, const PerfCounters &counters, unsigned long totalBytes,
+                         unsigned long totalBlocks)
+{
+	double userSeconds = cpu.userSeconds();
+	double systemSeconds = cpu.systemSeconds();
+	double mib = static_cast<double>(totalBytes) / 1024 / 1024;
 
-	unsigned int dmaBufferLen = imdma_transfer_get_length(dmaTransfer);
-	if (dmaBufferLen == 0)
+	std::cout << "CPU: user " << userSeconds << " s, system " << systemSeconds << " s (" << cpu.percent()
+	          << "% of one CPU)" << std::endl;
+	if (totalBlocks == 0)
 	{
-		std::cerr << "no data was transferred" << std::endl;
-		return 0;
+		return;
 	}
 
-	imdma_transfer_free(dmaTransfer);
+	std::cout << "Cost:                       per block         per MiB" << std::endl;
+	auto row = [&](const std::string &name, double value) {
+		std::cout << "  " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+		          << std::setw(16) << value / totalBlocks << std::setw(16) << (mib > 0 ? value / mib : 0)
+		          << std::defaultfloat << std::endl;
+	};
+	row("cpu time (us)", (userSeconds + systemSeconds) * 1e6);
+	row("context switches*", cpu.contextSwitches());
 
-	return dmaBufferLen;
+	for (int i = 0; i < PerfCounters::EventCount; i++)
+	{
+		PerfCounters::Event event = static_cast<PerfCounters::Event>(i);
+		uint64_t value;
+		if (counters.read(event, value))
+		{
+			row(std::string(PerfCounters::name(event)) + (counters.isUserOnly(event) ? " (user)" : ""), value);
+		}
+		else
+		{
+			std::cout << "  " << std::left << std::setw(20) << PerfCounters::name(event) << std::right
+			          << "             n/a             n/a" << std::endl;
+		}
+	}
+	std::cout << "  (* from getrusage; n/a = perf event not available)" << std::endl;
 }
 
 volatile bool running = true;
 
-static void ctrlc(int sig)
+static void ctrlc(int)
 {
 	running = false;
 	signal(SIGINT, SIG_DFL);
 }
 
-int main(int argc, const char *const argv[])
+int main(int argc, char *const argv[])
 {
 	signal(SIGINT, ctrlc);
 
-	if (argc < 2)
+	bool verify = false;
+	bool loop = false;
+	std::string txSpec;
+	int opt;
+	while ((opt = getopt(argc, argv, "vlt:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'v':
+			verify = true;
+			break;
+		case 'l':
+			loop = true;
+			break;
+		case 't':
+			txSpec = optarg;
+			break;
+		default:
+			argc = 0; // print the usage
+			break;
+		}
+	}
+
+	if (optind >= argc || (verify && (loop || !txSpec.empty())))
 	{
-		std::cout << "Usage: " << argv[0] << " <device> [lengthBytes:1000] [seconds:0] [timeout_ms:3000]\n";
+		std::cout << "Usage: " << argv[0] << " [-v | -t source] <device>[@cpu[:depth]][+<device>...] [lengthBytes:1000]"
+		          << " [seconds:0] [timeout_ms:3000]\n";
+		std::cout << "       " << argv[0] << " -l [-t source] <tx device>[@cpu[:depth]]+<rx device>[@cpu[:depth]] ...\n";
+		std::cout << "  -v         verify the u64 counter test pattern in every block\n";
+		std::cout << "             (reports gaps, duplicates and corruption)\n";
+		std::cout << "  -t source  transmit (MM2S) instead of receive, filling every block from the source:\n";
+		std::cout << "             counter, zero, file:<path>, sine[:period[:amplitude]]\n";
+		std::cout << "  -l         loopback: send stamped blocks on the first device (default source zero), match\n";
+		std::cout << "             them on the second and report the round trip latency (depth 1 = unloaded)\n";
 		std::cout << "Example: " << argv[0] << " /dev/imdma_downsampled\n";
+		std::cout << "Example: " << argv[0] << " /dev/imdma_ch0@1:4+/dev/imdma_ch1@2:4 1048576 10\n";
+		std::cout << "Example: " << argv[0] << " sim:rate=800MBps,block=1MiB,pattern=counter 1048576 10\n";
+		std::cout << "Example: " << argv[0] << " -t sine:256 /dev/imdma_dac 1048576 10\n";
+		std::cout << "Example: " << argv[0] << " -l /dev/imdma_loop_tx@1:4+/dev/imdma_loop_rx@2 65536 10\n";
+		std::cout << "Example: " << argv[0] << " -l sim:direction=tx,loop=a+sim:loop=a 65536 10\n";
 		return 1;
 	}
 
-	const char *devicePath = argv[1];
-
-	imdma_t *imdma = imdma_create(devicePath);
-	if (imdma == NULL)
+	// One worker per device (each runs on its own thread)
+	std::vector<DeviceWorker *> workers;
+	std::string deviceList = argv[optind];
+	for (size_t start = 0; start <= deviceList.size();)
 	{
-		return -1;
+		size_t plus = deviceList.find('+', start);
+		if (plus == std::string::npos)
+		{
+			plus = deviceList.size();
+		}
+
+		DeviceWorker *worker = new DeviceWorker();
+		workers.push_back(worker);
+		if (!worker->parse(deviceList.substr(start, plus - start)))
+		{
+			std::cerr << "invalid device specification: " << deviceList.substr(start, plus - start) << std::endl;
+			return 1;
+		}
+		worker->stats.verifying = verify;
+		worker->txSpec = txSpec;
+		imdma_verify_init(&worker->verify);
+		start = plus + 1;
 	}
 
 	unsigned int lengthBytes = 1000;
-	if (argc >= 3)
+	if (optind + 1 < argc)
+	{
+		lengthBytes = strtoul(argv[optind + 1], NULL, 10);
+	}
+
+	// Loopback: the first device sends, the second receives
+	Loopback loopback;
+	if (loop)
 	{
-		lengthBytes = strtoul(argv[2], NULL, 10);
+		if (workers.size() != 2 || lengthBytes < sizeof(Loopback::Stamp))
+		{
+			std::cerr << "loopback needs exactly two devices (<tx>+<rx>) and lengthBytes >= "
+			          << sizeof(Loopback::Stamp) << std::endl;
+			return 1;
+		}
+		workers[0]->txSpec = txSpec.empty() ? "zero" : txSpec;
+		workers[1]->txSpec.clear();
+		for (DeviceWorker *worker : workers)
+		{
+			worker->loopback = &loopback;
+		}
 	}
 
 	unsigned int seconds = 0;
-	if (argc >= 4)
+	if (optind + 2 < argc)
 	{
-		seconds = strtoul(argv[3], NULL, 10);
+		seconds = strtoul(argv[optind + 2], NULL, 10);
 	}
 
 	unsigned int timeoutMs = 3000; // 3 seconds
-	if (argc >= 5)
+	if (optind + 3 < argc)
 	{
-		timeoutMs = strtoul(argv[4], NULL, 10);
+		timeoutMs = strtoul(argv[optind + 3], NULL, 10);
 	}
 
-	std::queue<imdma_transfer_t *> pendingTransfers;
-
-	StatisticsRecorder stats;
-
-	std::chrono::steady_clock::time_point stopTime = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+	if (verify && lengthBytes % 8 != 0)
+	{
+		std::cerr << "warning: lengthBytes is not a multiple of 8; the partial word of each block is not verified"
+		          << std::endl;
+	}
 
-	stats.start();
+	// Count CPU cost for the whole process: open the counters before the workers, since the inherited counters
+	// only follow threads created after them (the TX prefill and simulator producer threads start in open())
+	PerfCounters counters;
+	counters.open();
 
-	while (running)
+	for (DeviceWorker *worker : workers)
 	{
-		imdma_transfer_t *dmaTransfer = imdma_transfer_alloc(imdma);
-		if (dmaTransfer != nullptr)
+		if (!worker->open(lengthBytes, timeoutMs))
 		{
-			bool started = start_transfer(dmaTransfer, lengthBytes, timeoutMs);
-			if (!started)
+			for (DeviceWorker *w : workers)
 			{
-				break;
+				w->close();
+				delete w;
 			}
-			pendingTransfers.push(dmaTransfer);
+			return -1;
 		}
-		else
+	}
+
+	CpuUsage cpu;
+	counters.start();
+
+	auto startTime = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point stopTime = startTime + std::chrono::seconds(seconds);
+
+	for (DeviceWorker *worker : workers)
+	{
+		worker->thread = std::thread(&DeviceWorker::run, worker, std::cref(running), stopTime, seconds != 0);
+	}
+
+	// Print the per-device and aggregate rates every second until every worker has stopped
+	bool multiple = workers.size() > 1;
+	auto nextPrintTime = startTime + std::chrono::seconds(1);
+	while (true)
+	{
+		bool allFinished = true;
+		for (DeviceWorker *worker : workers)
 		{
-			imdma_transfer_t *finishedTransfer = pendingTransfers.front();
-			unsigned int transferredBytes = finish_transfer(finishedTransfer);
-			pendingTransfers.pop();
-			if (transferredBytes != 0)
-			{
-				stats.addTransfer(transferredBytes);
-			}
+			allFinished = allFinished && worker->finished;
+		}
+		if (allFinished)
+		{
+			break;
 		}
 
-		stats.printPeriodic();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		if (std::chrono::steady_clock::now() < nextPrintTime)
+		{
+			continue;
+		}
+		nextPrintTime += std::chrono::seconds(1);
 
-		auto now = std::chrono::steady_clock::now();
-		if (seconds != 0 && now > stopTime)
+		StatisticsRecorder aggregate;
+		for (DeviceWorker *worker : workers)
 		{
-			break;
+			StatisticsRecorder lastSecond;
+			worker->stats.takeLastSecond(lastSecond);
+			if (multiple)
+			{
+				lastSecond.printLastSecond("[" + worker->path + "] ");
+			}
+			lastSecond.takeLastSecond(aggregate);
+		}
+		aggregate.printLastSecond(multiple ? "[all] " : "");
+		if (loop)
+		{
+			loopback.printLastSecond();
 		}
 	}
 
-	// Finishing remaining pending transfers
-	while (pendingTransfers.size() > 0)
+	for (DeviceWorker *worker : workers)
 	{
-		imdma_transfer_t *finishedTransfer = pendingTransfers.front();
-		unsigned int transferredBytes = finish_transfer(finishedTransfer);
-		pendingTransfers.pop();
-		if (transferredBytes != 0)
-		{
-			stats.addTransfer(transferredBytes);
-		}
-		stats.printPeriodic();
+		worker->thread.join();
 	}
 
-	stats.stop();
+	counters.stop();
+
+	double durationSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
 
-	stats.printFinal();
+	StatisticsRecorder aggregate;
+	imdma_verify_t verifyTotals;
+	imdma_verify_init(&verifyTotals);
+	unsigned long long verifyErrors = 0;
+	unsigned long fillStalls = 0;
+	for (DeviceWorker *worker : workers)
+	{
+		worker->close();
+		if (multiple)
+		{
+			worker->stats.printFinal("[" + worker->path + "] ", durationSeconds);
+			if (verify)
+			{
+				printVerify("[" + worker->path + "] ", worker->verify, imdma_verify_errors(&worker->verify));
+			}
+			if (worker->prefill)
+			{
+				std::cout << "[" << worker->path << "] Fill stalls: " << worker->prefill->stallCount() << std::endl;
+			}
+		}
+		if (worker->prefill)
+		{
+			fillStalls += worker->prefill->stallCount();
+		}
+		worker->stats.mergeTotals(aggregate);
+		verifyTotals.blocks += worker->verify.blocks;
+		verifyTotals.words += worker->verify.words;
+		verifyTotals.gaps += worker->verify.gaps;
+		verifyTotals.missing_words += worker->verify.missing_words;
+		verifyTotals.duplicates += worker->verify.duplicates;
+		verifyTotals.corrupt_words += worker->verify.corrupt_words;
+		verifyErrors += imdma_verify_errors(&worker->verify);
+		delete worker;
+	}
+	aggregate.printFinal(multiple ? "[all] " : "", durationSeconds);
+	if (verify)
+	{
+		printVerify(multiple ? "[all] " : "", verifyTotals, verifyErrors);
+	}
+	if (!txSpec.empty() && !loop)
+	{
+		std::cout << (multiple ? "[all] " : "") << "Transmit: " << txSpec << ", " << fillStalls
+		          << " fill stalls (channel waited on the source)" << std::endl;
+	}
+	if (loop)
+	{
+		loopback.printFinal();
+	}
 
-	imdma_free(imdma);
+	printCpuCost(cpu, counters, aggregate.totalBytes, aggregate.totalTransfers);
 
 	return 0;
 }
@@ -0,0 +1,413 @@
+// IMSAR DMA utility to play recorded captures back into a transmit (MM2S) channel
+//
+// Reads the segment files written by imdma-dump and sends every block, in order, at its recorded
+// time relative to the first block (scaled by -x), or back to back with -f. Each further recording
+// argument (and each loop) is rebased to follow the previous one. A loader thread (StagingRing) reads
+// ahead of the channel (readahead on the mapped segments, decompression) into staging buffers, so
+// the send loop only copies into the DMA buffer and waits for the block's time. A block handed to
+// the channel later than its time by more than the tolerance is an underrun: the disk, the loader
+// or the channel could not keep up with the recorded rate.
+
+extern "C"
+{
+#include "libimdma-record.h"
+#include "libimdma.h"
+}
+
+#include "imdma-histogram.h"
+#include "imdma-tx-source.h"
+
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+volatile bool running = true;
+
+static void ctrlc(int)
+{
+	running = false;
+	signal(SIGINT, SIG_DFL);
+}
+
+static uint64_t nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleepUntilNs(uint64_t deadlineNs)
+{
+	struct timespec ts;
+	ts.tv_sec = deadlineNs / 1000000000ull;
+	ts.tv_nsec = deadlineNs % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && running)
+	{
+	}
+}
+
+// Expand a recording argument: a segment file, or the prefix given to imdma-dump (all of its segments)
+static std::vector<std::string> segmentFiles(const std::string &recording)
+{
+	std::vector<std::string> files;
+	std::string suffix = IMDMA_RECORD_SUFFIX;
+	if (recording.size() > suffix.size() && recording.compare(recording.size() - suffix.size(), suffix.size(),
+	                                                          suffix) == 0)
+	{
+		files.push_back(recording);
+		return files;
+	}
+
+	for (unsigned long long index = 0;; index++)
+	{
+		std::stringstream ss;
+		ss << recording << std::setfill('0') << std::setw(6) << index << IMDMA_RECORD_SUFFIX;
+		if (access(ss.str().c_str(), R_OK) != 0)
+		{
+			break;
+		}
+		files.push_back(ss.str());
+	}
+	return files;
+}
+
+// Reads the recordings block by block (a StagingRing source, so the reads run on the ring's thread)
+class RecordingSource
+{
+public:
+	struct Info
+	{
+		uint32_t length{0};
+		uint32_t flags{0};
+		uint64_t timeNs{0}; // recorded time, continued across recordings and loops
+	};
+
+	// recordings: the segment files of each recording argument, in order; depth: blocks read ahead
+	RecordingSource(const std::vector<std::vector<std::string>> &recordings, unsigned int loops, unsigned int depth)
+	    : recordings(recordings), loops(loops), depth(depth)
+	{
+	}
+
+	~RecordingSource()
+	{
+		if (record != NULL)
+		{
+			imdma_record_close(record);
+		}
+	}
+
+	RecordingSource(const RecordingSource &) = delete;
+	RecordingSource &operator=(const RecordingSource &) = delete;
+
+	FillResult fill(void *dst, size_t blockBytes, Info &info)
+	{
+		FillResult result = nextBlock();
+		if (result != FillResult::Filled)
+		{
+			return result;
+		}
+
+		// Keep the disk a full ring ahead of the copies (at the start of a segment, the first ring as well)
+		if (blockIndex == 0)
+		{
+			imdma_record_prefetch(record, 0, 2 * depth);
+		}
+		else if (blockIndex % depth == 0)
+		{
+			imdma_record_prefetch(record, blockIndex + depth, depth);
+		}
+
+		imdma_record_block_t block;
+		int rc = imdma_record_get_block(record, blockIndex, &block);
+		if (rc == 0 && block.length_bytes > blockBytes)
+		{
+			rc = EOVERFLOW;
+		}
+		if (rc == 0)
+		{
+			rc = imdma_record_read_block(record, blockIndex, dst, blockBytes);
+		}
+		if (rc != 0)
+		{
+			std::cerr << recordings[recordingIndex][fileIndex] << ": block " << blockIndex << ": " << strerror(rc)
+			          << std::endl;
+			return FillResult::Failed;
+		}
+
+		// Every recording has its own clock: its first block is placed at offsetNs
+		firstNs = count == 0 ? block.timestamp_ns : firstNs;
+		lastNs = block.timestamp_ns;
+		count++;
+		blockIndex++;
+		info.length = block.length_bytes;
+		info.flags = block.flags;
+		info.timeNs = offsetNs + block.timestamp_ns - firstNs;
+		return FillResult::Filled;
+	}
+
+private:
+	// Move to the next block, opening the next segment, recording or loop as each one runs out
+	FillResult nextBlock()
+	{
+		while (record == NULL || blockIndex == blockCount)
+		{
+			if (record != NULL)
+			{
+				imdma_record_close(record);
+				record = NULL;
+				fileIndex++;
+			}
+
+			if (fileIndex == recordings[recordingIndex].size())
+			{
+				// The next recording (or loop) starts one average block interval after the last block
+				if (count != 0)
+				{
+					offsetNs += lastNs - firstNs + (count > 1 ? (lastNs - firstNs) / (count - 1) : 0);
+				}
+				loopCount += count;
+				count = 0;
+				fileIndex = 0;
+				if (++recordingIndex == recordings.size())
+				{
+					recordingIndex = 0;
+					if (loopCount == 0 || ++loop == loops)
+					{
+						return FillResult::Ended;
+					}
+					loopCount = 0;
+				}
+			}
+
+			record = imdma_record_open(recordings[recordingIndex][fileIndex].c_str());
+			if (record == NULL)
+			{
+				return FillResult::Failed;
+			}
+			blockIndex = 0;
+			blockCount = imdma_record_get_block_count(record);
+		}
+		return FillResult::Filled;
+	}
+
+	const std::vector<std::vector<std::string>> recordings;
+	const unsigned int loops; // 0 = until stopped
+	const unsigned int depth;
+
+	// Position
+	unsigned int loop{0};
+	size_t recordingIndex{0};
+	size_t fileIndex{0};
+	imdma_record_t *record{NULL};
+	uint64_t blockIndex{0};
+	uint64_t blockCount{0};
+
+	// Clock of the current recording
+	uint64_t offsetNs{0};
+	uint64_t firstNs{0};
+	uint64_t lastNs{0};
+	uint64_t count{0};     // blocks of the current recording so far
+	uint64_t loopCount{0}; // blocks of the current loop so far
+};
+
+typedef StagingRing<RecordingSource> BlockLoader;
+
+int main(int argc, char *const argv[])
+{
+	bool fast = false;
+	double speed = 1;
+	unsigned int loops = 1;
+	unsigned int depth = 16;
+	unsigned int toleranceUs = 1000;
+	unsigned int timeoutMs = 3000;
+	int opt;
+	while ((opt = getopt(argc, argv, "fx:l:q:u:t:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f':
+			fast = true;
+			break;
+		case 'x':
+			speed = strtod(optarg, NULL);
+			break;
+		case 'l':
+			loops = strtoul(optarg, NULL, 10);
+			break;
+		case 'q':
+			depth = strtoul(optarg, NULL, 10);
+			break;
+		case 'u':
+			toleranceUs = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			timeoutMs = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			argc = 0; // print the usage
+			break;
+		}
+	}
+
+	if (optind + 2 > argc || speed <= 0 || depth == 0)
+	{
+		std::cout << "Usage: " << argv[0] << " [-f] [-x speed] [-l loops] [-q depth] [-u us] [-t timeout_ms]"
+		          << " <device> <recording> [recording...]\n";
+		std::cout << "  recording  a segment file (*" IMDMA_RECORD_SUFFIX "), or the prefix given to imdma-dump\n";
+		std::cout << "  -f         send back to back as fast as the channel allows (ignore the recorded times)\n";
+		std::cout << "  -x speed   playback speed relative to the recording (default 1)\n";
+		std::cout << "  -l N       play the recording N times; 0 = until Ctrl-C (default 1)\n";
+		std::cout << "  -q N       blocks loaded ahead of the channel (default 16)\n";
+		std::cout << "  -u us      a block sent later than this after its time is an underrun (default 1000)\n";
+		std::cout << "  -t ms      transfer timeout (default 3000)\n";
+		std::cout << "Example: " << argv[0] << " /dev/imdma_tx /data/raw_\n";
+		return 1;
+	}
+
+	const char *devicePath = argv[optind];
+	std::vector<std::vector<std::string>> recordings;
+	for (int i = optind + 1; i < argc; i++)
+	{
+		recordings.push_back(segmentFiles(argv[i]));
+		if (recordings.back().empty())
+		{
+			std::cerr << argv[i] << ": no recording segments found" << std::endl;
+			return 1;
+		}
+	}
+
+	// The stream block length is the recorded one (shorter blocks are sent at their own length)
+	imdma_record_t *first = imdma_record_open(recordings[0][0].c_str());
+	if (first == NULL)
+	{
+		return 1;
+	}
+	unsigned int blockBytes = imdma_record_get_header(first)->block_bytes;
+	imdma_record_close(first);
+
+	imdma_t *imdma = imdma_create(devicePath);
+	if (imdma == NULL)
+	{
+		return 1;
+	}
+	if (imdma_get_direction(imdma) != IMDMA_DIRECTION_TX)
+	{
+		std::cerr << devicePath << ": not a transmit (MM2S) channel" << std::endl;
+		imdma_free(imdma);
+		return 1;
+	}
+	if (blockBytes > imdma_get_buffer_size(imdma))
+	{
+		std::cerr << "recorded blocks (" << blockBytes << " bytes) are larger than the channel buffers ("
+		          << imdma_get_buffer_size(imdma) << " bytes)" << std::endl;
+		imdma_free(imdma);
+		return 1;
+	}
+
+	imdma_stream_t *stream = imdma_stream_open(imdma, 0, blockBytes);
+	if (stream == NULL)
+	{
+		imdma_free(imdma);
+		return 1;
+	}
+	imdma_stream_set_timeout_ms(stream, timeoutMs);
+
+	signal(SIGINT, ctrlc);
+
+	RecordingSource source(recordings, loops, depth);
+	BlockLoader loader(source, blockBytes, depth);
+	loader.start();
+	loader.waitFilled();
+
+	unsigned long long sent = 0;
+	unsigned long long sentBytes = 0;
+	unsigned long long afterDrops = 0;
+	unsigned long long underruns = 0;
+	LatencyHistogram lateness; // ns after the block's time
+	uint64_t startNs = 0;
+	while (running)
+	{
+		const BlockLoader::Block *block = loader.acquire();
+		if (block == NULL)
+		{
+			break;
+		}
+
+		// A buffer to fill (the oldest sent one, once the channel has finished with it)
+		imdma_stream_view_t view;
+		int rc = imdma_stream_next(stream, &view);
+		if (rc != 0)
+		{
+			std::cerr << "failed to finish transfer: " << strerror(rc) << std::endl;
+			break;
+		}
+
+		// Fill the buffer ahead of time, so only the start of the transfer waits for the block's time
+		rc = imdma_transfer_write(view.transfer, block->data, block->info.length);
+		uint32_t length = block->info.length;
+		bool afterDrop = (block->info.flags & IMDMA_RECORD_FLAG_AFTER_DROP) != 0;
+		uint64_t timeNs = block->info.timeNs;
+		loader.release();
+		if (rc != 0)
+		{
+			break;
+		}
+
+		// Playback time starts with the first block
+		startNs = sent == 0 ? nowNs() : startNs;
+		uint64_t dueNs = startNs + static_cast<uint64_t>(timeNs / speed);
+		if (!fast)
+		{
+			sleepUntilNs(dueNs);
+		}
+
+		uint64_t startedNs = nowNs();
+		uint64_t late = startedNs - std::min(dueNs, startedNs);
+		lateness.record(late);
+		underruns += late > toleranceUs * 1000ull;
+
+		rc = imdma_stream_done(stream, &view);
+		if (rc != 0)
+		{
+			std::cerr << "failed to start transfer: " << strerror(rc) << std::endl;
+			break;
+		}
+		sent++;
+		sentBytes += length;
+		afterDrops += afterDrop;
+	}
+
+	double seconds = sent != 0 ? (nowNs() - startNs) / 1e9 : 0;
+	bool failed = loader.failed();
+	loader.stop();
+	imdma_stream_close(stream); // waits for the queued transfers
+	imdma_free(imdma);
+
+	std::cout << "Sent " << sent << " blocks (" << sentBytes / 1024.0 / 1024 << " MiB) in " << seconds << " seconds";
+	if (seconds > 0)
+	{
+		std::cout << " (" << sentBytes / 1024.0 / 1024 / seconds << " MiB/s)";
+	}
+	std::cout << std::endl;
+	if (!fast)
+	{
+		std::cout << "Underruns: " << underruns << " blocks more than " << toleranceUs << " us late (late p50 "
+		          << lateness.percentile(50) / 1000.0 << " us, p99 " << lateness.percentile(99) / 1000.0
+		          << " us, max " << lateness.max() / 1000.0 << " us)" << std::endl;
+	}
+	std::cout << "Loader: " << loader.stallCount() << " stalls (channel waited on the disk), " << afterDrops
+	          << " blocks recorded after drops" << std::endl;
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,68 @@
+// IMSAR DMA process CPU usage sampling (header only, C++)
+
+#ifndef __IMDMA_RUSAGE_H
+#define __IMDMA_RUSAGE_H
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <chrono>
+
+// CPU time used by the whole process (all threads) between two samples
+class CpuUsage
+{
+public:
+	CpuUsage() { sample(); }
+
+	// Start a new measurement interval
+	void sample()
+	{
+		wallStart = std::chrono::steady_clock::now();
+		getrusage(RUSAGE_SELF, &usageStart);
+	}
+
+	// CPU time since sample() as a percentage of one CPU (may exceed 100 with several threads)
+	double percent() const
+	{
+		struct rusage now;
+		getrusage(RUSAGE_SELF, &now);
+		double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+		return wallSeconds > 0 ? cpuSeconds(usageStart, now) / wallSeconds * 100 : 0;
+	}
+
+	// User and system CPU seconds since sample()
+	double userSeconds() const
+	{
+		struct rusage now;
+		getrusage(RUSAGE_SELF, &now);
+		return seconds(now.ru_utime) - seconds(usageStart.ru_utime);
+	}
+
+	double systemSeconds() const
+	{
+		struct rusage now;
+		getrusage(RUSAGE_SELF, &now);
+		return seconds(now.ru_stime) - seconds(usageStart.ru_stime);
+	}
+
+	// Voluntary and involuntary context switches since sample()
+	long contextSwitches() const
+	{
+		struct rusage now;
+		getrusage(RUSAGE_SELF, &now);
+		return (now.ru_nvcsw - usageStart.ru_nvcsw) + (now.ru_nivcsw - usageStart.ru_nivcsw);
+	}
+
+private:
+	static double seconds(const struct timeval &tv) { return tv.tv_sec + tv.tv_usec / 1e6; }
+
+	static double cpuSeconds(const struct rusage &start, const struct rusage &end)
+	{
+		return (seconds(end.ru_utime) - seconds(start.ru_utime)) + (seconds(end.ru_stime) - seconds(start.ru_stime));
+	}
+
+	std::chrono::steady_clock::time_point wallStart;
+	struct rusage usageStart;
+};
+
+#endif
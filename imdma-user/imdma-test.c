@@ -0,0 +1,448 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libimdma-record.h"
+#include "libimdma-verify.h"
+#include "libimdma.h"
+
+// Unit checks for the libimdma helpers that do not need a device: make test
+
+static int failures = 0;
+
+#define CHECK(condition)                                                                                               \
+	do                                                                                                                 \
+	{                                                                                                                  \
+		if (!(condition))                                                                                              \
+		{                                                                                                              \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                             \
+			failures++;                                                                                                \
+		}                                                                                                              \
+	} while (0)
+
+static void fillCounter(uint64_t *words, size_t count, uint64_t first)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		words[i] = first + i;
+	}
+}
+
+static void testVerifyContinuous(void)
+{
+	uint64_t block[64];
+	imdma_verify_t verify;
+	imdma_verify_init(&verify);
+
+	for (int i = 0; i < 4; i++)
+	{
+		fillCounter(block, 64, 100 + i * 64);
+		CHECK(imdma_verify_counter_u64(&verify, block, sizeof(block)) == 0);
+	}
+	CHECK(verify.words == 256);
+	CHECK(imdma_verify_errors(&verify) == 0);
+}
+
+static void testVerifyGapInBlock(void)
+{
+	uint64_t block[64];
+	imdma_verify_t verify;
+	imdma_verify_init(&verify);
+
+	fillCounter(block, 32, 0);
+	fillCounter(block + 32, 32, 40);
+	CHECK(imdma_verify_counter_u64(&verify, block, sizeof(block)) == 1);
+	CHECK(verify.gaps == 1);
+	CHECK(verify.missing_words == 8);
+	CHECK(verify.corrupt_words == 0);
+}
+
+static void testVerifyGapAtBlockEnd(void)
+{
+	uint64_t block[64];
+	imdma_verify_t verify;
+	imdma_verify_init(&verify);
+
+	// The jump starts on the last word of the first block
+	fillCounter(block, 63, 0);
+	block[63] = 100;
+	CHECK(imdma_verify_counter_u64(&verify, block, sizeof(block)) == 0);
+	CHECK(imdma_verify_errors(&verify) == 1);
+
+	fillCounter(block, 64, 101);
+	CHECK(imdma_verify_counter_u64(&verify, block, sizeof(block)) == 1);
+	CHECK(verify.gaps == 1);
+	CHECK(verify.missing_words == 100 - 63);
+	CHECK(verify.corrupt_words == 0);
+	CHECK(imdma_verify_errors(&verify) == 1);
+}
+
+static void testVerifyCorruptAtBlockEnd(void)
+{
+	uint64_t block[64];
+	imdma_verify_t verify;
+	imdma_verify_init(&verify);
+
+	// A single bad last word, the sequence continues in the next block
+	fillCounter(block, 64, 0);
+	block[63] = 12345;
+	CHECK(imdma_verify_counter_u64(&verify, block, sizeof(block)) == 0);
+
+	fillCounter(block, 64, 64);
+	CHECK(imdma_verify_counter_u64(&verify, block, sizeof(block)) == 1);
+	CHECK(verify.corrupt_words == 1);
+	CHECK(verify.gaps == 0);
+	CHECK(imdma_verify_errors(&verify) == 1);
+}
+
+// Fill block number i of a segment written by writeSegment()
+static void fillBlock(unsigned char *data, uint32_t blockBytes, unsigned int i)
+{
+	for (uint32_t byte = 0; byte < blockBytes; byte++)
+	{
+		data[byte] = (unsigned char)(i + byte / 64);
+	}
+}
+
+// Write a segment of count records of blockBytes each, stored with codec and with the record magic of block
+// damaged broken; returns its path (free it). An indexed segment ends with the index, as RecordSegment::close()
+// writes it; otherwise it was never closed (no index, zeros to the end of the preallocated file).
+// A codec that was not built in stores half of each block as a stand-in (the sizes can be checked, not the data).
+static char *writeSegment(unsigned int count, uint32_t blockBytes, uint32_t codec, unsigned int damaged, bool indexed)
+{
+	char *path = strdup("/tmp/imdma-test-XXXXXX");
+	int fd = mkstemp(path);
+	if (fd < 0)
+	{
+		free(path);
+		return NULL;
+	}
+
+	size_t boundBytes = imdma_record_compress_bound(codec, blockBytes);
+	size_t fileBytes = IMDMA_RECORD_ALIGNMENT + (count + 2) * imdma_record_block_stride(boundBytes); // zero tail
+	fileBytes += IMDMA_RECORD_ALIGNMENT; // room for the index
+	unsigned char *file = calloc(1, fileBytes);
+	unsigned char *data = malloc(blockBytes);
+	uint64_t *offsets = calloc(count, sizeof(uint64_t));
+	uint32_t *storedBytes = calloc(count, sizeof(uint32_t));
+
+	imdma_record_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IMDMA_RECORD_MAGIC, sizeof(header.magic));
+	header.version = IMDMA_RECORD_VERSION;
+	header.header_bytes = IMDMA_RECORD_ALIGNMENT;
+	header.alignment = IMDMA_RECORD_ALIGNMENT;
+	header.block_bytes = blockBytes;
+	memcpy(file, &header, sizeof(header));
+
+	size_t offset = IMDMA_RECORD_ALIGNMENT;
+	bool ok = true;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		imdma_record_block_header_t block;
+		memset(&block, 0, sizeof(block));
+		block.magic = i == damaged ? 0xdeadbeef : IMDMA_RECORD_BLOCK_MAGIC;
+		block.header_bytes = sizeof(block);
+		block.sequence = 10 + i;
+		block.length_bytes = blockBytes;
+		block.codec = codec;
+
+		unsigned char *record = file + offset;
+		fillBlock(data, blockBytes, i);
+		if (codec == IMDMA_RECORD_CODEC_NONE)
+		{
+			block.stored_bytes = blockBytes;
+			memcpy(record + sizeof(block), data, blockBytes);
+		}
+		else if (imdma_record_codec_available(codec))
+		{
+			block.stored_bytes = imdma_record_compress(codec, 1, data, blockBytes, record + sizeof(block), boundBytes);
+			ok = ok && block.stored_bytes != 0;
+		}
+		else
+		{
+			block.stored_bytes = blockBytes / 2;
+			memcpy(record + sizeof(block), data, block.stored_bytes);
+		}
+		memcpy(record, &block, sizeof(block));
+		offsets[i] = offset;
+		storedBytes[i] = block.stored_bytes;
+		offset += imdma_record_block_stride(block.stored_bytes);
+	}
+
+	if (indexed)
+	{
+		imdma_record_index_header_t indexHeader;
+		memset(&indexHeader, 0, sizeof(indexHeader));
+		memcpy(indexHeader.magic, IMDMA_RECORD_INDEX_MAGIC, sizeof(indexHeader.magic));
+		indexHeader.count = count;
+		memcpy(file + offset, &indexHeader, sizeof(indexHeader));
+
+		imdma_record_index_entry_t *entries = (imdma_record_index_entry_t *)(file + offset + sizeof(indexHeader));
+		for (unsigned int i = 0; i < count; i++)
+		{
+			entries[i].offset = offsets[i];
+			entries[i].stored_bytes = storedBytes[i];
+			entries[i].length_bytes = blockBytes;
+		}
+
+		// Padded to the alignment, and nothing after it (close() releases the rest of the preallocation)
+		size_t indexBytes = sizeof(indexHeader) + count * sizeof(imdma_record_index_entry_t);
+		size_t indexUnits = (indexBytes + IMDMA_RECORD_ALIGNMENT - 1) / IMDMA_RECORD_ALIGNMENT;
+		header.index_offset = offset;
+		header.block_count = count;
+		memcpy(file, &header, sizeof(header));
+		fileBytes = offset + indexUnits * IMDMA_RECORD_ALIGNMENT;
+	}
+
+	ok = ok && write(fd, file, fileBytes) == (ssize_t)fileBytes;
+	close(fd);
+	free(file);
+	free(data);
+	free(offsets);
+	free(storedBytes);
+	if (!ok)
+	{
+		unlink(path);
+		free(path);
+		return NULL;
+	}
+	return path;
+}
+
+static void testRecordScanResync(void)
+{
+	// Records span two alignment units, so the search has to step over the second half of the damaged one
+	char *path = writeSegment(4, IMDMA_RECORD_ALIGNMENT, IMDMA_RECORD_CODEC_NONE, 1, false);
+	CHECK(path != NULL);
+	if (path == NULL)
+	{
+		return;
+	}
+
+	imdma_record_t *record = imdma_record_open(path);
+	CHECK(record != NULL);
+	if (record != NULL)
+	{
+		CHECK(!imdma_record_is_indexed(record));
+		CHECK(imdma_record_get_block_count(record) == 3);
+		CHECK(imdma_record_get_skipped_regions(record) == 1);
+
+		imdma_record_block_t block;
+		CHECK(imdma_record_get_block(record, 1, &block) == 0 && block.sequence == 12);
+		imdma_record_close(record);
+	}
+
+	unlink(path);
+	free(path);
+}
+
+// Open the segment and check that it is read through its index (or by the scan) and holds count good blocks
+static void checkSegment(const char *path, unsigned int count, uint32_t blockBytes, uint32_t codec, bool indexed)
+{
+	imdma_record_t *record = imdma_record_open(path);
+	CHECK(record != NULL);
+	if (record == NULL)
+	{
+		return;
+	}
+
+	CHECK((imdma_record_is_indexed(record) != 0) == indexed);
+	CHECK(imdma_record_get_block_count(record) == count);
+
+	const unsigned char *map = (const unsigned char *)imdma_record_get_header(record);
+	unsigned char *expected = malloc(blockBytes);
+	unsigned char *data = malloc(blockBytes);
+	uint64_t offset = IMDMA_RECORD_ALIGNMENT;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		imdma_record_block_t block;
+		CHECK(imdma_record_get_block(record, i, &block) == 0);
+		CHECK(block.sequence == 10 + i && block.codec == codec && block.length_bytes == blockBytes);
+		CHECK(codec == IMDMA_RECORD_CODEC_NONE ? block.stored_bytes == blockBytes : block.stored_bytes < blockBytes);
+		CHECK(block.data == map + offset + sizeof(imdma_record_block_header_t));
+		offset += imdma_record_block_stride(block.stored_bytes);
+
+		fillBlock(expected, blockBytes, i);
+		if (codec == IMDMA_RECORD_CODEC_NONE || imdma_record_codec_available(codec))
+		{
+			CHECK(imdma_record_read_block(record, i, data, blockBytes) == 0 &&
+			      memcmp(data, expected, blockBytes) == 0);
+		}
+		else
+		{
+			CHECK(imdma_record_read_block(record, i, data, blockBytes) == ENOTSUP);
+		}
+	}
+	imdma_record_block_t block;
+	CHECK(imdma_record_get_block(record, count, &block) == ERANGE);
+
+	free(expected);
+	free(data);
+	imdma_record_close(record);
+}
+
+static void testRecordIndexed(uint32_t codec)
+{
+	const uint32_t blockBytes = 2 * IMDMA_RECORD_ALIGNMENT + 100;
+	char *path = writeSegment(4, blockBytes, codec, UINT32_MAX, true);
+	CHECK(path != NULL);
+	if (path == NULL)
+	{
+		return;
+	}
+
+	checkSegment(path, 4, blockBytes, codec, true);
+
+	imdma_record_t *record = imdma_record_open(path);
+	uint64_t indexOffset = record != NULL ? imdma_record_get_header(record)->index_offset : 0;
+	if (record != NULL)
+	{
+		imdma_record_close(record);
+	}
+	CHECK(indexOffset != 0);
+
+	// A damaged index magic falls back to walking the records
+	int fd = open(path, O_RDWR);
+	CHECK(fd >= 0 && pwrite(fd, "X", 1, indexOffset) == 1);
+	checkSegment(path, 4, blockBytes, codec, false);
+
+	// So does an index cut short (the count says more entries than the file holds)
+	CHECK(pwrite(fd, IMDMA_RECORD_INDEX_MAGIC, 1, indexOffset) == 1);
+	checkSegment(path, 4, blockBytes, codec, true);
+	CHECK(ftruncate(fd, indexOffset + sizeof(imdma_record_index_header_t) + sizeof(imdma_record_index_entry_t)) == 0);
+	checkSegment(path, 4, blockBytes, codec, false);
+	close(fd);
+
+	unlink(path);
+	free(path);
+}
+
+static void testRecordCodecRoundTrip(uint32_t codec)
+{
+	if (!imdma_record_codec_available(codec))
+	{
+		printf("%s codec not built in: round trip skipped\n", imdma_record_codec_name(codec));
+		return;
+	}
+
+	const uint32_t blockBytes = 3 * IMDMA_RECORD_ALIGNMENT + 100;
+	char *path = writeSegment(3, blockBytes, codec, UINT32_MAX, false);
+	CHECK(path != NULL);
+	if (path == NULL)
+	{
+		return;
+	}
+
+	imdma_record_t *record = imdma_record_open(path);
+	CHECK(record != NULL);
+	if (record != NULL)
+	{
+		CHECK(imdma_record_get_block_count(record) == 3);
+
+		unsigned char *expected = malloc(blockBytes);
+		unsigned char *data = malloc(blockBytes);
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			imdma_record_block_t block;
+			CHECK(imdma_record_get_block(record, i, &block) == 0 && block.codec == codec &&
+			      block.stored_bytes < blockBytes);
+			fillBlock(expected, blockBytes, i);
+			CHECK(imdma_record_read_block(record, i, data, blockBytes) == 0 &&
+			      memcmp(data, expected, blockBytes) == 0);
+		}
+		CHECK(imdma_record_read_block(record, 0, data, blockBytes - 1) == ENOSPC);
+		free(expected);
+		free(data);
+		imdma_record_close(record);
+	}
+
+	unlink(path);
+	free(path);
+}
+
+static void testStreamRearmFailure(void)
+{
+	// Every start after the four initial ones fails, so each returned block is lost to the stream
+	imdma_t *imdma = imdma_create("sim:count=4,block=4KiB,rate=0,latency=0,failstart=4");
+	CHECK(imdma != NULL);
+	if (imdma == NULL)
+	{
+		return;
+	}
+
+	imdma_stream_t *stream = imdma_stream_open(imdma, 0, 0);
+	CHECK(stream != NULL);
+	if (stream != NULL)
+	{
+		imdma_stream_view_t view;
+		for (int i = 0; i < 4; i++)
+		{
+			CHECK(imdma_stream_next(stream, &view) == 0);
+			CHECK(imdma_stream_done(stream, &view) == EIO);
+		}
+
+		// Nothing is queued or held any more: the re-arm error is returned instead of waiting forever
+		CHECK(imdma_stream_next(stream, &view) == EIO);
+		imdma_stream_close(stream);
+	}
+	imdma_free(imdma);
+}
+
+static void testStreamHeldTimeout(void)
+{
+	imdma_t *imdma = imdma_create("sim:count=2,block=4KiB,rate=0,latency=0");
+	CHECK(imdma != NULL);
+	if (imdma == NULL)
+	{
+		return;
+	}
+
+	imdma_stream_t *stream = imdma_stream_open(imdma, 0, 0);
+	CHECK(stream != NULL);
+	if (stream != NULL)
+	{
+		imdma_stream_view_t views[3];
+		imdma_stream_set_timeout_ms(stream, 20);
+		CHECK(imdma_stream_next(stream, &views[0]) == 0);
+		CHECK(imdma_stream_next(stream, &views[1]) == 0);
+
+		// Both buffers are held, so the wait for a returned one is bounded by the timeout
+		CHECK(imdma_stream_next(stream, &views[2]) == ETIMEDOUT);
+
+		CHECK(imdma_stream_done(stream, &views[0]) == 0);
+		CHECK(imdma_stream_next(stream, &views[2]) == 0);
+		CHECK(imdma_stream_done(stream, &views[1]) == 0);
+		CHECK(imdma_stream_done(stream, &views[2]) == 0);
+		imdma_stream_close(stream);
+	}
+	imdma_free(imdma);
+}
+
+int main(void)
+{
+	testVerifyContinuous();
+	testVerifyGapInBlock();
+	testVerifyGapAtBlockEnd();
+	testVerifyCorruptAtBlockEnd();
+	testRecordScanResync();
+	testRecordIndexed(IMDMA_RECORD_CODEC_NONE);
+	testRecordIndexed(IMDMA_RECORD_CODEC_LZ4);
+	testRecordCodecRoundTrip(IMDMA_RECORD_CODEC_LZ4);
+	testRecordCodecRoundTrip(IMDMA_RECORD_CODEC_ZSTD);
+	testStreamRearmFailure();
+	testStreamHeldTimeout();
+
+	if (failures != 0)
+	{
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
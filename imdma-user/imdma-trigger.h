@@ -0,0 +1,450 @@
+// IMSAR DMA pre-trigger ring (header only, C++)
+//
+// Every block is copied into a large preallocated RAM ring (huge pages when available) as a
+// complete record of the segmented format, and nothing is written to disk until a trigger.
+// A trigger writes the blocks received in the pre-trigger window, plus those received until the
+// post-trigger window ends, to a new recording (<prefix>eventNNNN_NNNNNN.imdma) from a flush thread.
+// A trigger during an event extends it; one after its window closed, while its last blocks are still being
+// written, starts the next event as soon as they are. While an event is being written its blocks are protected
+// in the ring; if capture laps the flush, new blocks are dropped (counted as overruns) rather than
+// stalling the DMA.
+
+#ifndef __IMDMA_TRIGGER_H
+#define __IMDMA_TRIGGER_H
+
+extern "C"
+{
+#include "libimdma-record.h"
+#include "libimdma.h"
+}
+
+#include "imdma-writer.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TriggerRing
+{
+public:
+	struct Statistics
+	{
+		unsigned long events{0};          // recordings written (overlapping triggers count once)
+		unsigned long triggers{0};        // triggers seen
+		unsigned long deferred{0};        // events started once the previous one was written (shorter pre-trigger)
+		unsigned long blocksWritten{0};
+		unsigned long long bytesWritten{0};
+		unsigned long overruns{0};        // blocks dropped because the ring was full of blocks still to be written
+		unsigned long writeErrors{0};
+	};
+
+	TriggerRing(size_t ringBytes, unsigned int blockBytes, double preSeconds, double postSeconds,
+	            const std::string &filePrefix, const std::string &device, uint64_t segmentBytes)
+	    : slotBytes(imdma_record_block_stride(blockBytes)), blockBytes(blockBytes),
+	      preNs(static_cast<uint64_t>(preSeconds * 1e9)), postNs(static_cast<uint64_t>(postSeconds * 1e9)),
+	      filePrefix(filePrefix), device(device), segmentBytes(segmentBytes)
+	{
+		slotCount = ringBytes / slotBytes;
+		if (slotCount < 2)
+		{
+			throw std::runtime_error("ring is smaller than two blocks");
+		}
+
+		// Huge pages keep the TLB out of the way of the copies; fall back to normal pages.
+		// Either way the ring is populated (and locked if allowed) up front, not on the capture path.
+		const size_t hugePageBytes = 2 * 1024 * 1024;
+		mapBytes = (slotCount * slotBytes + hugePageBytes - 1) / hugePageBytes * hugePageBytes;
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE;
+		ring = mmap(NULL, mapBytes, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+		hugePages = ring != MAP_FAILED;
+		if (!hugePages)
+		{
+			ring = mmap(NULL, mapBytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+			if (ring == MAP_FAILED)
+			{
+				throw std::runtime_error("cannot allocate the ring");
+			}
+			madvise(ring, mapBytes, MADV_HUGEPAGE); // transparent huge pages, if enabled
+		}
+		locked = mlock(ring, mapBytes) == 0;
+
+		timestamps.resize(slotCount);
+		thread = std::thread(&TriggerRing::run, this);
+	}
+
+	~TriggerRing()
+	{
+		finish();
+		munmap(ring, mapBytes);
+	}
+
+	TriggerRing(const TriggerRing &) = delete;
+	TriggerRing &operator=(const TriggerRing &) = delete;
+
+	// Request a trigger (async-signal-safe; handled with the next stored block)
+	void trigger() { pending = true; }
+
+	// Capture thread: get the data area for the next block; or NULL if it must be dropped (overrun)
+	unsigned char *next()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (flushing && stored >= slotCount && stored - slotCount >= flushNext)
+		{
+			stats.overruns++;
+			return NULL;
+		}
+		return slot(stored) + sizeof(imdma_record_block_header_t);
+	}
+
+	// Capture thread: store the block written to the area returned by next() (matched = pattern trigger)
+	void commit(const imdma_stream_view_t &view, unsigned int length, uint32_t flags, bool matched)
+	{
+		unsigned char *record = slot(stored);
+		size_t stride = imdma_record_block_stride(length);
+		std::memset(record + sizeof(imdma_record_block_header_t) + length, 0,
+		            stride - sizeof(imdma_record_block_header_t) - length);
+
+		imdma_record_block_header_t header;
+		std::memset(&header, 0, sizeof(header));
+		header.magic = IMDMA_RECORD_BLOCK_MAGIC;
+		header.header_bytes = sizeof(header);
+		header.sequence = view.sequence;
+		header.timestamp_ns = view.complete_ns;
+		header.length_bytes = length;
+		header.flags = flags;
+		header.stored_bytes = length;
+		header.codec = IMDMA_RECORD_CODEC_NONE;
+		std::memcpy(record, &header, sizeof(header));
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			uint64_t number = stored++;
+			timestamps[number % slotCount] = view.complete_ns;
+
+			if (pending.exchange(false) || matched)
+			{
+				startEvent(number, view.complete_ns);
+			}
+			if (flushing && flushEnd == UINT64_MAX && view.complete_ns > eventEndNs)
+			{
+				flushEnd = number; // this block is past the post-trigger window
+			}
+		}
+		changed.notify_all();
+	}
+
+	// Write any event in progress (up to the blocks stored so far) and stop the flush thread
+	void finish()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (flushEnd > stored)
+			{
+				flushEnd = stored;
+			}
+			stopping = true;
+		}
+		changed.notify_all();
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+
+	Statistics statistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	size_t capacityBlocks() const { return slotCount; }
+	bool usesHugePages() const { return hugePages; }
+	bool isLocked() const { return locked; }
+
+private:
+	unsigned char *slot(uint64_t number) { return static_cast<unsigned char *>(ring) + number % slotCount * slotBytes; }
+
+	// Start an event at the trigger time (or extend the one being written)
+	// Note: mutex must be held
+	void startEvent(uint64_t number, uint64_t triggerNs)
+	{
+		stats.triggers++;
+		if (flushing && flushEnd == UINT64_MAX)
+		{
+			eventEndNs = triggerNs + postNs;
+			return;
+		}
+		if (flushing)
+		{
+			// The previous event's window has closed but it is still being written: start this one after it
+			if (!queued)
+			{
+				queued = true;
+				queuedNumber = number;
+				queuedNs = triggerNs;
+			}
+			queuedEndNs = triggerNs + postNs;
+			return;
+		}
+
+		beginEvent(number, triggerNs, triggerNs + postNs, 0);
+	}
+
+	// Start writing the blocks from the pre-trigger window (but not before block notBefore) to endNs
+	// Note: mutex must be held
+	void beginEvent(uint64_t number, uint64_t triggerNs, uint64_t endNs, uint64_t notBefore)
+	{
+		// Walk back over the blocks still in the ring to the start of the pre-trigger window
+		uint64_t oldest = std::max(stored > slotCount ? stored - slotCount : 0, notBefore);
+		uint64_t first = number;
+		while (first > oldest && timestamps[(first - 1) % slotCount] + preNs >= triggerNs)
+		{
+			first--;
+		}
+
+		flushing = true;
+		flushNext = first;
+		flushEnd = UINT64_MAX;
+		eventEndNs = endNs;
+
+		// A deferred event may already have blocks stored past its window (or capture may have stopped)
+		for (uint64_t n = number + 1; n < stored && flushEnd == UINT64_MAX; n++)
+		{
+			if (timestamps[n % slotCount] > endNs)
+			{
+				flushEnd = n;
+			}
+		}
+		if (stopping && flushEnd > stored)
+		{
+			flushEnd = stored;
+		}
+	}
+
+	// Flush thread: write the event blocks as they become available
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		std::shared_ptr<RecordSegment> segment;
+		uint64_t segmentIndex = 0;
+		while (true)
+		{
+			changed.wait(lock, [this] {
+				return (flushing && (flushNext < stored || flushNext >= flushEnd)) || stopping;
+			});
+			if (!flushing)
+			{
+				return; // stopping with nothing left to write
+			}
+
+			if (flushNext >= flushEnd)
+			{
+				// Event complete: close its recording
+				lock.unlock();
+				segment.reset();
+				lock.lock();
+				segmentIndex = 0;
+				flushing = false;
+				stats.events++;
+				if (queued)
+				{
+					queued = false;
+					stats.deferred++;
+					beginEvent(queuedNumber, queuedNs, queuedEndNs, flushEnd);
+				}
+				changed.notify_all();
+				continue;
+			}
+
+			uint64_t number = flushNext;
+			unsigned long event = stats.events;
+			lock.unlock();
+
+			const unsigned char *record = slot(number);
+			imdma_record_block_header_t header;
+			std::memcpy(&header, record, sizeof(header));
+			size_t stride = imdma_record_block_stride(header.stored_bytes);
+
+			uint64_t offset = 0;
+			if (!segment || !segment->reserve(header, offset))
+			{
+				segment.reset();
+				segment = RecordSegment::create(fileName(event, segmentIndex), segmentIndex, header.sequence,
+				                                blockBytes, device, segmentBytes);
+				segmentIndex++;
+				if (segment)
+				{
+					segment->reserve(header, offset);
+				}
+			}
+			bool ok = segment && segment->write(record, stride, offset);
+
+			lock.lock();
+			stats.blocksWritten += ok;
+			stats.bytesWritten += ok ? header.length_bytes : 0;
+			stats.writeErrors += !ok;
+			flushNext++; // the slot may be reused now
+		}
+	}
+
+	std::string fileName(unsigned long event, uint64_t segmentIndex) const
+	{
+		std::stringstream ss;
+		ss << filePrefix << "event" << std::setfill('0') << std::setw(4) << event << "_" << std::setw(6)
+		   << segmentIndex << IMDMA_RECORD_SUFFIX;
+		return ss.str();
+	}
+
+	const size_t slotBytes;
+	const unsigned int blockBytes;
+	const uint64_t preNs;
+	const uint64_t postNs;
+	const std::string filePrefix;
+	const std::string device;
+	const uint64_t segmentBytes;
+
+	void *ring;
+	size_t mapBytes;
+	size_t slotCount;
+	bool hugePages;
+	bool locked;
+
+	std::atomic<bool> pending{false};
+
+	std::mutex mutex;
+	std::condition_variable changed; // a block was stored, an event started or ended, or stopping
+	std::vector<uint64_t> timestamps; // completion time of the block in each slot
+	uint64_t stored{0};               // blocks stored since the start (block n is in slot n % slotCount)
+	bool flushing{false};             // an event is being written
+	uint64_t flushNext{0};            // next block to write
+	uint64_t flushEnd{UINT64_MAX};    // first block after the event (UINT64_MAX until the window closes)
+	uint64_t eventEndNs{0};           // end of the post-trigger window
+	bool queued{false};               // a trigger arrived while the last blocks of an event were being written
+	uint64_t queuedNumber{0};         // block of its first trigger
+	uint64_t queuedNs{0};             // time of its first trigger
+	uint64_t queuedEndNs{0};          // end of its post-trigger window (extended by later triggers)
+	bool stopping{false};
+	Statistics stats;
+	std::thread thread;
+};
+
+// Triggers on readiness of a file descriptor: a UIO device (/dev/uioN, FPGA user interrupt),
+// a GPIO value file with an edge configured, a FIFO, ...
+class InterruptTrigger
+{
+public:
+	~InterruptTrigger() { stop(); }
+
+	bool open(const std::string &path)
+	{
+		fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK);
+		if (fd < 0)
+		{
+			fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK);
+		}
+		if (fd < 0)
+		{
+			std::cerr << path << ": " << strerror(errno) << std::endl;
+			return false;
+		}
+
+		struct stat st;
+		uio = fstat(fd, &st) == 0 && S_ISCHR(st.st_mode);
+		enableInterrupt();
+		return true;
+	}
+
+	void start(TriggerRing &ring) { thread = std::thread(&InterruptTrigger::run, this, std::ref(ring)); }
+
+	void stop()
+	{
+		stopping = true;
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+		if (fd >= 0)
+		{
+			::close(fd);
+			fd = -1;
+		}
+	}
+
+private:
+	// UIO interrupts are masked after each one until 1 is written back (ignored by other files)
+	void enableInterrupt()
+	{
+		if (uio)
+		{
+			uint32_t one = 1;
+			ssize_t rc = write(fd, &one, sizeof(one));
+			(void)rc;
+		}
+	}
+
+	void run(TriggerRing &ring)
+	{
+		while (!stopping)
+		{
+			struct pollfd pfd = {fd, POLLIN | POLLPRI, 0};
+			int rc = poll(&pfd, 1, 100); // wake up regularly to check for stop()
+			if (rc <= 0 || (pfd.revents & (POLLIN | POLLPRI)) == 0)
+			{
+				if (rc > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(100)); // e.g. FIFO without a writer
+				}
+				continue;
+			}
+
+			// Consume the event (UIO: the 32-bit interrupt count, the only read size it accepts;
+			// sysfs: re-read from the start); a failed or short read is not a trigger
+			bool triggered;
+			if (uio)
+			{
+				int32_t count;
+				triggered = read(fd, &count, sizeof(count)) == sizeof(count);
+			}
+			else
+			{
+				char buffer[64];
+				if ((pfd.revents & POLLPRI) != 0)
+				{
+					lseek(fd, 0, SEEK_SET);
+				}
+				triggered = read(fd, buffer, sizeof(buffer)) > 0;
+			}
+
+			if (triggered)
+			{
+				ring.trigger();
+			}
+			enableInterrupt();
+		}
+	}
+
+	int fd{-1};
+	bool uio{false};
+	std::atomic<bool> stopping{false};
+	std::thread thread;
+};
+
+#endif
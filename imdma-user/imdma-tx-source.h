@@ -0,0 +1,364 @@
+// IMSAR DMA transmit data sources (header only, C++)
+//
+// Generates the blocks sent on a host-to-device (MM2S) channel. StagingRing runs a source on its
+// own thread into a ring of cached staging buffers, so the next block is being generated while the
+// current one is copied to the DMA buffer and sent: the fill cost overlaps the DMA instead of
+// adding to it (TxPrefill for the generated sources below, a recording loader in imdma-replay). Sources:
+//   counter               u64 words counting up across blocks (the pattern imdma-perf -v checks)
+//   zero                  all zeros (measures the copy and DMA cost alone)
+//   file:<path>           the file contents, repeated from the start at the end of the file
+//   sine[:period[:amp]]   a precomputed int16 sine table (period samples, default 64) played in a loop
+
+#ifndef __IMDMA_TX_SOURCE_H
+#define __IMDMA_TX_SOURCE_H
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Result of filling one staging block
+enum class FillResult
+{
+	Filled,
+	Ended, // the source has no more blocks
+	Failed
+};
+
+class TxSource
+{
+public:
+	// Nothing is kept with a generated block (StagingRing)
+	struct Info
+	{
+	};
+	TxSource() {}
+	~TxSource() { closeFile(); }
+
+	TxSource(const TxSource &) = delete;
+	TxSource &operator=(const TxSource &) = delete;
+
+	// Parse the source specification; returns false (with a message) if it is invalid
+	bool open(const std::string &spec)
+	{
+		std::string name = spec.substr(0, spec.find(':'));
+		std::string args = name.size() < spec.size() ? spec.substr(name.size() + 1) : "";
+		if (name == "counter" && args.empty())
+		{
+			kind = Counter;
+		}
+		else if (name == "zero" && args.empty())
+		{
+			kind = Zero;
+		}
+		else if (name == "file" && !args.empty())
+		{
+			kind = File;
+			fd = ::open(args.c_str(), O_RDONLY);
+			if (fd < 0)
+			{
+				std::cerr << args << ": " << strerror(errno) << std::endl;
+				return false;
+			}
+		}
+		else if (name == "sine")
+		{
+			kind = Sine;
+			char *end;
+			unsigned long period = 64;
+			double amplitude = 0.9;
+			if (!args.empty())
+			{
+				period = strtoul(args.c_str(), &end, 10);
+				if (*end == ':')
+				{
+					amplitude = strtod(end + 1, &end);
+				}
+				if (*end != '\0' || period < 2 || amplitude <= 0 || amplitude > 1)
+				{
+					std::cerr << "invalid sine source (sine[:period>=2[:amplitude 0..1]]): " << spec << std::endl;
+					return false;
+				}
+			}
+
+			sineTable.resize(period);
+			for (unsigned long i = 0; i < period; i++)
+			{
+				sineTable[i] = static_cast<int16_t>(std::lround(std::sin(2 * M_PI * i / period) * amplitude * 32767));
+			}
+		}
+		else
+		{
+			std::cerr << "invalid transmit source: " << spec << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	// Generate the next block; returns false if the source failed (e.g. empty or unreadable file)
+	bool fill(void *dst, size_t lengthBytes)
+	{
+		unsigned char *out = static_cast<unsigned char *>(dst);
+		switch (kind)
+		{
+		case Counter:
+		{
+			// Whole words only (a trailing partial word is zero, as the checker ignores it)
+			size_t words = lengthBytes / sizeof(uint64_t);
+			uint64_t *values = static_cast<uint64_t *>(dst);
+			for (size_t i = 0; i < words; i++)
+			{
+				values[i] = counter++;
+			}
+			std::memset(out + words * sizeof(uint64_t), 0, lengthBytes % sizeof(uint64_t));
+			return true;
+		}
+
+		case Zero:
+			std::memset(dst, 0, lengthBytes);
+			return true;
+
+		case File:
+			while (lengthBytes > 0)
+			{
+				ssize_t got = ::read(fd, out, lengthBytes);
+				if (got == 0 && !readAny)
+				{
+					std::cerr << "transmit source file is empty" << std::endl;
+					return false;
+				}
+				if (got == 0)
+				{
+					lseek(fd, 0, SEEK_SET);
+					readAny = false;
+					continue;
+				}
+				if (got < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					std::cerr << "transmit source file: " << strerror(errno) << std::endl;
+					return false;
+				}
+				readAny = true;
+				out += got;
+				lengthBytes -= got;
+			}
+			return true;
+
+		case Sine:
+		{
+			// Copy runs of the table, continuing the phase across blocks
+			size_t samples = lengthBytes / sizeof(int16_t);
+			while (samples > 0)
+			{
+				size_t run = std::min(samples, sineTable.size() - phase);
+				std::memcpy(out, &sineTable[phase], run * sizeof(int16_t));
+				out += run * sizeof(int16_t);
+				samples -= run;
+				phase = (phase + run) % sineTable.size();
+			}
+			std::memset(out, 0, lengthBytes % sizeof(int16_t));
+			return true;
+		}
+		}
+		return false;
+	}
+
+	// StagingRing interface: a generated source never ends
+	FillResult fill(void *dst, size_t lengthBytes, Info &)
+	{
+		return fill(dst, lengthBytes) ? FillResult::Filled : FillResult::Failed;
+	}
+
+private:
+	void closeFile()
+	{
+		if (fd >= 0)
+		{
+			::close(fd);
+			fd = -1;
+		}
+	}
+
+	enum Kind
+	{
+		Counter,
+		Zero,
+		File,
+		Sine
+	};
+
+	Kind kind{Zero};
+	uint64_t counter{0};
+	int fd{-1};
+	bool readAny{false}; // read data since the start of the file (an empty file would loop forever)
+	std::vector<int16_t> sineTable;
+	size_t phase{0};
+};
+
+// Runs a source on its own thread into a ring of staging buffers. The source provides
+//   struct Info                                           kept with each block (length, time, ...)
+//   FillResult fill(void *dst, size_t blockBytes, Info &)  produce the next block
+template <typename Source>
+class StagingRing
+{
+public:
+	struct Block
+	{
+		unsigned char *data{NULL};
+		typename Source::Info info;
+		bool full{false};
+	};
+
+	StagingRing(Source &source, size_t blockBytes, unsigned int depth)
+	    : source(source), blockBytes(blockBytes), blocks(depth)
+	{
+		for (Block &block : blocks)
+		{
+			// Cache line aligned so the copy to the DMA buffer reads whole lines
+			block.data = static_cast<unsigned char *>(aligned_alloc(64, (blockBytes + 63) & ~size_t(63)));
+		}
+	}
+
+	~StagingRing()
+	{
+		stop();
+		for (Block &block : blocks)
+		{
+			free(block.data);
+		}
+	}
+
+	StagingRing(const StagingRing &) = delete;
+	StagingRing &operator=(const StagingRing &) = delete;
+
+	void start() { thread = std::thread(&StagingRing::run, this); }
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		changed.notify_all();
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+
+	// Wait until every staging buffer is filled (or the source ends first)
+	void waitFilled()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return blocks.back().full || finished || stopping; });
+	}
+
+	// Wait for the next filled block; returns NULL at the end of the source, if it failed or the filler stopped
+	const Block *acquire()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		Block &block = blocks[consumeIndex];
+		if (!block.full && !finished && !stopping)
+		{
+			stalls++; // the DMA is waiting on the fill
+			changed.wait(lock, [&] { return block.full || finished || stopping; });
+		}
+		return block.full ? &block : NULL;
+	}
+
+	// Hand the block returned by acquire() back to be refilled
+	void release()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			blocks[consumeIndex].full = false;
+			consumeIndex = (consumeIndex + 1) % blocks.size();
+		}
+		changed.notify_all();
+	}
+
+	// Times acquire() had to wait for the fill (the source is slower than the channel)
+	unsigned long stallCount()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stalls;
+	}
+
+	// The source failed (rather than ended)
+	bool failed()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return error;
+	}
+
+private:
+	void run()
+	{
+		size_t fillIndex = 0;
+		while (true)
+		{
+			Block &block = blocks[fillIndex];
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&] { return !block.full || stopping; });
+				if (stopping)
+				{
+					return;
+				}
+			}
+
+			// Fill outside the lock (the consumer only touches other blocks meanwhile)
+			FillResult result = FillResult::Failed;
+			if (block.data != NULL)
+			{
+				result = source.fill(block.data, blockBytes, block.info);
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				block.full = result == FillResult::Filled;
+				finished = result != FillResult::Filled;
+				error = result == FillResult::Failed;
+			}
+			changed.notify_all();
+			if (result != FillResult::Filled)
+			{
+				return;
+			}
+			fillIndex = (fillIndex + 1) % blocks.size();
+		}
+	}
+
+	Source &source;
+	const size_t blockBytes;
+	std::vector<Block> blocks;
+	size_t consumeIndex{0};
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable changed; // a block was filled or released (or stopping/finished changed)
+	bool stopping{false};
+	bool finished{false};
+	bool error{false};
+	unsigned long stalls{0};
+};
+
+// Generated transmit blocks: two staging buffers (double buffering) are enough to overlap the fill
+typedef StagingRing<TxSource> TxPrefill;
+static const unsigned int kTxPrefillDepth = 2;
+
+#endif
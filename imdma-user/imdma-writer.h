@@ -0,0 +1,487 @@
+// IMSAR DMA block writer (header only, C++)
+//
+// Moves file writes off the capture thread: the capture thread copies each block into one of a
+// fixed set of page-aligned staging buffers (so the DMA buffer is re-armed right away) and queues
+// it; writer threads pwrite() it with O_DIRECT, so the page cache is not flooded and the disk sees
+// large aligned writes. When every staging buffer is queued the capture thread either waits
+// (counted as a stall) or drops the block, so a slow disk shows up in the counters instead of
+// silently stalling the DMA.
+//
+// A block goes either into its own file, or at a reserved offset of a RecordSegment (the
+// segmented recording format of libimdma-record.h).
+
+#ifndef __IMDMA_WRITER_H
+#define __IMDMA_WRITER_H
+
+extern "C"
+{
+#include "libimdma-record.h"
+}
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// O_DIRECT needs the buffer, file offset and length aligned to the logical block size (4 KiB covers all disks)
+static const size_t kWriteAlignment = IMDMA_RECORD_ALIGNMENT;
+
+// Open a file for writing with O_DIRECT if the file system supports it (direct is set accordingly)
+static int openForWriting(const std::string &path, bool &direct)
+{
+	direct = true;
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if (fd < 0 && errno == EINVAL)
+	{
+		direct = false; // e.g. tmpfs
+		fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (fd < 0)
+	{
+		std::cerr << "failed to open file \"" << path << "\": " << strerror(errno) << std::endl;
+	}
+	return fd;
+}
+
+// Write the whole buffer at the given offset; falls back to buffered writes if O_DIRECT is refused
+static bool writeAll(int fd, const unsigned char *data, size_t length, uint64_t offset, bool &direct)
+{
+	size_t done = 0;
+	while (done < length)
+	{
+		ssize_t written = pwrite(fd, data + done, length - done, offset + done);
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (written < 0 && errno == EINVAL && direct)
+		{
+			// The file system accepted O_DIRECT at open but not this write: continue buffered
+			direct = false;
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+			continue;
+		}
+		if (written <= 0)
+		{
+			return false;
+		}
+		done += written;
+	}
+	return true;
+}
+
+// One preallocated segment file of a recording
+// The capture thread reserves space for each block; writer threads write the blocks at those offsets in any
+// order. The segment is closed (index and final header written) when the last reference to it is dropped,
+// i.e. when the capture thread has moved on to the next segment and every block in it has been written.
+class RecordSegment
+{
+public:
+	static std::shared_ptr<RecordSegment> create(const std::string &path, uint64_t segmentIndex,
+	                                             uint64_t firstSequence, uint32_t blockBytes, const std::string &device,
+	                                             uint64_t segmentBytes)
+	{
+		std::shared_ptr<RecordSegment> segment(new RecordSegment(path, segmentBytes));
+		bool direct;
+		segment->fd = openForWriting(path, direct);
+		if (segment->fd < 0)
+		{
+			return NULL;
+		}
+		segment->direct = direct;
+
+		// Reserve the disk space up front (fewer extents, no allocation on the write path); optional
+		if (fallocate(segment->fd, 0, 0, segmentBytes) != 0 && errno != EOPNOTSUPP)
+		{
+			std::cerr << "failed to preallocate \"" << path << "\": " << strerror(errno) << std::endl;
+		}
+
+		imdma_record_header_t &header = segment->header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, IMDMA_RECORD_MAGIC, sizeof(header.magic));
+		header.version = IMDMA_RECORD_VERSION;
+		header.header_bytes = kWriteAlignment;
+		header.alignment = kWriteAlignment;
+		header.block_bytes = blockBytes;
+		header.segment_index = segmentIndex;
+		header.first_sequence = firstSequence;
+		header.created_realtime_ns = nowNs(CLOCK_REALTIME);
+		header.created_monotonic_ns = nowNs(CLOCK_MONOTONIC);
+		strncpy(header.device, device.c_str(), sizeof(header.device) - 1);
+		if (!segment->writeHeader())
+		{
+			return NULL;
+		}
+
+		segment->nextOffset = kWriteAlignment;
+		return segment;
+	}
+
+	~RecordSegment()
+	{
+		if (fd >= 0)
+		{
+			close();
+		}
+	}
+
+	RecordSegment(const RecordSegment &) = delete;
+	RecordSegment &operator=(const RecordSegment &) = delete;
+
+	// Capture thread: reserve space for the next record (sized by the header's stored_bytes); returns false if the
+	// segment is full
+	bool reserve(const imdma_record_block_header_t &block, uint64_t &offset)
+	{
+		size_t stride = imdma_record_block_stride(block.stored_bytes);
+		if (!entries.empty() && nextOffset + stride > capacity)
+		{
+			return false;
+		}
+		offset = nextOffset;
+		entries.push_back({offset, block.stored_bytes, block.length_bytes});
+		nextOffset += stride;
+		return true;
+	}
+
+	// Writer threads: write one record at its reserved offset
+	bool write(const unsigned char *data, size_t length, uint64_t offset)
+	{
+		bool useDirect = direct;
+		bool ok = writeAll(fd, data, length, offset, useDirect);
+		if (!useDirect)
+		{
+			direct = false;
+		}
+		return ok;
+	}
+
+	bool isDirect() const { return direct; }
+
+private:
+	RecordSegment(const std::string &path, uint64_t segmentBytes) : path(path), capacity(segmentBytes) {}
+
+	static uint64_t nowNs(clockid_t clock)
+	{
+		struct timespec ts;
+		clock_gettime(clock, &ts);
+		return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+	}
+
+	// Write the (page sized) header from an aligned buffer
+	bool writeHeader()
+	{
+		void *page = NULL;
+		if (posix_memalign(&page, kWriteAlignment, kWriteAlignment) != 0)
+		{
+			return false;
+		}
+		std::memset(page, 0, kWriteAlignment);
+		std::memcpy(page, &header, sizeof(header));
+		bool useDirect = direct;
+		bool ok = writeAll(fd, static_cast<unsigned char *>(page), kWriteAlignment, 0, useDirect);
+		direct = direct && useDirect;
+		free(page);
+		if (!ok)
+		{
+			std::cerr << "failed to write segment header \"" << path << "\": " << strerror(errno) << std::endl;
+		}
+		return ok;
+	}
+
+	// Append the index, complete the header and release the unused preallocated space
+	void close()
+	{
+		size_t indexBytes = sizeof(imdma_record_index_header_t) + entries.size() * sizeof(imdma_record_index_entry_t);
+		size_t paddedBytes = (indexBytes + kWriteAlignment - 1) / kWriteAlignment * kWriteAlignment;
+		void *index = NULL;
+		bool ok = posix_memalign(&index, kWriteAlignment, paddedBytes) == 0;
+		if (ok)
+		{
+			std::memset(index, 0, paddedBytes);
+			imdma_record_index_header_t *indexHeader = static_cast<imdma_record_index_header_t *>(index);
+			std::memcpy(indexHeader->magic, IMDMA_RECORD_INDEX_MAGIC, sizeof(indexHeader->magic));
+			indexHeader->count = entries.size();
+			std::memcpy(indexHeader + 1, entries.data(), entries.size() * sizeof(imdma_record_index_entry_t));
+
+			bool useDirect = direct;
+			ok = writeAll(fd, static_cast<unsigned char *>(index), paddedBytes, nextOffset, useDirect);
+			direct = direct && useDirect;
+			free(index);
+		}
+
+		if (ok)
+		{
+			header.index_offset = nextOffset;
+			header.block_count = entries.size();
+			ok = writeHeader() && ftruncate(fd, nextOffset + paddedBytes) == 0;
+		}
+		if (!ok)
+		{
+			std::cerr << "failed to close segment \"" << path << "\" (it can still be read without the index)"
+			          << std::endl;
+		}
+
+		::close(fd);
+		fd = -1;
+	}
+
+	std::string path;
+	uint64_t capacity;
+	int fd{-1};
+	std::atomic<bool> direct{true};
+
+	// Capture thread only (read by close() once every other reference is gone)
+	imdma_record_header_t header;
+	uint64_t nextOffset{0};
+	std::vector<imdma_record_index_entry_t> entries;
+};
+
+class BlockWriter
+{
+public:
+	struct Buffer
+	{
+		unsigned char *data;
+		size_t length;    // bytes to write
+		std::string path; // file to create (if segment is NULL)
+
+		std::shared_ptr<RecordSegment> segment; // segment to write into (at offset)
+		uint64_t offset;
+	};
+
+	struct Statistics
+	{
+		unsigned long written{0};
+		unsigned long long writtenBytes{0};
+		unsigned long writeErrors{0};
+		unsigned long buffered{0}; // files written without O_DIRECT (not supported by the file system)
+		unsigned long stalls{0};   // times the capture thread waited for a free buffer
+		uint64_t stallNs{0};       // total time spent waiting
+		unsigned long drops{0};    // blocks dropped because every buffer was queued (dropWhenFull)
+		unsigned int maxQueued{0}; // high-water mark of the queue
+		double writeSeconds{0};    // wall time from the first submit to the last completed write
+	};
+
+	// blockBytes is the largest block that will be written; depth staging buffers are allocated up front
+	BlockWriter(unsigned int threadCount, unsigned int depth, size_t blockBytes, bool dropWhenFull)
+	    : dropWhenFull(dropWhenFull), depth(depth)
+	{
+		size_t capacity = (blockBytes + kWriteAlignment - 1) / kWriteAlignment * kWriteAlignment;
+		buffers.resize(depth);
+		for (Buffer &buffer : buffers)
+		{
+			void *memory = NULL;
+			if (posix_memalign(&memory, kWriteAlignment, capacity) != 0)
+			{
+				throw std::bad_alloc();
+			}
+			buffer.data = static_cast<unsigned char *>(memory);
+			buffer.length = 0;
+			freeBuffers.push_back(&buffer);
+		}
+
+		for (unsigned int i = 0; i < threadCount; i++)
+		{
+			threads.emplace_back(&BlockWriter::run, this);
+		}
+	}
+
+	~BlockWriter()
+	{
+		finish();
+		for (Buffer &buffer : buffers)
+		{
+			free(buffer.data);
+		}
+	}
+
+	BlockWriter(const BlockWriter &) = delete;
+	BlockWriter &operator=(const BlockWriter &) = delete;
+
+	// Get a free staging buffer; waits for one (or returns NULL when dropping) if all are queued
+	Buffer *acquire()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (freeBuffers.empty())
+		{
+			if (dropWhenFull)
+			{
+				stats.drops++;
+				return NULL;
+			}
+
+			auto waitStart = std::chrono::steady_clock::now();
+			stats.stalls++;
+			freed.wait(lock, [this] { return !freeBuffers.empty(); });
+			auto waited = std::chrono::steady_clock::now() - waitStart;
+			stats.stallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count();
+		}
+
+		Buffer *buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+		return buffer;
+	}
+
+	// Return a buffer from acquire() without writing it
+	void release(Buffer *buffer)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			freeBuffers.push_back(buffer);
+		}
+		freed.notify_one();
+	}
+
+	// Queue a filled buffer (its length and path set) for writing
+	void submit(Buffer *buffer)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (firstSubmit == std::chrono::steady_clock::time_point())
+			{
+				firstSubmit = std::chrono::steady_clock::now();
+			}
+			queue.push_back(buffer);
+			stats.maxQueued = std::max<unsigned int>(stats.maxQueued, depth - freeBuffers.size());
+		}
+		queued.notify_one();
+	}
+
+	// Write everything queued and stop the writer threads
+	void finish()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		queued.notify_all();
+		for (std::thread &thread : threads)
+		{
+			thread.join();
+		}
+		threads.clear();
+	}
+
+	Statistics statistics()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+private:
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			queued.wait(lock, [this] { return !queue.empty() || stopping; });
+			if (queue.empty())
+			{
+				return; // stopping and nothing left to write
+			}
+
+			Buffer *buffer = queue.front();
+			queue.pop_front();
+			lock.unlock();
+
+			bool direct = true;
+			bool ok = write(*buffer, direct);
+
+			lock.lock();
+			stats.written += ok;
+			stats.writtenBytes += ok ? buffer->length : 0;
+			stats.writeErrors += !ok;
+			stats.buffered += ok && !direct;
+			stats.writeSeconds =
+			    std::chrono::duration<double>(std::chrono::steady_clock::now() - firstSubmit).count();
+			freeBuffers.push_back(buffer);
+
+			// Drop the reference outside the lock (the last one closes the segment)
+			std::shared_ptr<RecordSegment> segment;
+			segment.swap(buffer->segment);
+			lock.unlock();
+			segment.reset();
+			lock.lock();
+			freed.notify_one();
+		}
+	}
+
+	// Write the buffer into its segment, or create its file (O_DIRECT if the file system allows it)
+	static bool write(Buffer &buffer, bool &direct)
+	{
+		if (buffer.segment)
+		{
+			// Records are padded to the alignment by the capture thread
+			bool ok = buffer.segment->write(buffer.data, buffer.length, buffer.offset);
+			direct = buffer.segment->isDirect();
+			if (!ok)
+			{
+				std::cerr << "failed to write block at offset " << buffer.offset << ": " << strerror(errno)
+				          << std::endl;
+			}
+			return ok;
+		}
+
+		int fd = openForWriting(buffer.path, direct);
+		if (fd < 0)
+		{
+			return false;
+		}
+
+		// O_DIRECT writes whole aligned blocks: pad the tail with zeros and truncate afterwards
+		size_t writeLength = buffer.length;
+		if (direct)
+		{
+			writeLength = (buffer.length + kWriteAlignment - 1) / kWriteAlignment * kWriteAlignment;
+			std::memset(buffer.data + buffer.length, 0, writeLength - buffer.length);
+		}
+
+		bool ok = writeAll(fd, buffer.data, writeLength, 0, direct);
+		if (!ok)
+		{
+			std::cerr << "failed to write file \"" << buffer.path << "\": " << strerror(errno) << std::endl;
+			close(fd);
+			return false;
+		}
+
+		ok = writeLength == buffer.length || ftruncate(fd, buffer.length) == 0;
+		if (close(fd) != 0 || !ok)
+		{
+			std::cerr << "failed to finish file \"" << buffer.path << "\": " << strerror(errno) << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	const bool dropWhenFull;
+	const unsigned int depth;
+	std::vector<Buffer> buffers;
+	std::vector<std::thread> threads;
+
+	std::mutex mutex;
+	std::condition_variable queued; // a buffer was queued (or stopping)
+	std::condition_variable freed;  // a buffer was written and is free again
+	std::vector<Buffer *> freeBuffers;
+	std::deque<Buffer *> queue;
+	bool stopping{false};
+	std::chrono::steady_clock::time_point firstSubmit;
+	Statistics stats;
+};
+
+#endif
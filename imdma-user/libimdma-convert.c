@@ -0,0 +1,1020 @@
+#include "libimdma-convert.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LIBIMDMA_CONVERT_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#define LIBIMDMA_CONVERT_NEON 1
+#include <arm_neon.h>
+#if !defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+typedef struct imdma_convert_kernels_st
+{
+	void (*s16_to_f32)(const int16_t *src, float *dst, size_t count, float scale);
+	void (*unpack12_to_s16)(const uint8_t *src, int16_t *dst, size_t count);
+	void (*bswap16)(const void *src, void *dst, size_t count);
+	void (*bswap32)(const void *src, void *dst, size_t count);
+	void (*bswap64)(const void *src, void *dst, size_t count);
+	void (*deinterleave_s16)(const int16_t *src, int16_t *const *dst, unsigned int channels, size_t frames);
+	void (*copy)(const void *src, void *dst, size_t bytes);
+	void (*copy_to_device)(const void *src, void *dst, size_t bytes);
+	size_t (*counter_mismatch_u64)(const void *src, size_t count, uint64_t first);
+} imdma_convert_kernels_t;
+
+// Copies at least this large use non-temporal stores (the destination would not stay in cache anyway)
+#define LIBIMDMA_COPY_NONTEMPORAL_BYTES (256 * 1024)
+
+// ------------------------------------------------------------------
+// Scalar kernels (also used for the tails of the vector kernels)
+// ------------------------------------------------------------------
+
+static void imdma_convert_scalar_s16_to_f32(const int16_t *src, float *dst, size_t count, float scale)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		dst[i] = (float)src[i] * scale;
+	}
+}
+
+static void imdma_convert_scalar_unpack12_to_s16(const uint8_t *src, int16_t *dst, size_t count)
+{
+	for (size_t i = 0; i + 1 < count; i += 2)
+	{
+		uint8_t b0 = src[0];
+		uint8_t b1 = src[1];
+		uint8_t b2 = src[2];
+		src += 3;
+
+		// Shift the 12-bit value to the top of the word, then arithmetic shift back to sign-extend
+		dst[i] = (int16_t)((uint16_t)(b0 | ((b1 & 0x0F) << 8)) << 4) >> 4;
+		dst[i + 1] = (int16_t)((uint16_t)((b1 >> 4) | (b2 << 4)) << 4) >> 4;
+	}
+}
+
+static void imdma_convert_scalar_bswap16(const void *src, void *dst, size_t count)
+{
+	const uint16_t *in = (const uint16_t *)src;
+	uint16_t *out = (uint16_t *)dst;
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] = __builtin_bswap16(in[i]);
+	}
+}
+
+static void imdma_convert_scalar_bswap32(const void *src, void *dst, size_t count)
+{
+	const uint32_t *in = (const uint32_t *)src;
+	uint32_t *out = (uint32_t *)dst;
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] = __builtin_bswap32(in[i]);
+	}
+}
+
+static void imdma_convert_scalar_bswap64(const void *src, void *dst, size_t count)
+{
+	const uint64_t *in = (const uint64_t *)src;
+	uint64_t *out = (uint64_t *)dst;
+	for (size_t i = 0; i < count; i++)
+	{
+		out[i] = __builtin_bswap64(in[i]);
+	}
+}
+
+static void imdma_convert_scalar_deinterleave_s16(const int16_t *src, int16_t *const *dst, unsigned int channels,
+                                                  size_t frames)
+{
+	for (size_t frame = 0; frame < frames; frame++)
+	{
+		for (unsigned int channel = 0; channel < channels; channel++)
+		{
+			dst[channel][frame] = *src++;
+		}
+	}
+}
+
+// Deinterleave starting at the given frame (used for vector kernel tails)
+static void imdma_convert_scalar_deinterleave_s16_from(const int16_t *src, int16_t *const *dst, unsigned int channels,
+                                                       size_t firstFrame, size_t frames)
+{
+	src += firstFrame * channels;
+	for (size_t frame = firstFrame; frame < frames; frame++)
+	{
+		for (unsigned int channel = 0; channel < channels; channel++)
+		{
+			dst[channel][frame] = *src++;
+		}
+	}
+}
+
+static void imdma_convert_scalar_copy(const void *src, void *dst, size_t bytes)
+{
+	memcpy(dst, src, bytes);
+}
+
+// Copy bytes until dst reaches the given alignment; returns the number of bytes copied
+static size_t imdma_convert_scalar_copy_to_alignment(const uint8_t *src, uint8_t *dst, size_t bytes, size_t alignment)
+{
+	size_t head = (alignment - ((uintptr_t)dst & (alignment - 1))) & (alignment - 1);
+	if (head > bytes)
+	{
+		head = bytes;
+	}
+	for (size_t i = 0; i < head; i++)
+	{
+		dst[i] = src[i];
+	}
+	return head;
+}
+
+// Write-combining/uncached memory only merges full, aligned, in-order writes into bus bursts,
+// so never let the destination see partial or overlapping stores (as memcpy may issue)
+static void imdma_convert_scalar_copy_to_device(const void *src, void *dst, size_t bytes)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *out = (uint8_t *)dst;
+	size_t offset = imdma_convert_scalar_copy_to_alignment(in, out, bytes, sizeof(uint64_t));
+
+	for (; offset + sizeof(uint64_t) <= bytes; offset += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, in + offset, sizeof(word));
+		*(volatile uint64_t *)(out + offset) = word;
+	}
+
+	for (; offset < bytes; offset++)
+	{
+		out[offset] = in[offset];
+	}
+}
+
+static size_t imdma_convert_scalar_counter_mismatch_u64_from(const void *src, size_t count, uint64_t first, size_t i)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	for (; i < count; i++)
+	{
+		uint64_t word;
+		memcpy(&word, in + i * sizeof(uint64_t), sizeof(word));
+		if (word != first + i)
+		{
+			return i;
+		}
+	}
+	return count;
+}
+
+static size_t imdma_convert_scalar_counter_mismatch_u64(const void *src, size_t count, uint64_t first)
+{
+	return imdma_convert_scalar_counter_mismatch_u64_from(src, count, first, 0);
+}
+
+static const imdma_convert_kernels_t imdma_convert_scalar_kernels = {
+    .s16_to_f32 = imdma_convert_scalar_s16_to_f32,                     //
+    .unpack12_to_s16 = imdma_convert_scalar_unpack12_to_s16,           //
+    .bswap16 = imdma_convert_scalar_bswap16,                           //
+    .bswap32 = imdma_convert_scalar_bswap32,                           //
+    .bswap64 = imdma_convert_scalar_bswap64,                           //
+    .deinterleave_s16 = imdma_convert_scalar_deinterleave_s16,         //
+    .copy = imdma_convert_scalar_copy,                                 //
+    .copy_to_device = imdma_convert_scalar_copy_to_device,             //
+    .counter_mismatch_u64 = imdma_convert_scalar_counter_mismatch_u64, //
+};
+
+// ------------------------------------------------------------------
+// x86 kernels (SSE4.1 and AVX2, compiled per function so no global -m flags are needed)
+// ------------------------------------------------------------------
+
+#if defined(LIBIMDMA_CONVERT_X86)
+
+#define SSE4_FN __attribute__((target("sse4.1")))
+#define AVX2_FN __attribute__((target("avx2")))
+
+SSE4_FN static void imdma_convert_sse4_s16_to_f32(const int16_t *src, float *dst, size_t count, float scale)
+{
+	size_t i = 0;
+	__m128 vscale = _mm_set1_ps(scale);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(a)), vscale));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(a, 8))), vscale));
+		_mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(b)), vscale));
+		_mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(b, 8))), vscale));
+	}
+	imdma_convert_scalar_s16_to_f32(src + i, dst + i, count - i, scale);
+}
+
+AVX2_FN static void imdma_convert_avx2_s16_to_f32(const int16_t *src, float *dst, size_t count, float scale)
+{
+	size_t i = 0;
+	__m256 vscale = _mm256_set1_ps(scale);
+	for (; i + 32 <= count; i += 32)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 16));
+		__m256 a0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(a)));
+		__m256 a1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(a, 1)));
+		__m256 b0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(b)));
+		__m256 b1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(b, 1)));
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(a0, vscale));
+		_mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(a1, vscale));
+		_mm256_storeu_ps(dst + i + 16, _mm256_mul_ps(b0, vscale));
+		_mm256_storeu_ps(dst + i + 24, _mm256_mul_ps(b1, vscale));
+	}
+	imdma_convert_scalar_s16_to_f32(src + i, dst + i, count - i, scale);
+}
+
+// Each group of 3 bytes {b0, b1, b2} becomes two 16-bit lanes {b0, b1} and {b1, b2}
+#define UNPACK12_SHUFFLE 0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11
+
+SSE4_FN static void imdma_convert_sse4_unpack12_to_s16(const uint8_t *src, int16_t *dst, size_t count)
+{
+	size_t i = 0;
+	size_t inBytes = count / 2 * 3;
+	const __m128i shuffle = _mm_setr_epi8(UNPACK12_SHUFFLE);
+	// 12 bytes in, 8 samples out; the 16-byte load reads 4 bytes ahead, so stop early enough to stay in bounds
+	for (; (i / 2 * 3) + 16 <= inBytes; i += 8)
+	{
+		__m128i raw = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i / 2 * 3)), shuffle);
+		__m128i even = _mm_srai_epi16(_mm_slli_epi16(raw, 4), 4); // low 12 bits, sign-extended
+		__m128i odd = _mm_srai_epi16(raw, 4);                     // high 12 bits, sign-extended
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_blend_epi16(even, odd, 0xAA));
+	}
+	imdma_convert_scalar_unpack12_to_s16(src + i / 2 * 3, dst + i, count - i);
+}
+
+AVX2_FN static void imdma_convert_avx2_unpack12_to_s16(const uint8_t *src, int16_t *dst, size_t count)
+{
+	size_t i = 0;
+	size_t inBytes = count / 2 * 3;
+	const __m256i shuffle = _mm256_setr_epi8(UNPACK12_SHUFFLE, UNPACK12_SHUFFLE);
+	// 24 bytes in (two 12-byte halves, one per 128-bit lane), 16 samples out
+	for (; (i / 2 * 3) + 28 <= inBytes; i += 16)
+	{
+		const uint8_t *in = src + i / 2 * 3;
+		__m256i raw = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)in)),
+		                                      _mm_loadu_si128((const __m128i *)(in + 12)), 1);
+		raw = _mm256_shuffle_epi8(raw, shuffle);
+		__m256i even = _mm256_srai_epi16(_mm256_slli_epi16(raw, 4), 4);
+		__m256i odd = _mm256_srai_epi16(raw, 4);
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_blend_epi16(even, odd, 0xAA));
+	}
+	imdma_convert_scalar_unpack12_to_s16(src + i / 2 * 3, dst + i, count - i);
+}
+
+#define BSWAP16_SHUFFLE 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+#define BSWAP32_SHUFFLE 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+#define BSWAP64_SHUFFLE 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8
+
+SSE4_FN static size_t imdma_convert_sse4_bswap(const void *src, void *dst, size_t bytes, __m128i shuffle)
+{
+	size_t offset = 0;
+	for (; offset + 32 <= bytes; offset += 32)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)((const uint8_t *)src + offset));
+		__m128i b = _mm_loadu_si128((const __m128i *)((const uint8_t *)src + offset + 16));
+		_mm_storeu_si128((__m128i *)((uint8_t *)dst + offset), _mm_shuffle_epi8(a, shuffle));
+		_mm_storeu_si128((__m128i *)((uint8_t *)dst + offset + 16), _mm_shuffle_epi8(b, shuffle));
+	}
+	return offset;
+}
+
+AVX2_FN static size_t imdma_convert_avx2_bswap(const void *src, void *dst, size_t bytes, __m256i shuffle)
+{
+	size_t offset = 0;
+	for (; offset + 64 <= bytes; offset += 64)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i *)((const uint8_t *)src + offset));
+		__m256i b = _mm256_loadu_si256((const __m256i *)((const uint8_t *)src + offset + 32));
+		_mm256_storeu_si256((__m256i *)((uint8_t *)dst + offset), _mm256_shuffle_epi8(a, shuffle));
+		_mm256_storeu_si256((__m256i *)((uint8_t *)dst + offset + 32), _mm256_shuffle_epi8(b, shuffle));
+	}
+	return offset;
+}
+
+SSE4_FN static void imdma_convert_sse4_bswap16(const void *src, void *dst, size_t count)
+{
+	size_t done = imdma_convert_sse4_bswap(src, dst, count * 2, _mm_setr_epi8(BSWAP16_SHUFFLE)) / 2;
+	imdma_convert_scalar_bswap16((const uint16_t *)src + done, (uint16_t *)dst + done, count - done);
+}
+
+SSE4_FN static void imdma_convert_sse4_bswap32(const void *src, void *dst, size_t count)
+{
+	size_t done = imdma_convert_sse4_bswap(src, dst, count * 4, _mm_setr_epi8(BSWAP32_SHUFFLE)) / 4;
+	imdma_convert_scalar_bswap32((const uint32_t *)src + done, (uint32_t *)dst + done, count - done);
+}
+
+SSE4_FN static void imdma_convert_sse4_bswap64(const void *src, void *dst, size_t count)
+{
+	size_t done = imdma_convert_sse4_bswap(src, dst, count * 8, _mm_setr_epi8(BSWAP64_SHUFFLE)) / 8;
+	imdma_convert_scalar_bswap64((const uint64_t *)src + done, (uint64_t *)dst + done, count - done);
+}
+
+AVX2_FN static void imdma_convert_avx2_bswap16(const void *src, void *dst, size_t count)
+{
+	size_t done =
+	    imdma_convert_avx2_bswap(src, dst, count * 2, _mm256_setr_epi8(BSWAP16_SHUFFLE, BSWAP16_SHUFFLE)) / 2;
+	imdma_convert_scalar_bswap16((const uint16_t *)src + done, (uint16_t *)dst + done, count - done);
+}
+
+AVX2_FN static void imdma_convert_avx2_bswap32(const void *src, void *dst, size_t count)
+{
+	size_t done =
+	    imdma_convert_avx2_bswap(src, dst, count * 4, _mm256_setr_epi8(BSWAP32_SHUFFLE, BSWAP32_SHUFFLE)) / 4;
+	imdma_convert_scalar_bswap32((const uint32_t *)src + done, (uint32_t *)dst + done, count - done);
+}
+
+AVX2_FN static void imdma_convert_avx2_bswap64(const void *src, void *dst, size_t count)
+{
+	size_t done =
+	    imdma_convert_avx2_bswap(src, dst, count * 8, _mm256_setr_epi8(BSWAP64_SHUFFLE, BSWAP64_SHUFFLE)) / 8;
+	imdma_convert_scalar_bswap64((const uint64_t *)src + done, (uint64_t *)dst + done, count - done);
+}
+
+// Gather even 16-bit words into the low 8 bytes and odd words into the high 8 bytes
+#define DEINTERLEAVE2_SHUFFLE 0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15
+
+SSE4_FN static void imdma_convert_sse4_deinterleave_s16(const int16_t *src, int16_t *const *dst, unsigned int channels,
+                                                        size_t frames)
+{
+	size_t frame = 0;
+	if (channels == 2)
+	{
+		const __m128i shuffle = _mm_setr_epi8(DEINTERLEAVE2_SHUFFLE);
+		for (; frame + 8 <= frames; frame += 8)
+		{
+			__m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + frame * 2)), shuffle);
+			__m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + frame * 2 + 8)), shuffle);
+			_mm_storeu_si128((__m128i *)(dst[0] + frame), _mm_unpacklo_epi64(a, b));
+			_mm_storeu_si128((__m128i *)(dst[1] + frame), _mm_unpackhi_epi64(a, b));
+		}
+	}
+	imdma_convert_scalar_deinterleave_s16_from(src, dst, channels, frame, frames);
+}
+
+AVX2_FN static void imdma_convert_avx2_deinterleave_s16(const int16_t *src, int16_t *const *dst, unsigned int channels,
+                                                        size_t frames)
+{
+	size_t frame = 0;
+	if (channels == 2)
+	{
+		const __m256i shuffle = _mm256_setr_epi8(DEINTERLEAVE2_SHUFFLE, DEINTERLEAVE2_SHUFFLE);
+		for (; frame + 16 <= frames; frame += 16)
+		{
+			// Per lane: {even x4, odd x4}; permuting 64-bit quarters gives {even x8 | odd x8}
+			__m256i a = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + frame * 2)), shuffle);
+			__m256i b = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + frame * 2 + 16)), shuffle);
+			a = _mm256_permute4x64_epi64(a, _MM_SHUFFLE(3, 1, 2, 0));
+			b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(3, 1, 2, 0));
+			_mm256_storeu_si256((__m256i *)(dst[0] + frame), _mm256_permute2x128_si256(a, b, 0x20));
+			_mm256_storeu_si256((__m256i *)(dst[1] + frame), _mm256_permute2x128_si256(a, b, 0x31));
+		}
+	}
+	imdma_convert_scalar_deinterleave_s16_from(src, dst, channels, frame, frames);
+}
+
+// MOVNTDQA streams 64-byte lines from write-combining/uncached memory instead of single loads
+SSE4_FN static void imdma_convert_sse4_copy(const void *src, void *dst, size_t bytes)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *out = (uint8_t *)dst;
+	size_t offset = 0;
+
+	if (((uintptr_t)in & 15) != 0)
+	{
+		memcpy(dst, src, bytes); // streaming loads require an aligned source
+		return;
+	}
+
+	bool nontemporal = bytes >= LIBIMDMA_COPY_NONTEMPORAL_BYTES && ((uintptr_t)out & 15) == 0;
+	for (; offset + 64 <= bytes; offset += 64)
+	{
+		__m128i a = _mm_stream_load_si128((__m128i *)(in + offset));
+		__m128i b = _mm_stream_load_si128((__m128i *)(in + offset + 16));
+		__m128i c = _mm_stream_load_si128((__m128i *)(in + offset + 32));
+		__m128i d = _mm_stream_load_si128((__m128i *)(in + offset + 48));
+		if (nontemporal)
+		{
+			_mm_stream_si128((__m128i *)(out + offset), a);
+			_mm_stream_si128((__m128i *)(out + offset + 16), b);
+			_mm_stream_si128((__m128i *)(out + offset + 32), c);
+			_mm_stream_si128((__m128i *)(out + offset + 48), d);
+		}
+		else
+		{
+			_mm_storeu_si128((__m128i *)(out + offset), a);
+			_mm_storeu_si128((__m128i *)(out + offset + 16), b);
+			_mm_storeu_si128((__m128i *)(out + offset + 32), c);
+			_mm_storeu_si128((__m128i *)(out + offset + 48), d);
+		}
+	}
+
+	if (nontemporal)
+	{
+		_mm_sfence(); // order the non-temporal stores before anything that follows
+	}
+
+	memcpy(out + offset, in + offset, bytes - offset);
+}
+
+AVX2_FN static void imdma_convert_avx2_copy(const void *src, void *dst, size_t bytes)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *out = (uint8_t *)dst;
+	size_t offset = 0;
+
+	if (((uintptr_t)in & 31) != 0)
+	{
+		imdma_convert_sse4_copy(src, dst, bytes);
+		return;
+	}
+
+	bool nontemporal = bytes >= LIBIMDMA_COPY_NONTEMPORAL_BYTES && ((uintptr_t)out & 31) == 0;
+	for (; offset + 128 <= bytes; offset += 128)
+	{
+		__m256i a = _mm256_stream_load_si256((__m256i *)(in + offset));
+		__m256i b = _mm256_stream_load_si256((__m256i *)(in + offset + 32));
+		__m256i c = _mm256_stream_load_si256((__m256i *)(in + offset + 64));
+		__m256i d = _mm256_stream_load_si256((__m256i *)(in + offset + 96));
+		if (nontemporal)
+		{
+			_mm256_stream_si256((__m256i *)(out + offset), a);
+			_mm256_stream_si256((__m256i *)(out + offset + 32), b);
+			_mm256_stream_si256((__m256i *)(out + offset + 64), c);
+			_mm256_stream_si256((__m256i *)(out + offset + 96), d);
+		}
+		else
+		{
+			_mm256_storeu_si256((__m256i *)(out + offset), a);
+			_mm256_storeu_si256((__m256i *)(out + offset + 32), b);
+			_mm256_storeu_si256((__m256i *)(out + offset + 64), c);
+			_mm256_storeu_si256((__m256i *)(out + offset + 96), d);
+		}
+	}
+
+	if (nontemporal)
+	{
+		_mm_sfence();
+	}
+
+	memcpy(out + offset, in + offset, bytes - offset);
+}
+
+// Streaming stores fill whole write-combining lines without reading the destination first
+SSE4_FN static void imdma_convert_sse4_copy_to_device(const void *src, void *dst, size_t bytes)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *out = (uint8_t *)dst;
+	size_t offset = imdma_convert_scalar_copy_to_alignment(in, out, bytes, 16);
+
+	for (; offset + 64 <= bytes; offset += 64)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(in + offset));
+		__m128i b = _mm_loadu_si128((const __m128i *)(in + offset + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(in + offset + 32));
+		__m128i d = _mm_loadu_si128((const __m128i *)(in + offset + 48));
+		_mm_stream_si128((__m128i *)(out + offset), a);
+		_mm_stream_si128((__m128i *)(out + offset + 16), b);
+		_mm_stream_si128((__m128i *)(out + offset + 32), c);
+		_mm_stream_si128((__m128i *)(out + offset + 48), d);
+	}
+	_mm_sfence();
+
+	imdma_convert_scalar_copy_to_device(in + offset, out + offset, bytes - offset);
+}
+
+AVX2_FN static void imdma_convert_avx2_copy_to_device(const void *src, void *dst, size_t bytes)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *out = (uint8_t *)dst;
+	size_t offset = imdma_convert_scalar_copy_to_alignment(in, out, bytes, 32);
+
+	for (; offset + 128 <= bytes; offset += 128)
+	{
+		__m256i a = _mm256_loadu_si256((const __m256i *)(in + offset));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(in + offset + 32));
+		__m256i c = _mm256_loadu_si256((const __m256i *)(in + offset + 64));
+		__m256i d = _mm256_loadu_si256((const __m256i *)(in + offset + 96));
+		_mm256_stream_si256((__m256i *)(out + offset), a);
+		_mm256_stream_si256((__m256i *)(out + offset + 32), b);
+		_mm256_stream_si256((__m256i *)(out + offset + 64), c);
+		_mm256_stream_si256((__m256i *)(out + offset + 96), d);
+	}
+	_mm_sfence();
+
+	imdma_convert_scalar_copy_to_device(in + offset, out + offset, bytes - offset);
+}
+
+// Compare 64 bytes per iteration against the expected counter values; the exact mismatch
+// position is found by the scalar kernel (only on the failing chunk)
+SSE4_FN static size_t imdma_convert_sse4_counter_mismatch_u64(const void *src, size_t count, uint64_t first)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	bool aligned = ((uintptr_t)in & 15) == 0;
+	const __m128i step = _mm_set1_epi64x(8);
+	__m128i e0 = _mm_set_epi64x(first + 1, first);
+	__m128i e1 = _mm_add_epi64(e0, _mm_set1_epi64x(2));
+	__m128i e2 = _mm_add_epi64(e0, _mm_set1_epi64x(4));
+	__m128i e3 = _mm_add_epi64(e0, _mm_set1_epi64x(6));
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const uint8_t *p = in + i * sizeof(uint64_t);
+		__m128i a, b, c, d;
+		if (aligned)
+		{
+			a = _mm_stream_load_si128((__m128i *)p);
+			b = _mm_stream_load_si128((__m128i *)(p + 16));
+			c = _mm_stream_load_si128((__m128i *)(p + 32));
+			d = _mm_stream_load_si128((__m128i *)(p + 48));
+		}
+		else
+		{
+			a = _mm_loadu_si128((const __m128i *)p);
+			b = _mm_loadu_si128((const __m128i *)(p + 16));
+			c = _mm_loadu_si128((const __m128i *)(p + 32));
+			d = _mm_loadu_si128((const __m128i *)(p + 48));
+		}
+		__m128i equal = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi64(a, e0), _mm_cmpeq_epi64(b, e1)),
+		                              _mm_and_si128(_mm_cmpeq_epi64(c, e2), _mm_cmpeq_epi64(d, e3)));
+		if (_mm_movemask_epi8(equal) != 0xffff)
+		{
+			break;
+		}
+		e0 = _mm_add_epi64(e0, step);
+		e1 = _mm_add_epi64(e1, step);
+		e2 = _mm_add_epi64(e2, step);
+		e3 = _mm_add_epi64(e3, step);
+	}
+	return imdma_convert_scalar_counter_mismatch_u64_from(src, count, first, i);
+}
+
+AVX2_FN static size_t imdma_convert_avx2_counter_mismatch_u64(const void *src, size_t count, uint64_t first)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	if (((uintptr_t)in & 31) != 0)
+	{
+		return imdma_convert_sse4_counter_mismatch_u64(src, count, first);
+	}
+
+	const __m256i step = _mm256_set1_epi64x(16);
+	__m256i e0 = _mm256_set_epi64x(first + 3, first + 2, first + 1, first);
+	__m256i e1 = _mm256_add_epi64(e0, _mm256_set1_epi64x(4));
+	__m256i e2 = _mm256_add_epi64(e0, _mm256_set1_epi64x(8));
+	__m256i e3 = _mm256_add_epi64(e0, _mm256_set1_epi64x(12));
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		const uint8_t *p = in + i * sizeof(uint64_t);
+		__m256i a = _mm256_stream_load_si256((__m256i *)p);
+		__m256i b = _mm256_stream_load_si256((__m256i *)(p + 32));
+		__m256i c = _mm256_stream_load_si256((__m256i *)(p + 64));
+		__m256i d = _mm256_stream_load_si256((__m256i *)(p + 96));
+		__m256i equal = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi64(a, e0), _mm256_cmpeq_epi64(b, e1)),
+		                                 _mm256_and_si256(_mm256_cmpeq_epi64(c, e2), _mm256_cmpeq_epi64(d, e3)));
+		if (_mm256_movemask_epi8(equal) != -1)
+		{
+			break;
+		}
+		e0 = _mm256_add_epi64(e0, step);
+		e1 = _mm256_add_epi64(e1, step);
+		e2 = _mm256_add_epi64(e2, step);
+		e3 = _mm256_add_epi64(e3, step);
+	}
+	return imdma_convert_scalar_counter_mismatch_u64_from(src, count, first, i);
+}
+
+static const imdma_convert_kernels_t imdma_convert_sse4_kernels = {
+    .s16_to_f32 = imdma_convert_sse4_s16_to_f32,                     //
+    .unpack12_to_s16 = imdma_convert_sse4_unpack12_to_s16,           //
+    .bswap16 = imdma_convert_sse4_bswap16,                           //
+    .bswap32 = imdma_convert_sse4_bswap32,                           //
+    .bswap64 = imdma_convert_sse4_bswap64,                           //
+    .deinterleave_s16 = imdma_convert_sse4_deinterleave_s16,         //
+    .copy = imdma_convert_sse4_copy,                                 //
+    .copy_to_device = imdma_convert_sse4_copy_to_device,             //
+    .counter_mismatch_u64 = imdma_convert_sse4_counter_mismatch_u64, //
+};
+
+static const imdma_convert_kernels_t imdma_convert_avx2_kernels = {
+    .s16_to_f32 = imdma_convert_avx2_s16_to_f32,                     //
+    .unpack12_to_s16 = imdma_convert_avx2_unpack12_to_s16,           //
+    .bswap16 = imdma_convert_avx2_bswap16,                           //
+    .bswap32 = imdma_convert_avx2_bswap32,                           //
+    .bswap64 = imdma_convert_avx2_bswap64,                           //
+    .deinterleave_s16 = imdma_convert_avx2_deinterleave_s16,         //
+    .copy = imdma_convert_avx2_copy,                                 //
+    .copy_to_device = imdma_convert_avx2_copy_to_device,             //
+    .counter_mismatch_u64 = imdma_convert_avx2_counter_mismatch_u64, //
+};
+
+#endif // LIBIMDMA_CONVERT_X86
+
+// ------------------------------------------------------------------
+// ARM NEON kernels
+// ------------------------------------------------------------------
+
+#if defined(LIBIMDMA_CONVERT_NEON)
+
+static void imdma_convert_neon_s16_to_f32(const int16_t *src, float *dst, size_t count, float scale)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		int16x8_t a = vld1q_s16(src + i);
+		int16x8_t b = vld1q_s16(src + i + 8);
+		vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(a))), scale));
+		vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(a))), scale));
+		vst1q_f32(dst + i + 8, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(b))), scale));
+		vst1q_f32(dst + i + 12, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(b))), scale));
+	}
+	imdma_convert_scalar_s16_to_f32(src + i, dst + i, count - i, scale);
+}
+
+// Build two sign-extended samples from the de-interleaved bytes of 8 packed pairs
+static inline int16x8x2_t imdma_convert_neon_unpack12_half(uint8x8_t b0, uint8x8_t b1, uint8x8_t b2)
+{
+	int16x8x2_t out;
+	uint16x8_t s0 = vorrq_u16(vmovl_u8(b0), vshlq_n_u16(vmovl_u8(vand_u8(b1, vdup_n_u8(0x0F))), 8));
+	uint16x8_t s1 = vorrq_u16(vmovl_u8(vshr_n_u8(b1, 4)), vshlq_n_u16(vmovl_u8(b2), 4));
+	out.val[0] = vshrq_n_s16(vshlq_n_s16(vreinterpretq_s16_u16(s0), 4), 4);
+	out.val[1] = vshrq_n_s16(vshlq_n_s16(vreinterpretq_s16_u16(s1), 4), 4);
+	return out;
+}
+
+static void imdma_convert_neon_unpack12_to_s16(const uint8_t *src, int16_t *dst, size_t count)
+{
+	size_t i = 0;
+	// 48 bytes in (de-interleaved into byte 0/1/2 of each pair), 32 samples out
+	for (; i + 32 <= count; i += 32)
+	{
+		uint8x16x3_t in = vld3q_u8(src + i / 2 * 3);
+		vst2q_s16(dst + i, imdma_convert_neon_unpack12_half(vget_low_u8(in.val[0]), vget_low_u8(in.val[1]),
+		                                                     vget_low_u8(in.val[2])));
+		vst2q_s16(dst + i + 16, imdma_convert_neon_unpack12_half(vget_high_u8(in.val[0]), vget_high_u8(in.val[1]),
+		                                                          vget_high_u8(in.val[2])));
+	}
+	imdma_convert_scalar_unpack12_to_s16(src + i / 2 * 3, dst + i, count - i);
+}
+
+static void imdma_convert_neon_bswap16(const void *src, void *dst, size_t count)
+{
+	size_t i = 0;
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *out = (uint8_t *)dst;
+	for (; i + 16 <= count; i += 16)
+	{
+		vst1q_u8(out + i * 2, vrev16q_u8(vld1q_u8(in + i * 2)));
+		vst1q_u8(out + i * 2 + 16, vrev16q_u8(vld1q_u8(in + i * 2 + 16)));
+	}
+	imdma_convert_scalar_bswap16(in + i * 2, out + i * 2, count - i);
+}
+
+static void imdma_convert_neon_bswap32(const void *src, void *dst, size_t count)
+{
+	size_t i = 0;
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *out = (uint8_t *)dst;
+	for (; i + 8 <= count; i += 8)
+	{
+		vst1q_u8(out + i * 4, vrev32q_u8(vld1q_u8(in + i * 4)));
+		vst1q_u8(out + i * 4 + 16, vrev32q_u8(vld1q_u8(in + i * 4 + 16)));
+	}
+	imdma_convert_scalar_bswap32(in + i * 4, out + i * 4, count - i);
+}
+
+static void imdma_convert_neon_bswap64(const void *src, void *dst, size_t count)
+{
+	size_t i = 0;
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *out = (uint8_t *)dst;
+	for (; i + 4 <= count; i += 4)
+	{
+		vst1q_u8(out + i * 8, vrev64q_u8(vld1q_u8(in + i * 8)));
+		vst1q_u8(out + i * 8 + 16, vrev64q_u8(vld1q_u8(in + i * 8 + 16)));
+	}
+	imdma_convert_scalar_bswap64(in + i * 8, out + i * 8, count - i);
+}
+
+static void imdma_convert_neon_deinterleave_s16(const int16_t *src, int16_t *const *dst, unsigned int channels,
+                                                size_t frames)
+{
+	size_t frame = 0;
+	if (channels == 2)
+	{
+		for (; frame + 8 <= frames; frame += 8)
+		{
+			int16x8x2_t in = vld2q_s16(src + frame * 2);
+			vst1q_s16(dst[0] + frame, in.val[0]);
+			vst1q_s16(dst[1] + frame, in.val[1]);
+		}
+	}
+	else if (channels == 3)
+	{
+		for (; frame + 8 <= frames; frame += 8)
+		{
+			int16x8x3_t in = vld3q_s16(src + frame * 3);
+			vst1q_s16(dst[0] + frame, in.val[0]);
+			vst1q_s16(dst[1] + frame, in.val[1]);
+			vst1q_s16(dst[2] + frame, in.val[2]);
+		}
+	}
+	else if (channels == 4)
+	{
+		for (; frame + 8 <= frames; frame += 8)
+		{
+			int16x8x4_t in = vld4q_s16(src + frame * 4);
+			vst1q_s16(dst[0] + frame, in.val[0]);
+			vst1q_s16(dst[1] + frame, in.val[1]);
+			vst1q_s16(dst[2] + frame, in.val[2]);
+			vst1q_s16(dst[3] + frame, in.val[3]);
+		}
+	}
+	imdma_convert_scalar_deinterleave_s16_from(src, dst, channels, frame, frames);
+}
+
+// Device (uncached) memory reads are slow per access, so move 64 bytes per burst
+static void imdma_convert_neon_copy(const void *src, void *dst, size_t bytes)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *out = (uint8_t *)dst;
+	size_t offset = 0;
+
+#if defined(__aarch64__)
+	if (bytes >= LIBIMDMA_COPY_NONTEMPORAL_BYTES)
+	{
+		// Load-pair from the source, non-temporal store-pair to the destination
+		for (; offset + 64 <= bytes; offset += 64)
+		{
+			__asm__ volatile("ldp q0, q1, [%[in]]\n\t"
+			                 "ldp q2, q3, [%[in], #32]\n\t"
+			                 "stnp q0, q1, [%[out]]\n\t"
+			                 "stnp q2, q3, [%[out], #32]\n\t"
+			                 :
+			                 : [in] "r"(in + offset), [out] "r"(out + offset)
+			                 : "v0", "v1", "v2", "v3", "memory");
+		}
+	}
+#endif
+
+	for (; offset + 64 <= bytes; offset += 64)
+	{
+		uint8x16_t a = vld1q_u8(in + offset);
+		uint8x16_t b = vld1q_u8(in + offset + 16);
+		uint8x16_t c = vld1q_u8(in + offset + 32);
+		uint8x16_t d = vld1q_u8(in + offset + 48);
+		vst1q_u8(out + offset, a);
+		vst1q_u8(out + offset + 16, b);
+		vst1q_u8(out + offset + 32, c);
+		vst1q_u8(out + offset + 48, d);
+	}
+
+	memcpy(out + offset, in + offset, bytes - offset);
+}
+
+// Aligned 64-byte bursts (store-pair non-temporal on AArch64) fill whole write-combining lines
+static void imdma_convert_neon_copy_to_device(const void *src, void *dst, size_t bytes)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	uint8_t *out = (uint8_t *)dst;
+	size_t offset = imdma_convert_scalar_copy_to_alignment(in, out, bytes, 16);
+
+	for (; offset + 64 <= bytes; offset += 64)
+	{
+#if defined(__aarch64__)
+		__asm__ volatile("ldp q0, q1, [%[in]]\n\t"
+		                 "ldp q2, q3, [%[in], #32]\n\t"
+		                 "stnp q0, q1, [%[out]]\n\t"
+		                 "stnp q2, q3, [%[out], #32]\n\t"
+		                 :
+		                 : [in] "r"(in + offset), [out] "r"(out + offset)
+		                 : "v0", "v1", "v2", "v3", "memory");
+#else
+		uint8x16_t a = vld1q_u8(in + offset);
+		uint8x16_t b = vld1q_u8(in + offset + 16);
+		uint8x16_t c = vld1q_u8(in + offset + 32);
+		uint8x16_t d = vld1q_u8(in + offset + 48);
+		vst1q_u8(out + offset, a);
+		vst1q_u8(out + offset + 16, b);
+		vst1q_u8(out + offset + 32, c);
+		vst1q_u8(out + offset + 48, d);
+#endif
+	}
+
+	imdma_convert_scalar_copy_to_device(in + offset, out + offset, bytes - offset);
+}
+
+// XOR against the expected values and OR the differences; any set bit means a mismatch in the chunk
+static size_t imdma_convert_neon_counter_mismatch_u64(const void *src, size_t count, uint64_t first)
+{
+	const uint8_t *in = (const uint8_t *)src;
+	const uint64_t initial[2] = {first, first + 1};
+	const uint64x2_t step = vdupq_n_u64(8);
+	uint64x2_t e0 = vld1q_u64(initial);
+	uint64x2_t e1 = vaddq_u64(e0, vdupq_n_u64(2));
+	uint64x2_t e2 = vaddq_u64(e0, vdupq_n_u64(4));
+	uint64x2_t e3 = vaddq_u64(e0, vdupq_n_u64(6));
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const uint8_t *p = in + i * sizeof(uint64_t);
+		uint64x2_t a = vreinterpretq_u64_u8(vld1q_u8(p));
+		uint64x2_t b = vreinterpretq_u64_u8(vld1q_u8(p + 16));
+		uint64x2_t c = vreinterpretq_u64_u8(vld1q_u8(p + 32));
+		uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(p + 48));
+		uint64x2_t diff = vorrq_u64(vorrq_u64(veorq_u64(a, e0), veorq_u64(b, e1)),
+		                            vorrq_u64(veorq_u64(c, e2), veorq_u64(d, e3)));
+		if (vget_lane_u64(vorr_u64(vget_low_u64(diff), vget_high_u64(diff)), 0) != 0)
+		{
+			break;
+		}
+		e0 = vaddq_u64(e0, step);
+		e1 = vaddq_u64(e1, step);
+		e2 = vaddq_u64(e2, step);
+		e3 = vaddq_u64(e3, step);
+	}
+	return imdma_convert_scalar_counter_mismatch_u64_from(src, count, first, i);
+}
+
+static const imdma_convert_kernels_t imdma_convert_neon_kernels = {
+    .s16_to_f32 = imdma_convert_neon_s16_to_f32,                     //
+    .unpack12_to_s16 = imdma_convert_neon_unpack12_to_s16,           //
+    .bswap16 = imdma_convert_neon_bswap16,                           //
+    .bswap32 = imdma_convert_neon_bswap32,                           //
+    .bswap64 = imdma_convert_neon_bswap64,                           //
+    .deinterleave_s16 = imdma_convert_neon_deinterleave_s16,         //
+    .copy = imdma_convert_neon_copy,                                 //
+    .copy_to_device = imdma_convert_neon_copy_to_device,             //
+    .counter_mismatch_u64 = imdma_convert_neon_counter_mismatch_u64, //
+};
+
+#endif // LIBIMDMA_CONVERT_NEON
+
+// ------------------------------------------------------------------
+// Runtime selection
+// ------------------------------------------------------------------
+
+static pthread_once_t s_select_once = PTHREAD_ONCE_INIT;
+static const imdma_convert_kernels_t *s_kernels = &imdma_convert_scalar_kernels;
+static imdma_convert_isa_t s_isa = IMDMA_CONVERT_ISA_SCALAR;
+
+static const imdma_convert_kernels_t *imdma_convert_isa_kernels(imdma_convert_isa_t isa)
+{
+	switch (isa)
+	{
+	case IMDMA_CONVERT_ISA_SCALAR:
+		return &imdma_convert_scalar_kernels;
+#if defined(LIBIMDMA_CONVERT_X86)
+	case IMDMA_CONVERT_ISA_SSE4:
+		return __builtin_cpu_supports("sse4.1") ? &imdma_convert_sse4_kernels : NULL;
+	case IMDMA_CONVERT_ISA_AVX2:
+		return __builtin_cpu_supports("avx2") ? &imdma_convert_avx2_kernels : NULL;
+#endif
+#if defined(LIBIMDMA_CONVERT_NEON)
+	case IMDMA_CONVERT_ISA_NEON:
+#if defined(__aarch64__)
+		return &imdma_convert_neon_kernels; // NEON is mandatory on AArch64
+#else
+		return (getauxval(AT_HWCAP) & HWCAP_NEON) ? &imdma_convert_neon_kernels : NULL;
+#endif
+#endif
+	default:
+		return NULL;
+	}
+}
+
+static void imdma_convert_select_best(void)
+{
+	static const imdma_convert_isa_t preferred[] = {IMDMA_CONVERT_ISA_AVX2, IMDMA_CONVERT_ISA_SSE4,
+	                                                IMDMA_CONVERT_ISA_NEON, IMDMA_CONVERT_ISA_SCALAR};
+
+	for (unsigned int i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++)
+	{
+		const imdma_convert_kernels_t *kernels = imdma_convert_isa_kernels(preferred[i]);
+		if (kernels != NULL)
+		{
+			s_kernels = kernels;
+			s_isa = preferred[i];
+			return;
+		}
+	}
+}
+
+static inline const imdma_convert_kernels_t *imdma_convert_kernels(void)
+{
+	pthread_once(&s_select_once, imdma_convert_select_best);
+	return s_kernels;
+}
+
+const char *imdma_convert_isa_name(imdma_convert_isa_t isa)
+{
+	switch (isa)
+	{
+	case IMDMA_CONVERT_ISA_AUTO:
+		return "auto";
+	case IMDMA_CONVERT_ISA_SCALAR:
+		return "scalar";
+	case IMDMA_CONVERT_ISA_SSE4:
+		return "sse4";
+	case IMDMA_CONVERT_ISA_AVX2:
+		return "avx2";
+	case IMDMA_CONVERT_ISA_NEON:
+		return "neon";
+	default:
+		return "unknown";
+	}
+}
+
+int imdma_convert_isa_supported(imdma_convert_isa_t isa)
+{
+	return isa == IMDMA_CONVERT_ISA_AUTO || imdma_convert_isa_kernels(isa) != NULL;
+}
+
+int imdma_convert_select_isa(imdma_convert_isa_t isa)
+{
+	pthread_once(&s_select_once, imdma_convert_select_best);
+
+	if (isa == IMDMA_CONVERT_ISA_AUTO)
+	{
+		imdma_convert_select_best();
+		return 0;
+	}
+
+	const imdma_convert_kernels_t *kernels = imdma_convert_isa_kernels(isa);
+	if (kernels == NULL)
+	{
+		return -1;
+	}
+
+	s_kernels = kernels;
+	s_isa = isa;
+	return 0;
+}
+
+imdma_convert_isa_t imdma_convert_get_isa(void)
+{
+	imdma_convert_kernels();
+	return s_isa;
+}
+
+// ------------------------------------------------------------------
+// Public kernels
+// ------------------------------------------------------------------
+
+void imdma_convert_s16_to_f32(const int16_t *src, float *dst, size_t count, float scale)
+{
+	imdma_convert_kernels()->s16_to_f32(src, dst, count, scale);
+}
+
+void imdma_convert_unpack12_to_s16(const uint8_t *src, int16_t *dst, size_t count)
+{
+	imdma_convert_kernels()->unpack12_to_s16(src, dst, count);
+}
+
+void imdma_convert_bswap16(const void *src, void *dst, size_t count)
+{
+	imdma_convert_kernels()->bswap16(src, dst, count);
+}
+
+void imdma_convert_bswap32(const void *src, void *dst, size_t count)
+{
+	imdma_convert_kernels()->bswap32(src, dst, count);
+}
+
+void imdma_convert_bswap64(const void *src, void *dst, size_t count)
+{
+	imdma_convert_kernels()->bswap64(src, dst, count);
+}
+
+void imdma_convert_deinterleave_s16(const int16_t *src, int16_t *const *dst, unsigned int channels, size_t frames)
+{
+	imdma_convert_kernels()->deinterleave_s16(src, dst, channels, frames);
+}
+
+void imdma_convert_copy(const void *src, void *dst, size_t bytes)
+{
+	imdma_convert_kernels()->copy(src, dst, bytes);
+}
+
+void imdma_convert_copy_to_device(const void *src, void *dst, size_t bytes)
+{
+	imdma_convert_kernels()->copy_to_device(src, dst, bytes);
+}
+
+size_t imdma_convert_counter_mismatch_u64(const void *src, size_t count, uint64_t first)
+{
+	return imdma_convert_kernels()->counter_mismatch_u64(src, count, first);
+}
@@ -0,0 +1,90 @@
+#ifndef __LIBIMDMA_CONVERT_H
+#define __LIBIMDMA_CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Instruction set used by the conversion kernels
+typedef enum imdma_convert_isa_en
+{
+	IMDMA_CONVERT_ISA_AUTO,   // best supported by the running CPU (default)
+	IMDMA_CONVERT_ISA_SCALAR, // portable C
+	IMDMA_CONVERT_ISA_SSE4,   // x86 SSE4.1
+	IMDMA_CONVERT_ISA_AVX2,   // x86 AVX2
+	IMDMA_CONVERT_ISA_NEON,   // ARM NEON (AArch32 and AArch64)
+} imdma_convert_isa_t;
+
+/// @brief Get a printable name for the given instruction set
+const char *imdma_convert_isa_name(imdma_convert_isa_t isa);
+
+/// @brief Check whether the given instruction set was compiled in and is supported by the running CPU
+/// @return non-zero if supported; or 0 if not
+int imdma_convert_isa_supported(imdma_convert_isa_t isa);
+
+/// @brief Select the instruction set used by all conversion kernels
+/// @note This is intended for benchmarking; it must not be called while conversions are running
+/// @return 0 on success; or non-zero if the instruction set is not supported
+int imdma_convert_select_isa(imdma_convert_isa_t isa);
+
+/// @brief Get the instruction set currently used by the conversion kernels
+imdma_convert_isa_t imdma_convert_get_isa(void);
+
+
+// All kernels read the source exactly once, front to back, so they can be pointed directly at
+// (uncached) DMA buffer memory returned by imdma_transfer_get_data_const() or imdma_stream_next().
+// The destination should be ordinary cached memory and must not overlap the source.
+
+/// @brief Convert signed 16-bit samples (e.g. interleaved I/Q) to float
+/// @param src The source samples
+/// @param dst The destination (count floats)
+/// @param count The number of samples (not I/Q pairs)
+/// @param scale Multiplied into every sample (e.g. 1.0f / 32768 for full scale = 1.0)
+void imdma_convert_s16_to_f32(const int16_t *src, float *dst, size_t count, float scale);
+
+/// @brief Unpack little-endian packed 12-bit signed samples (2 samples in 3 bytes) to 16-bit
+/// @param src The packed source (count * 3 / 2 bytes)
+/// @param dst The destination (count samples, sign-extended)
+/// @param count The number of samples (must be even)
+void imdma_convert_unpack12_to_s16(const uint8_t *src, int16_t *dst, size_t count);
+
+/// @brief Byte-swap 16-bit words
+void imdma_convert_bswap16(const void *src, void *dst, size_t count);
+
+/// @brief Byte-swap 32-bit words
+void imdma_convert_bswap32(const void *src, void *dst, size_t count);
+
+/// @brief Byte-swap 64-bit words
+void imdma_convert_bswap64(const void *src, void *dst, size_t count);
+
+/// @brief Split interleaved 16-bit channels into one buffer per channel
+/// @param src The interleaved source (frames * channels samples)
+/// @param dst An array of channels destination pointers (frames samples each)
+/// @param channels The number of interleaved channels
+/// @param frames The number of frames (samples per channel)
+void imdma_convert_deinterleave_s16(const int16_t *src, int16_t *const *dst, unsigned int channels, size_t frames);
+
+/// @brief Copy a block of bytes out of (uncached) DMA buffer memory
+/// @details Uses wide aligned loads (streaming loads on x86, load-pair on AArch64).
+///          Large copies use non-temporal stores so the destination does not evict the working set.
+/// @param src The source (typically DMA buffer memory)
+/// @param dst The destination (ordinary memory)
+/// @param bytes The number of bytes to copy
+void imdma_convert_copy(const void *src, void *dst, size_t bytes);
+
+/// @brief Copy a block of bytes into (write-combining/uncached) DMA buffer memory
+/// @details Every store to the destination is aligned and full width (streaming stores on x86,
+///          store-pair non-temporal on AArch64), so the writes merge into whole bus bursts.
+/// @param src The source (ordinary memory)
+/// @param dst The destination (typically DMA buffer memory)
+/// @param bytes The number of bytes to copy
+void imdma_convert_copy_to_device(const void *src, void *dst, size_t bytes);
+
+/// @brief Find the first 64-bit word that breaks a counting sequence (first, first + 1, ...)
+/// @param src The source words (native byte order)
+/// @param count The number of 64-bit words
+/// @param first The value expected in the first word
+/// @return The index of the first mismatching word; or count if every word matches
+size_t imdma_convert_counter_mismatch_u64(const void *src, size_t count, uint64_t first);
+
+#endif
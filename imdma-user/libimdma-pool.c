@@ -0,0 +1,259 @@
+#include "libimdma-pool.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define LIBIMDMA_NAME "libimdma"
+
+typedef struct imdma_pool_slot_st
+{
+	imdma_stream_view_t view;
+	void *output;
+	int result;
+	bool done; // kernel finished; waiting to be emitted
+} imdma_pool_slot_t;
+
+typedef struct imdma_pool_internal_st
+{
+	imdma_stream_t *stream;
+	imdma_pool_kernel_t kernel;
+	imdma_pool_emit_t emit;
+	void *user_data;
+	unsigned int output_bytes;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work_available;   // signaled when a block is submitted (or on shutdown)
+	pthread_cond_t window_available; // signaled when a block is emitted
+
+	// Reorder window (slot index = sequence % window_size)
+	imdma_pool_slot_t *slots;
+	unsigned int window_size;
+	unsigned long long submit_sequence;   // next sequence to be submitted
+	unsigned long long dispatch_sequence; // next sequence to be handed to a worker
+	unsigned long long emit_sequence;     // next sequence to be emitted
+	bool emitting;                        // a worker is currently calling emit
+	bool shutdown;
+	int error;
+
+	pthread_t *threads;
+	unsigned int thread_count;
+	unsigned int threads_started;
+} imdma_pool_internal_t;
+
+// Emit every finished block at the head of the window (in order)
+// Note: pool->mutex must be held; it is released while calling emit
+static void imdma_pool_emit_ready_locked(imdma_pool_internal_t *pool)
+{
+	if (pool->emitting)
+	{
+		return; // the emitting thread will pick up this block
+	}
+
+	pool->emitting = true;
+	while (pool->emit_sequence < pool->dispatch_sequence)
+	{
+		imdma_pool_slot_t *slot = &pool->slots[pool->emit_sequence % pool->window_size];
+		if (!slot->done)
+		{
+			break;
+		}
+
+		if (pool->emit != NULL)
+		{
+			pthread_mutex_unlock(&pool->mutex);
+			pool->emit(slot->view.sequence, slot->output, slot->result, pool->user_data);
+			pthread_mutex_lock(&pool->mutex);
+		}
+
+		slot->done = false;
+		pool->emit_sequence++;
+		pthread_cond_broadcast(&pool->window_available);
+	}
+	pool->emitting = false;
+}
+
+static void *imdma_pool_worker(void *arg)
+{
+	imdma_pool_internal_t *pool = (imdma_pool_internal_t *)arg;
+
+	pthread_mutex_lock(&pool->mutex);
+	while (true)
+	{
+		while (pool->dispatch_sequence == pool->submit_sequence && !pool->shutdown)
+		{
+			pthread_cond_wait(&pool->work_available, &pool->mutex);
+		}
+
+		if (pool->dispatch_sequence == pool->submit_sequence)
+		{
+			break; // shutdown and no work left
+		}
+
+		imdma_pool_slot_t *slot = &pool->slots[pool->dispatch_sequence % pool->window_size];
+		pool->dispatch_sequence++;
+		pthread_mutex_unlock(&pool->mutex);
+
+		slot->result = pool->kernel(&slot->view, slot->output, pool->output_bytes, pool->user_data);
+
+		// Hand the buffer back to the driver right away (the result is kept in the slot)
+		int doneResult = imdma_stream_done(pool->stream, &slot->view);
+
+		pthread_mutex_lock(&pool->mutex);
+		if (doneResult != 0 && pool->error == 0)
+		{
+			pool->error = doneResult;
+		}
+		slot->done = true;
+		imdma_pool_emit_ready_locked(pool);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+imdma_pool_t *imdma_pool_create(imdma_stream_t *stream, unsigned int threadCount, unsigned int windowSize,
+                                unsigned int outputBytes, imdma_pool_kernel_t kernel, imdma_pool_emit_t emit,
+                                void *userData)
+{
+	if (stream == NULL || kernel == NULL)
+	{
+		fprintf(stderr, LIBIMDMA_NAME ": pool requires a stream and a kernel\n");
+		return NULL;
+	}
+
+	if (threadCount == 0)
+	{
+		long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+		threadCount = cpuCount > 0 ? (unsigned int)cpuCount : 1;
+	}
+
+	if (windowSize == 0)
+	{
+		windowSize = 2 * threadCount;
+	}
+
+	imdma_pool_internal_t *pool = calloc(1, sizeof(imdma_pool_internal_t));
+	if (pool == NULL)
+	{
+		perror(LIBIMDMA_NAME ": failed to malloc");
+		return NULL;
+	}
+
+	pool->stream = stream;
+	pool->kernel = kernel;
+	pool->emit = emit;
+	pool->user_data = userData;
+	pool->output_bytes = outputBytes;
+	pool->window_size = windowSize;
+	pool->thread_count = threadCount;
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_available, NULL);
+	pthread_cond_init(&pool->window_available, NULL);
+
+	pool->slots = calloc(windowSize, sizeof(imdma_pool_slot_t));
+	pool->threads = calloc(threadCount, sizeof(pthread_t));
+	if (pool->slots == NULL || pool->threads == NULL)
+	{
+		perror(LIBIMDMA_NAME ": failed to allocate pool memory");
+		imdma_pool_free(pool);
+		return NULL;
+	}
+
+	// Allocate all output buffers up front (nothing is allocated while running)
+	for (unsigned int i = 0; i < windowSize && outputBytes > 0; i++)
+	{
+		pool->slots[i].output = malloc(outputBytes);
+		if (pool->slots[i].output == NULL)
+		{
+			perror(LIBIMDMA_NAME ": failed to allocate pool output memory");
+			imdma_pool_free(pool);
+			return NULL;
+		}
+	}
+
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		int rc = pthread_create(&pool->threads[i], NULL, imdma_pool_worker, pool);
+		if (rc != 0)
+		{
+			errno = rc;
+			perror(LIBIMDMA_NAME ": failed to create pool thread");
+			imdma_pool_free(pool);
+			return NULL;
+		}
+		pool->threads_started++;
+	}
+
+	return pool;
+}
+
+void imdma_pool_free(imdma_pool_t *pool)
+{
+	imdma_pool_internal_t *state = (imdma_pool_internal_t *)pool;
+
+	// Workers finish every submitted block before exiting
+	pthread_mutex_lock(&state->mutex);
+	state->shutdown = true;
+	pthread_cond_broadcast(&state->work_available);
+	pthread_mutex_unlock(&state->mutex);
+
+	for (unsigned int i = 0; i < state->threads_started; i++)
+	{
+		pthread_join(state->threads[i], NULL);
+	}
+
+	if (state->slots != NULL)
+	{
+		for (unsigned int i = 0; i < state->window_size; i++)
+		{
+			free(state->slots[i].output);
+		}
+		free(state->slots);
+	}
+
+	free(state->threads);
+
+	pthread_cond_destroy(&state->window_available);
+	pthread_cond_destroy(&state->work_available);
+	pthread_mutex_destroy(&state->mutex);
+
+	free(state);
+}
+
+int imdma_pool_submit(imdma_pool_t *pool, const imdma_stream_view_t *view)
+{
+	imdma_pool_internal_t *state = (imdma_pool_internal_t *)pool;
+
+	pthread_mutex_lock(&state->mutex);
+	while (state->submit_sequence - state->emit_sequence >= state->window_size)
+	{
+		pthread_cond_wait(&state->window_available, &state->mutex);
+	}
+
+	imdma_pool_slot_t *slot = &state->slots[state->submit_sequence % state->window_size];
+	slot->view = *view;
+	slot->done = false;
+	state->submit_sequence++;
+	pthread_cond_signal(&state->work_available);
+
+	int error = state->error;
+	pthread_mutex_unlock(&state->mutex);
+
+	return error;
+}
+
+void imdma_pool_drain(imdma_pool_t *pool)
+{
+	imdma_pool_internal_t *state = (imdma_pool_internal_t *)pool;
+
+	pthread_mutex_lock(&state->mutex);
+	while (state->emit_sequence != state->submit_sequence)
+	{
+		pthread_cond_wait(&state->window_available, &state->mutex);
+	}
+	pthread_mutex_unlock(&state->mutex);
+}
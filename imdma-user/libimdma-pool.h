@@ -0,0 +1,57 @@
+#ifndef __LIBIMDMA_POOL_H
+#define __LIBIMDMA_POOL_H
+
+#include "libimdma.h"
+
+
+typedef void imdma_pool_t;
+
+/// @brief User function that processes one block (called from a worker thread)
+/// @param view The completed block (the data is only valid until this function returns)
+/// @param output The output buffer for this block (outputBytes long; NULL if outputBytes is 0)
+/// @param outputBytes The size of the output buffer in bytes
+/// @param userData The pointer given to imdma_pool_create()
+/// @return The number of output bytes produced; or negative on error
+typedef int (*imdma_pool_kernel_t)(const imdma_stream_view_t *view, void *output, unsigned int outputBytes,
+                                   void *userData);
+
+/// @brief User function that receives results (called in block sequence order, one call at a time)
+/// @param sequence The sequence number of the block
+/// @param output The output buffer filled by the kernel (only valid until this function returns)
+/// @param result The value returned by the kernel
+/// @param userData The pointer given to imdma_pool_create()
+typedef void (*imdma_pool_emit_t)(unsigned long long sequence, const void *output, int result, void *userData);
+
+/// @brief Create a pool of worker threads that process stream blocks in parallel and emit results in order
+/// @details Each block is released back to the stream (and re-armed) as soon as its kernel returns,
+///          while the results wait in a reorder window until every earlier block has been emitted.
+/// @param stream A pointer to the imdma_stream_t returned by imdma_stream_open()
+/// @param threadCount The number of worker threads; 0 uses one per online CPU
+/// @param windowSize The maximum number of blocks in flight (submitted but not emitted); 0 uses 2 * threadCount
+/// @param outputBytes The size of the output buffer handed to the kernel for each block
+/// @param kernel The function run on each block
+/// @param emit The function that receives results in sequence order (may be NULL)
+/// @param userData Passed through to kernel and emit
+/// @note If this function returns non-NULL, the user must call imdma_pool_free() when finished with it
+/// @return imdma_pool_t pointer on success; or NULL on failure
+imdma_pool_t *imdma_pool_create(imdma_stream_t *stream, unsigned int threadCount, unsigned int windowSize,
+                                unsigned int outputBytes, imdma_pool_kernel_t kernel, imdma_pool_emit_t emit,
+                                void *userData);
+
+/// @brief Wait for every submitted block to be emitted, stop the workers and free the pool
+/// @param pool A pointer to the imdma_pool_t returned by imdma_pool_create()
+void imdma_pool_free(imdma_pool_t *pool);
+
+/// @brief Queue a block returned by imdma_stream_next() for processing
+/// @details Blocks while the reorder window is full. The pool takes ownership of the view
+///          and returns it to the stream with imdma_stream_done().
+/// @param pool A pointer to the imdma_pool_t returned by imdma_pool_create()
+/// @param view The view populated by imdma_stream_next()
+/// @return 0 on success; or non-zero (errno) if a previous block could not be returned to the stream
+int imdma_pool_submit(imdma_pool_t *pool, const imdma_stream_view_t *view);
+
+/// @brief Wait for every submitted block to be emitted
+/// @param pool A pointer to the imdma_pool_t returned by imdma_pool_create()
+void imdma_pool_drain(imdma_pool_t *pool);
+
+#endif
@@ -0,0 +1,429 @@
+#include "libimdma-record.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef IMDMA_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef IMDMA_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define LIBIMDMA_NAME "libimdma"
+
+typedef struct imdma_record_internal_st
+{
+	const unsigned char *map;
+	size_t map_bytes;
+	const imdma_record_header_t *header;
+
+	// Record offsets: the index in the file, or found by walking the segment
+	// (each entry starts with the uint64_t offset; version 1 indexes hold nothing else)
+	const unsigned char *offsets;
+	size_t offset_stride;      // bytes from one entry to the next
+	uint64_t *scanned_offsets; // allocated (and owned) when walking
+	uint64_t block_count;
+	uint64_t skipped_regions; // damaged stretches stepped over while walking
+} imdma_record_internal_t;
+
+size_t imdma_record_block_stride(size_t lengthBytes)
+{
+	size_t bytes = sizeof(imdma_record_block_header_t) + lengthBytes;
+	return (bytes + IMDMA_RECORD_ALIGNMENT - 1) / IMDMA_RECORD_ALIGNMENT * IMDMA_RECORD_ALIGNMENT;
+}
+
+int imdma_record_codec_available(uint32_t codec)
+{
+	switch (codec)
+	{
+	case IMDMA_RECORD_CODEC_NONE:
+		return 1;
+#ifdef IMDMA_HAVE_LZ4
+	case IMDMA_RECORD_CODEC_LZ4:
+		return 1;
+#endif
+#ifdef IMDMA_HAVE_ZSTD
+	case IMDMA_RECORD_CODEC_ZSTD:
+		return 1;
+#endif
+	default:
+		return 0;
+	}
+}
+
+const char *imdma_record_codec_name(uint32_t codec)
+{
+	switch (codec)
+	{
+	case IMDMA_RECORD_CODEC_NONE:
+		return "none";
+	case IMDMA_RECORD_CODEC_LZ4:
+		return "lz4";
+	case IMDMA_RECORD_CODEC_ZSTD:
+		return "zstd";
+	default:
+		return NULL;
+	}
+}
+
+size_t imdma_record_compress_bound(uint32_t codec, size_t lengthBytes)
+{
+	switch (codec)
+	{
+#ifdef IMDMA_HAVE_LZ4
+	case IMDMA_RECORD_CODEC_LZ4:
+		return LZ4_compressBound(lengthBytes);
+#endif
+#ifdef IMDMA_HAVE_ZSTD
+	case IMDMA_RECORD_CODEC_ZSTD:
+		return ZSTD_compressBound(lengthBytes);
+#endif
+	default:
+		return lengthBytes;
+	}
+}
+
+size_t imdma_record_compress(uint32_t codec, int level, const void *src, size_t srcBytes, void *dst,
+                             size_t dstBytes)
+{
+	switch (codec)
+	{
+#ifdef IMDMA_HAVE_LZ4
+	case IMDMA_RECORD_CODEC_LZ4:
+	{
+		int bytes = LZ4_compress_fast(src, dst, srcBytes, dstBytes, level);
+		return bytes > 0 ? bytes : 0;
+	}
+#endif
+#ifdef IMDMA_HAVE_ZSTD
+	case IMDMA_RECORD_CODEC_ZSTD:
+	{
+		size_t bytes = ZSTD_compress(dst, dstBytes, src, srcBytes, level);
+		return ZSTD_isError(bytes) ? 0 : bytes;
+	}
+#endif
+	default:
+		(void)level;
+		(void)src;
+		(void)srcBytes;
+		(void)dst;
+		(void)dstBytes;
+		return 0;
+	}
+}
+
+// Decompress one block; returns 0 on success or errno
+static int imdma_record_decompress(uint32_t codec, const void *src, size_t srcBytes, void *dst, size_t lengthBytes)
+{
+	switch (codec)
+	{
+#ifdef IMDMA_HAVE_LZ4
+	case IMDMA_RECORD_CODEC_LZ4:
+		return LZ4_decompress_safe(src, dst, srcBytes, lengthBytes) == (int)lengthBytes ? 0 : EILSEQ;
+#endif
+#ifdef IMDMA_HAVE_ZSTD
+	case IMDMA_RECORD_CODEC_ZSTD:
+		return ZSTD_decompress(dst, lengthBytes, src, srcBytes) == lengthBytes ? 0 : EILSEQ;
+#endif
+	default:
+		(void)src;
+		(void)srcBytes;
+		(void)dst;
+		(void)lengthBytes;
+		return ENOTSUP;
+	}
+}
+
+// Get the number of bytes stored after the header of a record
+static uint32_t imdma_record_stored_bytes(const imdma_record_block_header_t *block)
+{
+	return block->codec == IMDMA_RECORD_CODEC_NONE ? block->length_bytes : block->stored_bytes;
+}
+
+// Get the offset of record N
+static uint64_t imdma_record_offset(const imdma_record_internal_t *record, uint64_t index)
+{
+	uint64_t offset;
+	memcpy(&offset, record->offsets + index * record->offset_stride, sizeof(offset));
+	return offset;
+}
+
+// Get the record at the given offset if it is complete and inside the mapping; or NULL
+static const imdma_record_block_header_t *imdma_record_block_at(const imdma_record_internal_t *record,
+                                                                uint64_t offset)
+{
+	if (offset < record->header->header_bytes || offset > record->map_bytes ||
+	    record->map_bytes - offset < sizeof(imdma_record_block_header_t))
+	{
+		return NULL;
+	}
+
+	const imdma_record_block_header_t *block = (const imdma_record_block_header_t *)(record->map + offset);
+	uint64_t remaining = record->map_bytes - offset;
+	if (block->magic != IMDMA_RECORD_BLOCK_MAGIC || block->header_bytes < sizeof(imdma_record_block_header_t) ||
+	    block->header_bytes > remaining || remaining - block->header_bytes < imdma_record_stored_bytes(block))
+	{
+		return NULL;
+	}
+
+	return block;
+}
+
+// Use the index written when the segment was closed; returns false if there is none (or it is damaged)
+static bool imdma_record_load_index(imdma_record_internal_t *record)
+{
+	uint64_t indexOffset = record->header->index_offset;
+	if (indexOffset == 0 || indexOffset > record->map_bytes ||
+	    record->map_bytes - indexOffset < sizeof(imdma_record_index_header_t))
+	{
+		return false;
+	}
+
+	const imdma_record_index_header_t *index = (const imdma_record_index_header_t *)(record->map + indexOffset);
+	size_t stride = record->header->version >= 2 ? sizeof(imdma_record_index_entry_t) : sizeof(uint64_t);
+	size_t available = (record->map_bytes - indexOffset - sizeof(*index)) / stride;
+	if (memcmp(index->magic, IMDMA_RECORD_INDEX_MAGIC, sizeof(index->magic)) != 0 || index->count > available)
+	{
+		return false;
+	}
+
+	record->offsets = (const unsigned char *)(index + 1);
+	record->offset_stride = stride;
+	record->block_count = index->count;
+	return true;
+}
+
+// Find the records by walking the segment (it was not closed, so the index was never written)
+static int imdma_record_scan(imdma_record_internal_t *record)
+{
+	uint64_t capacity = 1024;
+	record->scanned_offsets = malloc(capacity * sizeof(uint64_t));
+	if (record->scanned_offsets == NULL)
+	{
+		return ENOMEM;
+	}
+
+	// A damaged record (torn write, bad sector) is stepped over one alignment unit at a time until the next
+	// record header; the rest of the preallocated segment is zeros, so that search runs off the end of the file
+	uint32_t alignment = record->header->alignment;
+	uint64_t offset = record->header->header_bytes;
+	bool skipping = false;
+	while (offset < record->map_bytes)
+	{
+		const imdma_record_block_header_t *block = imdma_record_block_at(record, offset);
+		if (block != NULL && record->block_count > 0 && skipping)
+		{
+			// A stray header in the damaged stretch must still continue the sequence
+			const imdma_record_block_header_t *previous = imdma_record_block_at(
+			    record, record->scanned_offsets[record->block_count - 1]);
+			block = block->sequence > previous->sequence ? block : NULL;
+		}
+		if (block == NULL)
+		{
+			skipping = true;
+			offset += alignment - offset % alignment;
+			continue;
+		}
+
+		if (skipping)
+		{
+			record->skipped_regions++;
+			skipping = false;
+		}
+
+		if (record->block_count == capacity)
+		{
+			uint64_t *grown = realloc(record->scanned_offsets, capacity * 2 * sizeof(uint64_t));
+			if (grown == NULL)
+			{
+				return ENOMEM;
+			}
+			record->scanned_offsets = grown;
+			capacity *= 2;
+		}
+
+		record->scanned_offsets[record->block_count++] = offset;
+		uint64_t bytes = (uint64_t)block->header_bytes + imdma_record_stored_bytes(block);
+		offset += (bytes + alignment - 1) / alignment * alignment;
+	}
+
+	record->offsets = (const unsigned char *)record->scanned_offsets;
+	record->offset_stride = sizeof(uint64_t);
+	return 0;
+}
+
+imdma_record_t *imdma_record_open(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		perror(LIBIMDMA_NAME ": failed to open recording segment");
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(imdma_record_header_t))
+	{
+		fprintf(stderr, LIBIMDMA_NAME ": %s is not a recording segment (too short)\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	imdma_record_internal_t *record = calloc(1, sizeof(imdma_record_internal_t));
+	if (record == NULL)
+	{
+		perror(LIBIMDMA_NAME ": failed to malloc");
+		close(fd);
+		return NULL;
+	}
+
+	record->map_bytes = st.st_size;
+	record->map = mmap(NULL, record->map_bytes, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (record->map == MAP_FAILED)
+	{
+		perror(LIBIMDMA_NAME ": failed to map recording segment");
+		free(record);
+		return NULL;
+	}
+
+	record->header = (const imdma_record_header_t *)record->map;
+	if (memcmp(record->header->magic, IMDMA_RECORD_MAGIC, sizeof(record->header->magic)) != 0 ||
+	    record->header->version < 1 || record->header->version > IMDMA_RECORD_VERSION ||
+	    record->header->alignment == 0 || record->header->header_bytes < sizeof(imdma_record_header_t))
+	{
+		fprintf(stderr, LIBIMDMA_NAME ": %s is not a recording segment (or an unsupported version)\n", path);
+		imdma_record_close(record);
+		return NULL;
+	}
+
+	if (!imdma_record_load_index(record))
+	{
+		int rc = imdma_record_scan(record);
+		if (rc != 0)
+		{
+			errno = rc;
+			perror(LIBIMDMA_NAME ": failed to scan recording segment");
+			imdma_record_close(record);
+			return NULL;
+		}
+		if (record->skipped_regions != 0)
+		{
+			fprintf(stderr, LIBIMDMA_NAME ": %s: skipped %llu damaged region(s) while walking the records\n", path,
+			        (unsigned long long)record->skipped_regions);
+		}
+	}
+
+	// Sequential readers benefit from read-ahead
+	madvise((void *)record->map, record->map_bytes, MADV_SEQUENTIAL);
+
+	return record;
+}
+
+void imdma_record_close(imdma_record_t *record)
+{
+	imdma_record_internal_t *state = (imdma_record_internal_t *)record;
+
+	munmap((void *)state->map, state->map_bytes);
+	free(state->scanned_offsets);
+	free(state);
+}
+
+const imdma_record_header_t *imdma_record_get_header(imdma_record_t *record)
+{
+	imdma_record_internal_t *state = (imdma_record_internal_t *)record;
+	return state->header;
+}
+
+uint64_t imdma_record_get_block_count(imdma_record_t *record)
+{
+	imdma_record_internal_t *state = (imdma_record_internal_t *)record;
+	return state->block_count;
+}
+
+int imdma_record_is_indexed(imdma_record_t *record)
+{
+	imdma_record_internal_t *state = (imdma_record_internal_t *)record;
+	return state->scanned_offsets == NULL;
+}
+
+uint64_t imdma_record_get_skipped_regions(imdma_record_t *record)
+{
+	imdma_record_internal_t *state = (imdma_record_internal_t *)record;
+	return state->skipped_regions;
+}
+
+int imdma_record_get_block(imdma_record_t *record, uint64_t index, imdma_record_block_t *block)
+{
+	imdma_record_internal_t *state = (imdma_record_internal_t *)record;
+
+	if (index >= state->block_count)
+	{
+		return ERANGE;
+	}
+
+	const imdma_record_block_header_t *header = imdma_record_block_at(state, imdma_record_offset(state, index));
+	if (header == NULL)
+	{
+		return EILSEQ;
+	}
+
+	block->data = (const unsigned char *)header + header->header_bytes;
+	block->length_bytes = header->length_bytes;
+	block->stored_bytes = imdma_record_stored_bytes(header);
+	block->codec = header->codec;
+	block->flags = header->flags;
+	block->sequence = header->sequence;
+	block->timestamp_ns = header->timestamp_ns;
+	return 0;
+}
+
+int imdma_record_read_block(imdma_record_t *record, uint64_t index, void *dst, size_t dstBytes)
+{
+	imdma_record_block_t block;
+	int rc = imdma_record_get_block(record, index, &block);
+	if (rc != 0)
+	{
+		return rc;
+	}
+	if (dstBytes < block.length_bytes)
+	{
+		return ENOSPC;
+	}
+
+	if (block.codec == IMDMA_RECORD_CODEC_NONE)
+	{
+		memcpy(dst, block.data, block.length_bytes);
+		return 0;
+	}
+	return imdma_record_decompress(block.codec, block.data, block.stored_bytes, dst, block.length_bytes);
+}
+
+void imdma_record_prefetch(imdma_record_t *record, uint64_t first, uint64_t count)
+{
+	imdma_record_internal_t *state = (imdma_record_internal_t *)record;
+
+	if (first >= state->block_count || count == 0)
+	{
+		return;
+	}
+	uint64_t last = count > state->block_count - first ? state->block_count - 1 : first + count - 1;
+
+	// Records are laid out in order, so the range runs from the first record to the end of the last one
+	const imdma_record_block_header_t *end = imdma_record_block_at(state, imdma_record_offset(state, last));
+	uint64_t start = imdma_record_offset(state, first) & ~(uint64_t)(sysconf(_SC_PAGESIZE) - 1);
+	uint64_t stop = end != NULL ? imdma_record_offset(state, last) + end->header_bytes + imdma_record_stored_bytes(end)
+	                            : state->map_bytes;
+	if (start < stop && stop <= state->map_bytes)
+	{
+		madvise((void *)(state->map + start), stop - start, MADV_WILLNEED);
+	}
+}
@@ -0,0 +1,174 @@
+#ifndef __LIBIMDMA_RECORD_H
+#define __LIBIMDMA_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Segmented recording format (written by imdma-dump)
+//
+// A recording is a series of segment files (<prefix>000000.imdma, <prefix>000001.imdma, ...),
+// each preallocated to the segment size. All fields are little-endian.
+//
+//    offset 0              imdma_record_header_t, padded to header_bytes
+//    header_bytes          block record: imdma_record_block_header_t, data, zero padding to alignment
+//    ...                   (one record per block, in sequence order)
+//    index_offset          imdma_record_index_header_t, then block_count imdma_record_index_entry_t
+//
+// Every record starts on an alignment boundary, so the data can be written with O_DIRECT.
+// A block may be stored compressed (imdma-dump -z): its record then holds stored_bytes of codec output,
+// which decompress to length_bytes. The index gives both sizes for every block, so a reader can size its
+// buffers or skip blocks without touching the records.
+// Version 1 (no compression) has zero codec and stored_bytes fields and an index of uint64_t offsets only.
+// The index and the header's block_count/index_offset are written when the segment is closed;
+// a segment that was never closed (crash, power loss) has index_offset 0 and is read by walking
+// the records from the start; a damaged record is skipped by searching the following alignment boundaries
+// for the next valid record header.
+
+#define IMDMA_RECORD_MAGIC "IMDMAREC"       // imdma_record_header_t.magic
+#define IMDMA_RECORD_INDEX_MAGIC "IMDMAIDX" // imdma_record_index_header_t.magic
+#define IMDMA_RECORD_BLOCK_MAGIC 0x314b4c42 // imdma_record_block_header_t.magic ("BLK1")
+#define IMDMA_RECORD_VERSION 2
+#define IMDMA_RECORD_ALIGNMENT 4096
+#define IMDMA_RECORD_SUFFIX ".imdma"
+
+// imdma_record_block_header_t.flags
+#define IMDMA_RECORD_FLAG_VERIFY_ERROR 0x1 // the counter test pattern check found errors in this block
+#define IMDMA_RECORD_FLAG_AFTER_DROP 0x2   // blocks were dropped (not recorded) just before this one
+
+// imdma_record_block_header_t.codec
+#define IMDMA_RECORD_CODEC_NONE 0 // stored as is
+#define IMDMA_RECORD_CODEC_LZ4 1  // LZ4 block format (built with IMDMA_HAVE_LZ4)
+#define IMDMA_RECORD_CODEC_ZSTD 2 // Zstandard frame (built with IMDMA_HAVE_ZSTD)
+
+typedef struct imdma_record_header_st
+{
+	char magic[8];                 // IMDMA_RECORD_MAGIC
+	uint32_t version;              // IMDMA_RECORD_VERSION
+	uint32_t header_bytes;         // offset of the first block record
+	uint32_t alignment;            // every record starts on a multiple of this
+	uint32_t block_bytes;          // stream block length when recorded (records may be shorter)
+	uint64_t segment_index;        // 0, 1, 2, ... within the recording
+	uint64_t first_sequence;       // sequence number of the first block in this segment
+	uint64_t created_realtime_ns;  // CLOCK_REALTIME when the segment was created
+	uint64_t created_monotonic_ns; // CLOCK_MONOTONIC at the same moment (to convert block timestamps)
+	uint64_t index_offset;         // offset of the index; 0 if the segment was not closed
+	uint64_t block_count;          // number of records; 0 if the segment was not closed
+	char device[64];               // device path (NUL terminated, may be truncated)
+} imdma_record_header_t;
+
+typedef struct imdma_record_block_header_st
+{
+	uint32_t magic;        // IMDMA_RECORD_BLOCK_MAGIC
+	uint32_t header_bytes; // offset of the data from the start of the record
+	uint64_t sequence;     // stream sequence number
+	uint64_t timestamp_ns; // CLOCK_MONOTONIC completion time (imdma_stream_view_t.complete_ns)
+	uint32_t length_bytes; // data length
+	uint32_t flags;        // IMDMA_RECORD_FLAG_*
+	uint32_t stored_bytes; // bytes following the header (the compressed length); version 1: 0
+	uint32_t codec;        // IMDMA_RECORD_CODEC_*
+	uint32_t reserved[6];
+} imdma_record_block_header_t;
+
+typedef struct imdma_record_index_header_st
+{
+	char magic[8];  // IMDMA_RECORD_INDEX_MAGIC
+	uint64_t count; // number of entries that follow
+} imdma_record_index_header_t;
+
+typedef struct imdma_record_index_entry_st
+{
+	uint64_t offset;       // record offset
+	uint32_t stored_bytes; // imdma_record_block_header_t.stored_bytes
+	uint32_t length_bytes; // imdma_record_block_header_t.length_bytes
+} imdma_record_index_entry_t;
+
+/// @brief Get the size of a record (header, data and padding) holding lengthBytes of data
+size_t imdma_record_block_stride(size_t lengthBytes);
+
+/// @brief Check whether a codec was built in
+/// @return non-zero if blocks can be compressed and decompressed with it
+int imdma_record_codec_available(uint32_t codec);
+
+/// @brief Get the name of a codec ("none", "lz4", "zstd"); or NULL if it is unknown
+const char *imdma_record_codec_name(uint32_t codec);
+
+/// @brief Get the largest compressed size of lengthBytes of data (the output buffer size to use)
+size_t imdma_record_compress_bound(uint32_t codec, size_t lengthBytes);
+
+/// @brief Compress one block
+/// @param codec IMDMA_RECORD_CODEC_LZ4 or IMDMA_RECORD_CODEC_ZSTD
+/// @param level Compression level (zstd: 1 fast .. 19 small; LZ4: acceleration, 1 = default)
+/// @param src The block data
+/// @param srcBytes The block length
+/// @param dst The output buffer
+/// @param dstBytes The output buffer size (imdma_record_compress_bound() is always enough)
+/// @return The compressed length; or 0 on failure (codec not built in, or dstBytes too small)
+size_t imdma_record_compress(uint32_t codec, int level, const void *src, size_t srcBytes, void *dst,
+                             size_t dstBytes);
+
+
+typedef void imdma_record_t;
+
+/// @brief One block of a segment, as returned by imdma_record_get_block()
+typedef struct imdma_record_block_st
+{
+	const void *data;      // stored data (inside the mapping; valid until imdma_record_close())
+	uint32_t length_bytes; // block length (after decompression)
+	uint32_t stored_bytes; // length of data (equal to length_bytes if not compressed)
+	uint32_t codec;        // IMDMA_RECORD_CODEC_*: data is compressed unless IMDMA_RECORD_CODEC_NONE
+	uint32_t flags;
+	uint64_t sequence;
+	uint64_t timestamp_ns;
+} imdma_record_block_t;
+
+/// @brief Open a segment file for reading
+/// @details The file is mapped read-only. The index written when the segment was closed gives
+///          constant time access to every block; without one (the recording was interrupted) the
+///          records are found by walking the segment once.
+/// @param path The segment file
+/// @note If this function returns non-NULL, the user must call imdma_record_close() when finished with it
+/// @return imdma_record_t pointer on success; or NULL on failure (not a segment, or unreadable)
+imdma_record_t *imdma_record_open(const char *path);
+
+/// @brief Unmap and free the segment
+void imdma_record_close(imdma_record_t *record);
+
+/// @brief Get the segment header
+const imdma_record_header_t *imdma_record_get_header(imdma_record_t *record);
+
+/// @brief Get the number of blocks in the segment
+uint64_t imdma_record_get_block_count(imdma_record_t *record);
+
+/// @brief Check whether the segment was closed properly (has an index)
+/// @return non-zero if the index was used; or 0 if the records were found by walking the segment
+int imdma_record_is_indexed(imdma_record_t *record);
+
+/// @brief Get the number of damaged stretches skipped while walking a segment without an index
+/// @return 0 if the segment is indexed or every record was intact
+uint64_t imdma_record_get_skipped_regions(imdma_record_t *record);
+
+/// @brief Get block N (0 .. block count - 1) of the segment in constant time
+/// @param record A pointer to the imdma_record_t returned by imdma_record_open()
+/// @param index The block number within the segment
+/// @param block Populated with the block on success
+/// @return 0 on success; or non-zero (errno) if the index is out of range or the record is damaged
+int imdma_record_get_block(imdma_record_t *record, uint64_t index, imdma_record_block_t *block);
+
+/// @brief Copy block N, decompressing it if needed
+/// @param record A pointer to the imdma_record_t returned by imdma_record_open()
+/// @param index The block number within the segment
+/// @param dst The output buffer
+/// @param dstBytes The output buffer size (at least the block's length_bytes)
+/// @return 0 on success; or non-zero (errno) if the block is out of range or damaged, dst is too small (ENOSPC),
+///         or its codec was not built in (ENOTSUP)
+int imdma_record_read_block(imdma_record_t *record, uint64_t index, void *dst, size_t dstBytes);
+
+/// @brief Start reading blocks first .. first + count - 1 from disk in the background (readahead)
+/// @details Call this some blocks ahead of the reader, so imdma_record_get_block() data is already in memory
+///          when it is used. The range is clamped to the blocks of the segment.
+/// @param record A pointer to the imdma_record_t returned by imdma_record_open()
+/// @param first The first block number
+/// @param count The number of blocks
+void imdma_record_prefetch(imdma_record_t *record, uint64_t first, uint64_t count);
+
+#endif
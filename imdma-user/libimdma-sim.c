@@ -0,0 +1,869 @@
+#include "libimdma-sim.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "imdma.h"
+
+#define LIBIMDMA_NAME "libimdma"
+
+// Same limit as the driver
+#define IMDMA_SIM_TIMEOUT_MS_MAX 30000
+
+// Blocks in flight between the tx and rx sides of a loopback (the FPGA FIFO); the sender waits when full
+#define IMDMA_SIM_LOOP_DEPTH 16
+
+typedef enum imdma_sim_buffer_state_en
+{
+	IMDMA_SIM_BUFFER_FREE,
+	IMDMA_SIM_BUFFER_RESERVED,
+	IMDMA_SIM_BUFFER_IN_PROGRESS,
+	IMDMA_SIM_BUFFER_DONE,
+} imdma_sim_buffer_state_t;
+
+typedef enum imdma_sim_pattern_en
+{
+	IMDMA_SIM_PATTERN_COUNTER,
+	IMDMA_SIM_PATTERN_ZERO,
+	IMDMA_SIM_PATTERN_RANDOM,
+	IMDMA_SIM_PATTERN_NONE,
+} imdma_sim_pattern_t;
+
+// Loopback connection shared by the channels created with the same loop=<name>
+typedef struct imdma_sim_loop_st
+{
+	char *name;
+	unsigned int references; // guarded by imdma_sim_loops_mutex
+	struct imdma_sim_loop_st *next;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t changed; // signaled when a block is added or removed (or a channel is closing)
+	unsigned char *blocks[IMDMA_SIM_LOOP_DEPTH];
+	unsigned int lengths[IMDMA_SIM_LOOP_DEPTH];
+	unsigned int head;
+	unsigned int count;
+} imdma_sim_loop_t;
+
+static pthread_mutex_t imdma_sim_loops_mutex = PTHREAD_MUTEX_INITIALIZER;
+static imdma_sim_loop_t *imdma_sim_loops;
+
+typedef struct imdma_sim_buffer_st
+{
+	imdma_sim_buffer_state_t state;
+	unsigned int length_bytes;
+	uint64_t complete_ns; // CLOCK_MONOTONIC time at which the transfer completes
+} imdma_sim_buffer_t;
+
+typedef struct imdma_sim_internal_st
+{
+	// Configuration
+	struct imdma_buffer_spec spec;
+	unsigned int direction; // IMDMA_CHANNEL_DIRECTION_*
+	double rate_bytes_per_ns;
+	uint64_t latency_ns;
+	uint64_t jitter_ns;
+	imdma_sim_pattern_t pattern;
+	unsigned int default_timeout_ms;
+	unsigned long fail_start_after; // failstart=N (0 = never fail)
+	char *loop_name;        // loop=<name> (NULL if not connected)
+	imdma_sim_loop_t *loop;
+	bool loop_closing;      // the producer must stop waiting on the loop (guarded by loop->mutex)
+
+	unsigned char *memory;
+	size_t memory_bytes;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t started;  // signaled when a transfer is queued (or on shutdown)
+	pthread_cond_t finished; // signaled when a transfer completes
+	imdma_sim_buffer_t *buffers;
+
+	// Started transfers in submission order (the hardware completes them in order)
+	unsigned int *queue;
+	unsigned int queue_head;
+	unsigned int queue_count;
+
+	unsigned long start_count; // transfer starts accepted so far
+	uint64_t bus_free_ns;      // time at which the simulated bus finishes the last queued transfer
+	uint64_t last_complete_ns; // completion time of the last queued transfer
+	uint64_t random_state;     // xorshift64 state (jitter; guarded by mutex)
+	uint64_t pattern_state;    // next counter word or random state (producer thread only)
+
+	bool shutdown;
+	bool thread_started;
+	pthread_t thread;
+} imdma_sim_internal_t;
+
+static uint64_t imdma_sim_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct timespec imdma_sim_timespec(uint64_t ns)
+{
+	struct timespec ts = {.tv_sec = ns / 1000000000ull, .tv_nsec = ns % 1000000000ull};
+	return ts;
+}
+
+static uint64_t imdma_sim_xorshift64(uint64_t *state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+// ------------------------------------------------------------------
+// Parameter parsing
+// ------------------------------------------------------------------
+
+// Parse a number with an optional decimal (k, M, G) or binary (Ki, Mi, Gi) multiplier
+// followed by an optional unit (B, Bps, B/s)
+static int imdma_sim_parse_size(const char *value, double *result)
+{
+	char *end;
+	double number = strtod(value, &end);
+	if (end == value || number < 0)
+	{
+		return -1;
+	}
+
+	double multiplier = 1;
+	if (*end == 'k' || *end == 'K')
+	{
+		multiplier = 1e3;
+		end++;
+	}
+	else if (*end == 'M')
+	{
+		multiplier = 1e6;
+		end++;
+	}
+	else if (*end == 'G')
+	{
+		multiplier = 1e9;
+		end++;
+	}
+
+	if (multiplier != 1 && *end == 'i')
+	{
+		multiplier = multiplier == 1e3 ? 1024.0 : multiplier == 1e6 ? 1048576.0 : 1073741824.0;
+		end++;
+	}
+
+	if (*end != '\0' && strcmp(end, "B") != 0 && strcmp(end, "Bps") != 0 && strcmp(end, "B/s") != 0)
+	{
+		return -1;
+	}
+
+	*result = number * multiplier;
+	return 0;
+}
+
+// Parse a duration with an optional unit (ns, us, ms, s; default us) into nanoseconds
+static int imdma_sim_parse_duration_ns(const char *value, uint64_t *result)
+{
+	char *end;
+	double number = strtod(value, &end);
+	if (end == value || number < 0)
+	{
+		return -1;
+	}
+
+	double multiplier;
+	if (*end == '\0' || strcmp(end, "us") == 0)
+	{
+		multiplier = 1e3;
+	}
+	else if (strcmp(end, "ns") == 0)
+	{
+		multiplier = 1;
+	}
+	else if (strcmp(end, "ms") == 0)
+	{
+		multiplier = 1e6;
+	}
+	else if (strcmp(end, "s") == 0)
+	{
+		multiplier = 1e9;
+	}
+	else
+	{
+		return -1;
+	}
+
+	*result = (uint64_t)(number * multiplier);
+	return 0;
+}
+
+static int imdma_sim_parse_param(imdma_sim_internal_t *sim, const char *key, const char *value)
+{
+	double number;
+	uint64_t ns;
+
+	if (strcmp(key, "rate") == 0 && imdma_sim_parse_size(value, &number) == 0)
+	{
+		sim->rate_bytes_per_ns = number / 1e9;
+	}
+	else if (strcmp(key, "block") == 0 && imdma_sim_parse_size(value, &number) == 0 && number >= 1 &&
+	         number <= 0x7fffffff)
+	{
+		sim->spec.size_bytes = (unsigned int)number;
+	}
+	else if (strcmp(key, "count") == 0 && imdma_sim_parse_size(value, &number) == 0 && number >= 1 && number <= 4096)
+	{
+		sim->spec.count = (unsigned int)number;
+	}
+	else if (strcmp(key, "latency") == 0 && imdma_sim_parse_duration_ns(value, &ns) == 0)
+	{
+		sim->latency_ns = ns;
+	}
+	else if (strcmp(key, "jitter") == 0 && imdma_sim_parse_duration_ns(value, &ns) == 0)
+	{
+		sim->jitter_ns = ns;
+	}
+	else if (strcmp(key, "timeout") == 0 && imdma_sim_parse_duration_ns(value, &ns) == 0 && ns > 0)
+	{
+		// A bare number is taken as milliseconds (like the driver property)
+		sim->default_timeout_ms = strpbrk(value, "nums") == NULL ? ns / 1000 : (ns + 999999) / 1000000;
+	}
+	else if (strcmp(key, "seed") == 0 && imdma_sim_parse_size(value, &number) == 0)
+	{
+		sim->random_state = (uint64_t)number | 1; // xorshift state must be non-zero
+	}
+	else if (strcmp(key, "pattern") == 0 && strcmp(value, "counter") == 0)
+	{
+		sim->pattern = IMDMA_SIM_PATTERN_COUNTER;
+	}
+	else if (strcmp(key, "pattern") == 0 && strcmp(value, "zero") == 0)
+	{
+		sim->pattern = IMDMA_SIM_PATTERN_ZERO;
+	}
+	else if (strcmp(key, "pattern") == 0 && strcmp(value, "random") == 0)
+	{
+		sim->pattern = IMDMA_SIM_PATTERN_RANDOM;
+	}
+	else if (strcmp(key, "pattern") == 0 && strcmp(value, "none") == 0)
+	{
+		sim->pattern = IMDMA_SIM_PATTERN_NONE;
+	}
+	else if (strcmp(key, "direction") == 0 && (strcmp(value, "rx") == 0 || strcmp(value, "s2mm") == 0))
+	{
+		sim->direction = IMDMA_CHANNEL_DIRECTION_DEV_TO_MEM;
+	}
+	else if (strcmp(key, "direction") == 0 && (strcmp(value, "tx") == 0 || strcmp(value, "mm2s") == 0))
+	{
+		sim->direction = IMDMA_CHANNEL_DIRECTION_MEM_TO_DEV;
+	}
+	else if (strcmp(key, "failstart") == 0 && imdma_sim_parse_size(value, &number) == 0)
+	{
+		sim->fail_start_after = (unsigned long)number;
+	}
+	else if (strcmp(key, "loop") == 0 && *value != '\0')
+	{
+		free(sim->loop_name);
+		sim->loop_name = strdup(value);
+	}
+	else
+	{
+		fprintf(stderr, LIBIMDMA_NAME ": invalid simulator parameter: %s=%s\n", key, value);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int imdma_sim_parse_params(imdma_sim_internal_t *sim, const char *params)
+{
+	char *copy = strdup(params);
+	if (copy == NULL)
+	{
+		return -1;
+	}
+
+	int rc = 0;
+	char *saveptr = NULL;
+	for (char *item = strtok_r(copy, ",", &saveptr); item != NULL && rc == 0; item = strtok_r(NULL, ",", &saveptr))
+	{
+		char *value = strchr(item, '=');
+		if (value == NULL)
+		{
+			fprintf(stderr, LIBIMDMA_NAME ": invalid simulator parameter (expected key=value): %s\n", item);
+			rc = -1;
+			break;
+		}
+		*value++ = '\0';
+		rc = imdma_sim_parse_param(sim, item, value);
+	}
+
+	free(copy);
+	return rc;
+}
+
+// ------------------------------------------------------------------
+// Loopback
+// ------------------------------------------------------------------
+
+// Find or create the loop with the given name (and take a reference to it)
+static imdma_sim_loop_t *imdma_sim_loop_get(const char *name)
+{
+	pthread_mutex_lock(&imdma_sim_loops_mutex);
+
+	imdma_sim_loop_t *loop = imdma_sim_loops;
+	while (loop != NULL && strcmp(loop->name, name) != 0)
+	{
+		loop = loop->next;
+	}
+
+	if (loop == NULL)
+	{
+		loop = calloc(1, sizeof(imdma_sim_loop_t));
+		if (loop != NULL && (loop->name = strdup(name)) == NULL)
+		{
+			free(loop);
+			loop = NULL;
+		}
+		if (loop != NULL)
+		{
+			pthread_mutex_init(&loop->mutex, NULL);
+			pthread_cond_init(&loop->changed, NULL);
+			loop->next = imdma_sim_loops;
+			imdma_sim_loops = loop;
+		}
+	}
+
+	if (loop != NULL)
+	{
+		loop->references++;
+	}
+
+	pthread_mutex_unlock(&imdma_sim_loops_mutex);
+	return loop;
+}
+
+static void imdma_sim_loop_put(imdma_sim_loop_t *loop)
+{
+	pthread_mutex_lock(&imdma_sim_loops_mutex);
+
+	if (--loop->references == 0)
+	{
+		imdma_sim_loop_t **link = &imdma_sim_loops;
+		while (*link != loop)
+		{
+			link = &(*link)->next;
+		}
+		*link = loop->next;
+
+		for (unsigned int i = 0; i < loop->count; i++)
+		{
+			free(loop->blocks[(loop->head + i) % IMDMA_SIM_LOOP_DEPTH]);
+		}
+		pthread_cond_destroy(&loop->changed);
+		pthread_mutex_destroy(&loop->mutex);
+		free(loop->name);
+		free(loop);
+	}
+
+	pthread_mutex_unlock(&imdma_sim_loops_mutex);
+}
+
+// Send a block into the loop (waits while the loop is full)
+static void imdma_sim_loop_send(imdma_sim_internal_t *sim, const unsigned char *data, unsigned int length)
+{
+	unsigned char *block = malloc(length > 0 ? length : 1);
+	if (block == NULL)
+	{
+		return; // dropped, like a FIFO overflow
+	}
+	memcpy(block, data, length);
+
+	imdma_sim_loop_t *loop = sim->loop;
+	pthread_mutex_lock(&loop->mutex);
+	while (loop->count == IMDMA_SIM_LOOP_DEPTH && !sim->loop_closing)
+	{
+		pthread_cond_wait(&loop->changed, &loop->mutex);
+	}
+
+	if (loop->count < IMDMA_SIM_LOOP_DEPTH)
+	{
+		unsigned int tail = (loop->head + loop->count) % IMDMA_SIM_LOOP_DEPTH;
+		loop->blocks[tail] = block;
+		loop->lengths[tail] = length;
+		loop->count++;
+		block = NULL;
+		pthread_cond_broadcast(&loop->changed);
+	}
+	pthread_mutex_unlock(&loop->mutex);
+
+	free(block);
+}
+
+// Receive the next block from the loop into data (waits for one); returns false if the channel is closing
+static bool imdma_sim_loop_receive(imdma_sim_internal_t *sim, unsigned char *data, unsigned int length)
+{
+	imdma_sim_loop_t *loop = sim->loop;
+	pthread_mutex_lock(&loop->mutex);
+	while (loop->count == 0 && !sim->loop_closing)
+	{
+		pthread_cond_wait(&loop->changed, &loop->mutex);
+	}
+
+	if (loop->count == 0)
+	{
+		pthread_mutex_unlock(&loop->mutex);
+		return false;
+	}
+
+	unsigned char *block = loop->blocks[loop->head];
+	unsigned int blockLength = loop->lengths[loop->head];
+	loop->head = (loop->head + 1) % IMDMA_SIM_LOOP_DEPTH;
+	loop->count--;
+	pthread_cond_broadcast(&loop->changed);
+	pthread_mutex_unlock(&loop->mutex);
+
+	// One block per transfer: a longer block is truncated, a shorter one is padded with zeros
+	unsigned int copy = blockLength < length ? blockLength : length;
+	memcpy(data, block, copy);
+	memset(data + copy, 0, length - copy);
+	free(block);
+	return true;
+}
+
+// ------------------------------------------------------------------
+// Producer thread
+// ------------------------------------------------------------------
+
+static void imdma_sim_fill(imdma_sim_internal_t *sim, unsigned char *data, unsigned int length)
+{
+	switch (sim->pattern)
+	{
+	case IMDMA_SIM_PATTERN_COUNTER:
+	case IMDMA_SIM_PATTERN_RANDOM:
+	{
+		unsigned int offset = 0;
+		for (; offset + sizeof(uint64_t) <= length; offset += sizeof(uint64_t))
+		{
+			uint64_t word = sim->pattern == IMDMA_SIM_PATTERN_COUNTER ? sim->pattern_state++
+			                                                          : imdma_sim_xorshift64(&sim->pattern_state);
+			memcpy(data + offset, &word, sizeof(word));
+		}
+		if (offset < length)
+		{
+			uint64_t word = sim->pattern == IMDMA_SIM_PATTERN_COUNTER ? sim->pattern_state++
+			                                                          : imdma_sim_xorshift64(&sim->pattern_state);
+			memcpy(data + offset, &word, length - offset);
+		}
+		break;
+	}
+	case IMDMA_SIM_PATTERN_ZERO:
+		memset(data, 0, length);
+		break;
+	case IMDMA_SIM_PATTERN_NONE:
+		break;
+	}
+}
+
+static void *imdma_sim_producer(void *arg)
+{
+	imdma_sim_internal_t *sim = (imdma_sim_internal_t *)arg;
+
+	pthread_mutex_lock(&sim->mutex);
+	while (true)
+	{
+		while (sim->queue_count == 0 && !sim->shutdown)
+		{
+			pthread_cond_wait(&sim->started, &sim->mutex);
+		}
+
+		if (sim->shutdown)
+		{
+			break;
+		}
+
+		unsigned int index = sim->queue[sim->queue_head];
+		imdma_sim_buffer_t *buffer = &sim->buffers[index];
+		unsigned int length = buffer->length_bytes;
+		struct timespec deadline = imdma_sim_timespec(buffer->complete_ns);
+		pthread_mutex_unlock(&sim->mutex);
+
+		// The buffer is owned by the "hardware" until it is marked done
+		unsigned char *data = &sim->memory[(size_t)index * sim->spec.size_bytes];
+		if (sim->direction == IMDMA_CHANNEL_DIRECTION_DEV_TO_MEM && sim->loop != NULL)
+		{
+			// The data arrives when the other side sends it; it still takes the latency to complete.
+			// If the transfer was given up on, complete it right away (with no data)
+			if (imdma_sim_loop_receive(sim, data, length))
+			{
+				uint64_t arrived = imdma_sim_now_ns() + sim->latency_ns;
+				if (arrived > buffer->complete_ns)
+				{
+					deadline = imdma_sim_timespec(arrived);
+				}
+			}
+			else
+			{
+				memset(data, 0, length);
+				deadline = imdma_sim_timespec(0);
+			}
+		}
+		else if (sim->direction == IMDMA_CHANNEL_DIRECTION_DEV_TO_MEM)
+		{
+			imdma_sim_fill(sim, data, length);
+		}
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+		{
+		}
+
+		// Sent data enters the loop once the transfer has been read from memory
+		if (sim->direction == IMDMA_CHANNEL_DIRECTION_MEM_TO_DEV && sim->loop != NULL)
+		{
+			imdma_sim_loop_send(sim, data, length);
+		}
+
+		pthread_mutex_lock(&sim->mutex);
+		sim->queue_head = (sim->queue_head + 1) % sim->spec.count;
+		sim->queue_count--;
+		buffer->state = IMDMA_SIM_BUFFER_DONE;
+		pthread_cond_broadcast(&sim->finished);
+	}
+	pthread_mutex_unlock(&sim->mutex);
+
+	return NULL;
+}
+
+// ------------------------------------------------------------------
+// Public functions
+// ------------------------------------------------------------------
+
+imdma_sim_t *imdma_sim_create(const char *params)
+{
+	imdma_sim_internal_t *sim = calloc(1, sizeof(imdma_sim_internal_t));
+	if (sim == NULL)
+	{
+		perror(LIBIMDMA_NAME ": failed to malloc");
+		return NULL;
+	}
+
+	// Defaults
+	sim->spec.count = 8;
+	sim->spec.size_bytes = 1024 * 1024;
+	sim->direction = IMDMA_CHANNEL_DIRECTION_DEV_TO_MEM;
+	sim->rate_bytes_per_ns = 0.8; // 800 MB/s
+	sim->latency_ns = 100000;     // 100 us
+	sim->pattern = IMDMA_SIM_PATTERN_COUNTER;
+	sim->default_timeout_ms = 1000;
+	sim->random_state = 1;
+
+	pthread_mutex_init(&sim->mutex, NULL);
+	pthread_cond_init(&sim->started, NULL);
+	pthread_cond_init(&sim->finished, NULL);
+
+	if (imdma_sim_parse_params(sim, params) != 0)
+	{
+		imdma_sim_free(sim);
+		return NULL;
+	}
+
+	sim->pattern_state = sim->pattern == IMDMA_SIM_PATTERN_RANDOM ? sim->random_state * 0x9e3779b97f4a7c15ull | 1 : 0;
+
+	if (sim->loop_name != NULL && (sim->loop = imdma_sim_loop_get(sim->loop_name)) == NULL)
+	{
+		perror(LIBIMDMA_NAME ": failed to allocate simulator loopback");
+		imdma_sim_free(sim);
+		return NULL;
+	}
+
+	sim->buffers = calloc(sim->spec.count, sizeof(imdma_sim_buffer_t));
+	sim->queue = calloc(sim->spec.count, sizeof(unsigned int));
+	if (sim->buffers == NULL || sim->queue == NULL)
+	{
+		perror(LIBIMDMA_NAME ": failed to allocate simulator state");
+		imdma_sim_free(sim);
+		return NULL;
+	}
+
+	// Page aligned like the driver mapping
+	sim->memory_bytes = (size_t)sim->spec.count * sim->spec.size_bytes;
+	sim->memory = mmap(NULL, sim->memory_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (sim->memory == MAP_FAILED)
+	{
+		sim->memory = NULL;
+		perror(LIBIMDMA_NAME ": failed to allocate simulator buffers");
+		imdma_sim_free(sim);
+		return NULL;
+	}
+
+	int rc = pthread_create(&sim->thread, NULL, imdma_sim_producer, sim);
+	if (rc != 0)
+	{
+		errno = rc;
+		perror(LIBIMDMA_NAME ": failed to create simulator thread");
+		imdma_sim_free(sim);
+		return NULL;
+	}
+	sim->thread_started = true;
+
+	return sim;
+}
+
+void imdma_sim_free(imdma_sim_t *sim)
+{
+	imdma_sim_internal_t *state = (imdma_sim_internal_t *)sim;
+
+	if (state->thread_started)
+	{
+		pthread_mutex_lock(&state->mutex);
+		state->shutdown = true;
+		pthread_cond_broadcast(&state->started);
+		pthread_mutex_unlock(&state->mutex);
+
+		// The producer may be waiting on the other side of the loop
+		if (state->loop != NULL)
+		{
+			pthread_mutex_lock(&state->loop->mutex);
+			state->loop_closing = true;
+			pthread_cond_broadcast(&state->loop->changed);
+			pthread_mutex_unlock(&state->loop->mutex);
+		}
+		pthread_join(state->thread, NULL);
+	}
+
+	if (state->loop != NULL)
+	{
+		imdma_sim_loop_put(state->loop);
+	}
+	free(state->loop_name);
+
+	if (state->memory != NULL)
+	{
+		munmap(state->memory, state->memory_bytes);
+	}
+
+	free(state->queue);
+	free(state->buffers);
+
+	pthread_cond_destroy(&state->finished);
+	pthread_cond_destroy(&state->started);
+	pthread_mutex_destroy(&state->mutex);
+
+	free(state);
+}
+
+void *imdma_sim_get_buffer(imdma_sim_t *sim)
+{
+	imdma_sim_internal_t *state = (imdma_sim_internal_t *)sim;
+	return state->memory;
+}
+
+// Wait for a started transfer to complete
+// Note: sim->mutex must be held
+static int imdma_sim_wait_locked(imdma_sim_internal_t *sim, imdma_sim_buffer_t *buffer, unsigned int timeout_ms)
+{
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline); // pthread_cond_timedwait uses CLOCK_REALTIME by default
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000l;
+	if (deadline.tv_nsec >= 1000000000l)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000l;
+	}
+
+	while (buffer->state == IMDMA_SIM_BUFFER_IN_PROGRESS)
+	{
+		if (pthread_cond_timedwait(&sim->finished, &sim->mutex, &deadline) == ETIMEDOUT)
+		{
+			return buffer->state == IMDMA_SIM_BUFFER_IN_PROGRESS ? -ETIMEDOUT : 0;
+		}
+	}
+
+	return 0;
+}
+
+static int imdma_sim_reserve_locked(imdma_sim_internal_t *sim, struct imdma_buffer_reserve_spec *spec)
+{
+	for (unsigned int i = 0; i < sim->spec.count; i++)
+	{
+		if (sim->buffers[i].state == IMDMA_SIM_BUFFER_FREE)
+		{
+			sim->buffers[i].state = IMDMA_SIM_BUFFER_RESERVED;
+			spec->buffer_index = i;
+			spec->offset_bytes = i * sim->spec.size_bytes;
+			return 0;
+		}
+	}
+
+	return -ENOBUFS;
+}
+
+static int imdma_sim_start_locked(imdma_sim_internal_t *sim, const struct imdma_transfer_start_spec *spec)
+{
+	if (spec->buffer_index >= sim->spec.count)
+	{
+		return -ENOENT;
+	}
+
+	if (spec->length_bytes > sim->spec.size_bytes)
+	{
+		return -EOVERFLOW;
+	}
+
+	imdma_sim_buffer_t *buffer = &sim->buffers[spec->buffer_index];
+	if (buffer->state == IMDMA_SIM_BUFFER_FREE)
+	{
+		return -EPERM;
+	}
+	if (buffer->state == IMDMA_SIM_BUFFER_IN_PROGRESS)
+	{
+		return -EALREADY;
+	}
+
+	if (sim->fail_start_after > 0 && sim->start_count >= sim->fail_start_after)
+	{
+		return -EIO;
+	}
+	sim->start_count++;
+
+	// Schedule the transfer: the bus moves one transfer at a time at the configured rate,
+	// then the completion is reported after the latency (completions stay in order)
+	uint64_t now = imdma_sim_now_ns();
+	uint64_t busStart = sim->bus_free_ns > now ? sim->bus_free_ns : now;
+	uint64_t busTime = sim->rate_bytes_per_ns > 0 ? (uint64_t)(spec->length_bytes / sim->rate_bytes_per_ns) : 0;
+	sim->bus_free_ns = busStart + busTime;
+
+	uint64_t complete = sim->bus_free_ns + sim->latency_ns;
+	if (sim->jitter_ns > 0)
+	{
+		complete += imdma_sim_xorshift64(&sim->random_state) % (sim->jitter_ns + 1);
+	}
+	if (complete < sim->last_complete_ns)
+	{
+		complete = sim->last_complete_ns;
+	}
+	sim->last_complete_ns = complete;
+
+	buffer->state = IMDMA_SIM_BUFFER_IN_PROGRESS;
+	buffer->length_bytes = spec->length_bytes;
+	buffer->complete_ns = complete;
+
+	sim->queue[(sim->queue_head + sim->queue_count) % sim->spec.count] = spec->buffer_index;
+	sim->queue_count++;
+	pthread_cond_signal(&sim->started);
+
+	return 0;
+}
+
+static int imdma_sim_finish_locked(imdma_sim_internal_t *sim, const struct imdma_transfer_finish_spec *spec)
+{
+	if (spec->buffer_index >= sim->spec.count)
+	{
+		return -ENOENT;
+	}
+
+	if (spec->timeout_ms >= IMDMA_SIM_TIMEOUT_MS_MAX)
+	{
+		return -EINVAL;
+	}
+
+	imdma_sim_buffer_t *buffer = &sim->buffers[spec->buffer_index];
+	if (buffer->state != IMDMA_SIM_BUFFER_IN_PROGRESS && buffer->state != IMDMA_SIM_BUFFER_DONE)
+	{
+		return -EPERM;
+	}
+
+	return imdma_sim_wait_locked(sim, buffer, spec->timeout_ms ? spec->timeout_ms : sim->default_timeout_ms);
+}
+
+static int imdma_sim_release_locked(imdma_sim_internal_t *sim, const struct imdma_buffer_release_spec *spec)
+{
+	if (spec->buffer_index >= sim->spec.count)
+	{
+		return -ENOENT;
+	}
+
+	imdma_sim_buffer_t *buffer = &sim->buffers[spec->buffer_index];
+	if (buffer->state == IMDMA_SIM_BUFFER_FREE)
+	{
+		return -EPERM;
+	}
+
+	// Like the driver, releasing a buffer with a transfer in progress waits for it first.
+	// A simulated transfer always completes, except on a loop with nothing left to receive:
+	// give up on that after the default timeout (as the driver does) and drain the queue.
+	if (buffer->state == IMDMA_SIM_BUFFER_IN_PROGRESS && sim->loop != NULL &&
+	    imdma_sim_wait_locked(sim, buffer, sim->default_timeout_ms) != 0)
+	{
+		pthread_mutex_lock(&sim->loop->mutex);
+		sim->loop_closing = true;
+		pthread_cond_broadcast(&sim->loop->changed);
+		pthread_mutex_unlock(&sim->loop->mutex);
+	}
+	while (buffer->state == IMDMA_SIM_BUFFER_IN_PROGRESS)
+	{
+		pthread_cond_wait(&sim->finished, &sim->mutex);
+	}
+
+	buffer->state = IMDMA_SIM_BUFFER_FREE;
+	return 0;
+}
+
+int imdma_sim_ioctl(imdma_sim_t *sim, unsigned long cmd, void *arg)
+{
+	imdma_sim_internal_t *state = (imdma_sim_internal_t *)sim;
+	int rc;
+
+	if (arg == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&state->mutex);
+	switch (cmd)
+	{
+	case IMDMA_BUFFER_GET_SPEC:
+		*(struct imdma_buffer_spec *)arg = state->spec;
+		rc = 0;
+		break;
+	case IMDMA_CHANNEL_GET_DIRECTION:
+		*(unsigned int *)arg = state->direction;
+		rc = 0;
+		break;
+	case IMDMA_BUFFER_RESERVE:
+		rc = imdma_sim_reserve_locked(state, (struct imdma_buffer_reserve_spec *)arg);
+		break;
+	case IMDMA_TRANSFER_START:
+		rc = imdma_sim_start_locked(state, (const struct imdma_transfer_start_spec *)arg);
+		break;
+	case IMDMA_TRANSFER_FINISH:
+		rc = imdma_sim_finish_locked(state, (const struct imdma_transfer_finish_spec *)arg);
+		break;
+	case IMDMA_BUFFER_RELEASE:
+		rc = imdma_sim_release_locked(state, (const struct imdma_buffer_release_spec *)arg);
+		break;
+	default:
+		rc = -EINVAL;
+		break;
+	}
+	pthread_mutex_unlock(&state->mutex);
+
+	if (rc < 0)
+	{
+		errno = -rc;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef __LIBIMDMA_SIM_H
+#define __LIBIMDMA_SIM_H
+
+// In-process stand-in for the imdma driver (selected by imdma_create("sim:..."))
+//
+// The simulator implements the same ioctl protocol as the driver (reserve/start/finish/release,
+// buffer states and error codes), so everything above it in libimdma runs unmodified.
+// A producer thread completes the started transfers in order, paced by the configured rate and
+// latency, and fills received buffers with a test pattern.
+//
+// Parameters (comma separated, all optional):
+//    rate=800MBps         bus rate; 0 = unlimited (suffixes k, M, G and Ki, Mi, Gi; B, Bps, B/s ignored)
+//    block=1MiB           size of each buffer
+//    count=8              number of buffers
+//    latency=100us        added to every completion (suffixes ns, us, ms, s; default us)
+//    jitter=0us           uniformly distributed extra latency (0 .. jitter)
+//    pattern=counter      counter (little-endian 64-bit words counting up across blocks), zero, random or none
+//    direction=rx         rx (device-to-host) or tx (host-to-device)
+//    timeout=1000ms       default finish timeout (the driver imsar,default-timeout-ms)
+//    seed=1               seed for the random pattern and jitter
+//    loop=<name>          connect to every other channel in this process with the same loop name, like the
+//                         FPGA loopback design: blocks sent on the tx channel are received on the rx channel
+//                         (in order, one block per transfer; the rx pattern is not used)
+//    failstart=0          fail every transfer start after the first N with EIO (to test error handling); 0 = never
+
+typedef void imdma_sim_t;
+
+/// @brief Create a simulated channel
+/// @param params The parameter string (the part of the path after "sim:")
+/// @return imdma_sim_t pointer on success; or NULL on failure (invalid parameters or out of memory)
+imdma_sim_t *imdma_sim_create(const char *params);
+
+/// @brief Stop the producer thread and free the simulated channel
+void imdma_sim_free(imdma_sim_t *sim);
+
+/// @brief Get the simulated DMA buffer memory (all buffers, back to back)
+void *imdma_sim_get_buffer(imdma_sim_t *sim);
+
+/// @brief Perform one of the IMDMA_* ioctl commands
+/// @return 0 on success; or -1 with errno set (same as ioctl())
+int imdma_sim_ioctl(imdma_sim_t *sim, unsigned long cmd, void *arg);
+
+#endif
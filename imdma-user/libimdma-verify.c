@@ -0,0 +1,104 @@
+#include "libimdma-verify.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libimdma-convert.h"
+
+static uint64_t imdma_verify_word(const unsigned char *data, size_t index)
+{
+	uint64_t word;
+	memcpy(&word, data + index * sizeof(uint64_t), sizeof(word));
+	return word;
+}
+
+// Classify a word that did not continue the sequence: if the following word continues from it, the counter
+// jumped; otherwise this single word is corrupt and the old sequence continues after it.
+// Leaves expected at the counter value of the classified word in the sequence that follows.
+static void imdma_verify_break(imdma_verify_t *verify, uint64_t value, bool jumped)
+{
+	if (jumped && value > verify->expected)
+	{
+		verify->gaps++;
+		verify->missing_words += value - verify->expected;
+		verify->expected = value;
+	}
+	else if (jumped)
+	{
+		verify->duplicates++;
+		verify->expected = value;
+	}
+	else
+	{
+		verify->corrupt_words++;
+	}
+}
+
+void imdma_verify_init(imdma_verify_t *verify)
+{
+	memset(verify, 0, sizeof(*verify));
+}
+
+unsigned long long imdma_verify_counter_u64(imdma_verify_t *verify, const void *data, size_t lengthBytes)
+{
+	const unsigned char *words = (const unsigned char *)data;
+	size_t count = lengthBytes / sizeof(uint64_t);
+	unsigned long long errors = 0;
+
+	verify->blocks++;
+	verify->words += count;
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	if (!verify->started)
+	{
+		verify->expected = imdma_verify_word(words, 0);
+		verify->started = 1;
+	}
+
+	// The previous block ended on a mismatch: its first word here tells a jump from a corrupt word
+	if (verify->pending)
+	{
+		verify->pending = 0;
+		imdma_verify_break(verify, verify->pending_value, imdma_verify_word(words, 0) == verify->pending_value + 1);
+		verify->expected++;
+		errors++;
+	}
+
+	size_t index = 0;
+	while (index < count)
+	{
+		// Fast path: find the next word that does not continue the sequence
+		size_t mismatch = index + imdma_convert_counter_mismatch_u64(words + index * sizeof(uint64_t), count - index,
+		                                                             verify->expected);
+		verify->expected += mismatch - index;
+		if (mismatch == count)
+		{
+			break;
+		}
+
+		// A mismatch on the last word is classified by the first word of the next block
+		uint64_t value = imdma_verify_word(words, mismatch);
+		if (mismatch + 1 == count)
+		{
+			verify->pending = 1;
+			verify->pending_value = value;
+			break;
+		}
+
+		imdma_verify_break(verify, value, imdma_verify_word(words, mismatch + 1) == value + 1);
+		verify->expected++;
+		index = mismatch + 1;
+		errors++;
+	}
+
+	return errors;
+}
+
+unsigned long long imdma_verify_errors(const imdma_verify_t *verify)
+{
+	return verify->gaps + verify->duplicates + verify->corrupt_words + (verify->pending ? 1 : 0);
+}
@@ -0,0 +1,43 @@
+#ifndef __LIBIMDMA_VERIFY_H
+#define __LIBIMDMA_VERIFY_H
+
+#include <stddef.h>
+
+
+// Running state of a u64 counter test pattern check (the FPGA test pattern and the simulator
+// "pattern=counter" are native-endian 64-bit words counting up across blocks)
+typedef struct imdma_verify_st
+{
+	unsigned long long expected;      // next expected counter value
+	int started;                      // expected is valid (set by the first word received)
+	int pending;                      // the last block ended on a mismatch that the next block classifies
+	unsigned long long pending_value; // that mismatched last word
+
+	unsigned long long blocks;        // blocks checked
+	unsigned long long words;         // words checked
+	unsigned long long gaps;          // times the counter jumped forward (data lost)
+	unsigned long long missing_words; // words skipped by those jumps
+	unsigned long long duplicates;    // times the counter jumped backward (data repeated)
+	unsigned long long corrupt_words; // single bad words (the counter continued as expected)
+} imdma_verify_t;
+
+/// @brief Reset the verification state and counts
+void imdma_verify_init(imdma_verify_t *verify);
+
+/// @brief Check one block for counter continuity (with the previous block and within itself)
+/// @details The common case (an unbroken sequence) is checked with vector compares while reading
+///          the block once, so it can run on the DMA buffer at line rate.
+///          A trailing partial word (length not a multiple of 8 bytes) is ignored.
+///          A mismatch on the last word of a block is classified (gap, duplicate or corrupt word) when the
+///          next block arrives, so its errors are returned by that call.
+/// @param verify The state initialized with imdma_verify_init()
+/// @param data The block data
+/// @param lengthBytes The length of the block in bytes
+/// @return The number of errors (gaps + duplicates + corrupt words) found in this block
+unsigned long long imdma_verify_counter_u64(imdma_verify_t *verify, const void *data, size_t lengthBytes);
+
+/// @brief Get the total number of errors counted so far
+/// @details A mismatch on the last word checked that has not been classified yet counts as one error.
+unsigned long long imdma_verify_errors(const imdma_verify_t *verify);
+
+#endif
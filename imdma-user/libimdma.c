@@ -9,13 +9,17 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "imdma.h"
+#include "libimdma-convert.h"
+#include "libimdma-sim.h"
 
 #define LIBIMDMA_NAME "libimdma"
 
@@ -24,8 +28,11 @@ struct imdma_internal_buffer_state_st;
 typedef struct imdma_internal_st
 {
 	int devfd;
+	imdma_sim_t *sim; // non-NULL if this is a simulated channel ("sim:..." path)
 	pthread_mutex_t mutex;
 	struct imdma_buffer_spec bufferSpec;
+	imdma_direction_t direction;
+	bool writable; // buffers are mapped PROT_WRITE
 	unsigned char *buffer;
 	unsigned int totalBufferSize;
 	struct imdma_internal_buffer_state_st *bufferStates;
@@ -41,8 +48,55 @@ typedef struct imdma_internal_buffer_state_st
 
 	unsigned int timeout_ms;
 	unsigned int length_bytes;
+
+	// Stream timing
+	unsigned long long submit_ns;
+	unsigned int start_ioctl_ns;
 } imdma_buffer_state_t;
 
+typedef struct imdma_internal_stream_st
+{
+	imdma_internal_t *imdma;
+	pthread_mutex_t mutex;    // held when changing the queue
+	pthread_cond_t queued;    // signaled when a transfer is added to the queue (or a re-arm fails)
+	unsigned int depth;       // number of transfers owned by the stream
+	unsigned int block_bytes; // length of every transfer
+	unsigned int timeout_ms;
+
+	imdma_buffer_state_t **transfers; // all transfers owned by the stream
+	imdma_buffer_state_t **queue;     // ring of started transfers (in submission order)
+	unsigned int queue_head;
+	unsigned int queue_count;
+	unsigned int unsent;              // transmit: transfers[unsent..depth) have not been handed out yet
+	unsigned int held;                // views handed out by imdma_stream_next() and not yet returned
+	int error;                        // first failed re-arm (sticky: its buffer is no longer queued)
+
+	unsigned long long next_sequence;
+} imdma_stream_internal_t;
+
+// Issue an ioctl to the driver (or the simulator)
+static int imdma_ioctl(imdma_internal_t *state, unsigned long cmd, void *arg)
+{
+	if (state->sim != NULL)
+	{
+		return imdma_sim_ioctl(state->sim, cmd, arg);
+	}
+	return ioctl(state->devfd, cmd, arg);
+}
+
+// Close the device (or stop the simulator)
+static void imdma_close(imdma_internal_t *state)
+{
+	if (state->sim != NULL)
+	{
+		imdma_sim_free(state->sim);
+	}
+	else
+	{
+		close(state->devfd);
+	}
+}
+
 imdma_t *imdma_create(const char *devicePath)
 {
 	imdma_internal_t *state = calloc(1, sizeof(imdma_internal_t));
@@ -53,21 +107,42 @@ imdma_t *imdma_create(const char *devicePath)
 		return NULL;
 	}
 
-	// Open the device
-	state->devfd = open(devicePath, 0);
-	if (state->devfd < 0)
+	bool canWrite;
+	if (strcmp(devicePath, "sim") == 0 || strncmp(devicePath, "sim:", 4) == 0)
 	{
-		free(state);
-		perror(LIBIMDMA_NAME ": failed to open device");
-		return NULL;
+		// Simulated channel (no hardware required)
+		state->devfd = -1;
+		state->sim = imdma_sim_create(devicePath[3] == ':' ? devicePath + 4 : "");
+		if (state->sim == NULL)
+		{
+			free(state);
+			return NULL;
+		}
+		canWrite = true;
+	}
+	else
+	{
+		// Open the device (read/write if allowed, so transmit buffers can be mapped writable)
+		state->devfd = open(devicePath, O_RDWR);
+		canWrite = state->devfd >= 0;
+		if (state->devfd < 0 && (errno == EACCES || errno == EROFS))
+		{
+			state->devfd = open(devicePath, O_RDONLY);
+		}
+		if (state->devfd < 0)
+		{
+			free(state);
+			perror(LIBIMDMA_NAME ": failed to open device");
+			return NULL;
+		}
 	}
 
 	// Read the buffer specifications (count and size)
-	int getSpecResult = ioctl(state->devfd, IMDMA_BUFFER_GET_SPEC, &state->bufferSpec);
+	int getSpecResult = imdma_ioctl(state, IMDMA_BUFFER_GET_SPEC, &state->bufferSpec);
 	if (getSpecResult < 0)
 	{
 		perror(LIBIMDMA_NAME ": failed to get buffer specifications");
-		close(state->devfd);
+		imdma_close(state);
 		free(state);
 		return NULL;
 	}
@@ -76,7 +151,31 @@ imdma_t *imdma_create(const char *devicePath)
 	if (state->bufferStates == NULL)
 	{
 		perror(LIBIMDMA_NAME ": failed to allocate buffer state memory");
-		close(state->devfd);
+		imdma_close(state);
+		free(state);
+		return NULL;
+	}
+
+	// Read the channel direction (older drivers do not support this ioctl)
+	unsigned int direction;
+	if (imdma_ioctl(state, IMDMA_CHANNEL_GET_DIRECTION, &direction) < 0)
+	{
+		state->direction = IMDMA_DIRECTION_UNKNOWN;
+	}
+	else if (direction == IMDMA_CHANNEL_DIRECTION_MEM_TO_DEV)
+	{
+		state->direction = IMDMA_DIRECTION_TX;
+	}
+	else
+	{
+		state->direction = IMDMA_DIRECTION_RX;
+	}
+
+	if (state->direction == IMDMA_DIRECTION_TX && !canWrite)
+	{
+		fprintf(stderr, LIBIMDMA_NAME ": %s is a transmit channel but cannot be opened for writing\n", devicePath);
+		imdma_close(state);
+		free(state->bufferStates);
 		free(state);
 		return NULL;
 	}
@@ -84,22 +183,37 @@ imdma_t *imdma_create(const char *devicePath)
 	// Compute buffer size
 	state->totalBufferSize = state->bufferSpec.count * state->bufferSpec.size_bytes;
 
-	// Map the memory into user space
-	state->buffer = mmap(NULL,                   // requested address
-	                     state->totalBufferSize, // mapped size
-	                     PROT_READ,              // protections
-	                     MAP_SHARED,             // flags
-	                     state->devfd,           // file descriptor
-	                     0);                     // offset
+	// Map the memory into user space (writable only if user space produces the data)
+	state->writable = canWrite && state->direction != IMDMA_DIRECTION_RX;
+	if (state->sim != NULL)
+	{
+		state->buffer = imdma_sim_get_buffer(state->sim);
+	}
+	else
+	{
+		state->buffer = mmap(NULL,                                                 // requested address
+		                     state->totalBufferSize,                               // mapped size
+		                     state->writable ? PROT_READ | PROT_WRITE : PROT_READ, // protections
+		                     MAP_SHARED,                                           // flags
+		                     state->devfd,                                         // file descriptor
+		                     0);                                                   // offset
+		if (state->buffer == MAP_FAILED && state->direction == IMDMA_DIRECTION_UNKNOWN && state->writable)
+		{
+			// Unknown direction: a read-only mapping is still useful for receiving
+			state->writable = false;
+			state->buffer = mmap(NULL, state->totalBufferSize, PROT_READ, MAP_SHARED, state->devfd, 0);
+		}
+	}
 	if (state->buffer == MAP_FAILED)
 	{
 		perror(LIBIMDMA_NAME ": failed to mmap");
-		close(state->devfd);
+		imdma_close(state);
+		free(state->bufferStates);
 		free(state);
 		return NULL;
 	}
 
-	for (int i = 0; i < state->bufferSpec.count; i++)
+	for (unsigned int i = 0; i < state->bufferSpec.count; i++)
 	{
 		imdma_buffer_state_t *buffer = &state->bufferStates[i];
 		buffer->imdma = state;
@@ -117,8 +231,11 @@ void imdma_free(imdma_t *imdma)
 {
 	imdma_internal_t *state = (imdma_internal_t *)imdma;
 
-	// Unmap rx channel
-	munmap(state->buffer, state->totalBufferSize);
+	// Unmap the buffers (the simulator owns its memory)
+	if (state->sim == NULL)
+	{
+		munmap(state->buffer, state->totalBufferSize);
+	}
 
 	// Free the buffer states memory
 	if (state->bufferStates != NULL)
@@ -127,18 +244,36 @@ void imdma_free(imdma_t *imdma)
 	}
 
 	// Close the device
-	close(state->devfd);
+	imdma_close(state);
 
 	// Free the imdma memory
 	free(state);
 }
 
+unsigned int imdma_get_buffer_count(imdma_t *imdma)
+{
+	imdma_internal_t *state = (imdma_internal_t *)imdma;
+	return state->bufferSpec.count;
+}
+
+unsigned int imdma_get_buffer_size(imdma_t *imdma)
+{
+	imdma_internal_t *state = (imdma_internal_t *)imdma;
+	return state->bufferSpec.size_bytes;
+}
+
+imdma_direction_t imdma_get_direction(imdma_t *imdma)
+{
+	imdma_internal_t *state = (imdma_internal_t *)imdma;
+	return state->direction;
+}
+
 imdma_transfer_t *imdma_transfer_alloc(imdma_t *imdma)
 {
 	imdma_internal_t *state = (imdma_internal_t *)imdma;
 
 	struct imdma_buffer_reserve_spec spec;
-	int res = ioctl(state->devfd, IMDMA_BUFFER_RESERVE, &spec);
+	int res = imdma_ioctl(state, IMDMA_BUFFER_RESERVE, &spec);
 	if (res == 0)
 	{
 		imdma_buffer_state_t *buffer = &state->bufferStates[spec.buffer_index];
@@ -166,7 +301,7 @@ int imdma_transfer_start_async(imdma_transfer_t *transfer)
 
 	// Start the transfer
 	// Note: This ioctl requires transferSpec.buffer_index, transferSpec.length_bytes
-	int startResult = ioctl(buffer->imdma->devfd, IMDMA_TRANSFER_START, &transferSpec);
+	int startResult = imdma_ioctl(buffer->imdma, IMDMA_TRANSFER_START, &transferSpec);
 	if (startResult < 0)
 	{
 		perror(LIBIMDMA_NAME ": failed to start transfer");
@@ -188,7 +323,7 @@ int imdma_transfer_finish(imdma_transfer_t *transfer)
 
 	// Wait for transfer to finish
 	// Note: This ioctl requires finishSpec.buffer_index, finishSpec.timeout_ms
-	int finishResult = ioctl(buffer->imdma->devfd, IMDMA_TRANSFER_FINISH, &finishSpec);
+	int finishResult = imdma_ioctl(buffer->imdma, IMDMA_TRANSFER_FINISH, &finishSpec);
 	if (finishResult < 0)
 	{
 		perror(LIBIMDMA_NAME ": failed to finish transfer");
@@ -206,7 +341,7 @@ void imdma_transfer_free(imdma_transfer_t *transfer)
 
 	// Release the buffer
 	// Note: This ioctl requires releaseSpec.buffer_index
-	int finishResult = ioctl(buffer->imdma->devfd, IMDMA_BUFFER_RELEASE, &releaseSpec);
+	int finishResult = imdma_ioctl(buffer->imdma, IMDMA_BUFFER_RELEASE, &releaseSpec);
 	if (finishResult < 0)
 	{
 		perror(LIBIMDMA_NAME ": failed to release buffer");
@@ -245,5 +380,295 @@ const void *imdma_transfer_get_data_const(imdma_transfer_t *transfer)
 void *imdma_transfer_get_data(imdma_transfer_t *transfer)
 {
 	imdma_buffer_state_t *buffer = (imdma_buffer_state_t *)transfer;
-	return buffer->data_start;
+	return buffer->imdma->writable ? buffer->data_start : NULL;
+}
+
+int imdma_transfer_write(imdma_transfer_t *transfer, const void *src, unsigned int len)
+{
+	imdma_buffer_state_t *buffer = (imdma_buffer_state_t *)transfer;
+
+	if (!buffer->imdma->writable)
+	{
+		fprintf(stderr, LIBIMDMA_NAME ": buffers are not mapped writable (receive channel?)\n");
+		return EPERM;
+	}
+
+	if (len > buffer->imdma->bufferSpec.size_bytes)
+	{
+		fprintf(stderr, LIBIMDMA_NAME ": write of %u bytes exceeds the buffer size (%u)\n", len,
+		        buffer->imdma->bufferSpec.size_bytes);
+		return EOVERFLOW;
+	}
+
+	imdma_convert_copy_to_device(src, buffer->data_start, len);
+	buffer->length_bytes = len;
+
+	return 0;
+}
+
+unsigned int imdma_transfer_copy_out(imdma_transfer_t *transfer, void *dst, unsigned int len)
+{
+	imdma_buffer_state_t *buffer = (imdma_buffer_state_t *)transfer;
+
+	if (len > buffer->length_bytes)
+	{
+		len = buffer->length_bytes;
+	}
+
+	// The mapping is coherent (uncached on ARM), so there is nothing to sync before reading.
+	// If the driver gains cached buffers with an explicit sync ioctl, that path belongs here.
+	imdma_convert_copy(buffer->data_start, dst, len);
+
+	return len;
+}
+
+static unsigned long long imdma_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Start the transfer and add it to the back of the stream queue
+// Note: stream->mutex must be held so the queue order matches the driver submission order
+static int imdma_stream_submit_locked(imdma_stream_internal_t *stream, imdma_buffer_state_t *buffer)
+{
+	// Transmit buffers are sent with the length they were filled with (imdma_transfer_write())
+	if (stream->imdma->direction != IMDMA_DIRECTION_TX)
+	{
+		buffer->length_bytes = stream->block_bytes;
+	}
+	buffer->timeout_ms = stream->timeout_ms;
+
+	buffer->submit_ns = imdma_now_ns();
+	int startResult = imdma_transfer_start_async(buffer);
+	buffer->start_ioctl_ns = imdma_now_ns() - buffer->submit_ns;
+	if (startResult != 0)
+	{
+		return startResult;
+	}
+
+	unsigned int tail = (stream->queue_head + stream->queue_count) % stream->depth;
+	stream->queue[tail] = buffer;
+	stream->queue_count++;
+	pthread_cond_signal(&stream->queued);
+
+	return 0;
+}
+
+imdma_stream_t *imdma_stream_open(imdma_t *imdma, unsigned int depth, unsigned int blockBytes)
+{
+	imdma_internal_t *state = (imdma_internal_t *)imdma;
+
+	if (depth == 0)
+	{
+		depth = state->bufferSpec.count;
+	}
+
+	if (blockBytes == 0)
+	{
+		blockBytes = state->bufferSpec.size_bytes;
+	}
+
+	if (depth > state->bufferSpec.count || blockBytes > state->bufferSpec.size_bytes)
+	{
+		fprintf(stderr, LIBIMDMA_NAME ": invalid stream depth (%u of %u) or block size (%u of %u)\n", depth,
+		        state->bufferSpec.count, blockBytes, state->bufferSpec.size_bytes);
+		return NULL;
+	}
+
+	imdma_stream_internal_t *stream = calloc(1, sizeof(imdma_stream_internal_t));
+	if (stream == NULL)
+	{
+		perror(LIBIMDMA_NAME ": failed to malloc");
+		return NULL;
+	}
+
+	stream->imdma = state;
+	stream->depth = depth;
+	stream->block_bytes = blockBytes;
+	stream->timeout_ms = 0;
+	pthread_mutex_init(&stream->mutex, NULL);
+	pthread_cond_init(&stream->queued, NULL);
+
+	stream->transfers = calloc(depth, sizeof(imdma_buffer_state_t *));
+	stream->queue = calloc(depth, sizeof(imdma_buffer_state_t *));
+	if (stream->transfers == NULL || stream->queue == NULL)
+	{
+		perror(LIBIMDMA_NAME ": failed to allocate stream queue memory");
+		imdma_stream_close(stream);
+		return NULL;
+	}
+
+	// A transmit stream has nothing to send yet: its buffers are handed out empty by imdma_stream_next()
+	bool transmit = state->direction == IMDMA_DIRECTION_TX;
+	unsigned int reserved = 0;
+
+	pthread_mutex_lock(&stream->mutex);
+	for (unsigned int i = 0; i < depth; i++)
+	{
+		stream->transfers[i] = (imdma_buffer_state_t *)imdma_transfer_alloc(imdma);
+		if (stream->transfers[i] == NULL)
+		{
+			fprintf(stderr, LIBIMDMA_NAME ": only %u of %u stream buffers could be reserved\n", i, depth);
+			break;
+		}
+		reserved++;
+
+		if (!transmit && imdma_stream_submit_locked(stream, stream->transfers[i]) != 0)
+		{
+			break;
+		}
+	}
+	pthread_mutex_unlock(&stream->mutex);
+
+	if (transmit ? reserved != depth : stream->queue_count != depth)
+	{
+		imdma_stream_close(stream);
+		return NULL;
+	}
+
+	return stream;
+}
+
+void imdma_stream_close(imdma_stream_t *stream)
+{
+	imdma_stream_internal_t *state = (imdma_stream_internal_t *)stream;
+
+	// Release every buffer (the driver waits for in-progress transfers to finish)
+	if (state->transfers != NULL)
+	{
+		for (unsigned int i = 0; i < state->depth; i++)
+		{
+			if (state->transfers[i] != NULL)
+			{
+				imdma_transfer_free(state->transfers[i]);
+			}
+		}
+		free(state->transfers);
+	}
+
+	if (state->queue != NULL)
+	{
+		free(state->queue);
+	}
+
+	pthread_cond_destroy(&state->queued);
+	pthread_mutex_destroy(&state->mutex);
+
+	free(state);
+}
+
+int imdma_stream_set_timeout_ms(imdma_stream_t *stream, unsigned int timeoutMs)
+{
+	imdma_stream_internal_t *state = (imdma_stream_internal_t *)stream;
+	state->timeout_ms = timeoutMs;
+	return 0;
+}
+
+int imdma_stream_next(imdma_stream_t *stream, imdma_stream_view_t *view)
+{
+	imdma_stream_internal_t *state = (imdma_stream_internal_t *)stream;
+
+	// Transmit: hand out the buffers that have never been sent before waiting on any transfer
+	pthread_mutex_lock(&state->mutex);
+	if (state->unsent < state->depth && state->imdma->direction == IMDMA_DIRECTION_TX)
+	{
+		imdma_buffer_state_t *unused = state->transfers[state->unsent++];
+		state->held++;
+		pthread_mutex_unlock(&state->mutex);
+
+		unused->length_bytes = state->block_bytes;
+		memset(view, 0, sizeof(*view));
+		view->data = unused->data_start;
+		view->length_bytes = state->block_bytes;
+		view->sequence = state->next_sequence++;
+		view->transfer = unused;
+		return 0;
+	}
+
+	// Wait for a started transfer (all buffers may be held by the user). Once a re-arm has failed and
+	// no held buffer can still come back, nothing will ever be queued again.
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline); // pthread_cond_timedwait uses CLOCK_REALTIME by default
+	deadline.tv_sec += state->timeout_ms / 1000;
+	deadline.tv_nsec += (state->timeout_ms % 1000) * 1000000l;
+	if (deadline.tv_nsec >= 1000000000l)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000l;
+	}
+	while (state->queue_count == 0)
+	{
+		if (state->error != 0 && state->held == 0)
+		{
+			int error = state->error;
+			pthread_mutex_unlock(&state->mutex);
+			return error;
+		}
+
+		int waitResult = state->timeout_ms == 0 ? pthread_cond_wait(&state->queued, &state->mutex)
+		                                        : pthread_cond_timedwait(&state->queued, &state->mutex, &deadline);
+		if (waitResult == ETIMEDOUT && state->queue_count == 0)
+		{
+			pthread_mutex_unlock(&state->mutex);
+			return ETIMEDOUT;
+		}
+	}
+	imdma_buffer_state_t *buffer = state->queue[state->queue_head];
+	pthread_mutex_unlock(&state->mutex);
+
+	// Only this function removes from the queue, so the head stays put while waiting
+	buffer->timeout_ms = state->timeout_ms;
+	unsigned long long waitStart = imdma_now_ns();
+	int finishResult = imdma_transfer_finish(buffer);
+	unsigned long long waitEnd = imdma_now_ns();
+	if (finishResult != 0)
+	{
+		return finishResult;
+	}
+
+	pthread_mutex_lock(&state->mutex);
+	state->queue_head = (state->queue_head + 1) % state->depth;
+	state->queue_count--;
+	state->held++;
+	pthread_mutex_unlock(&state->mutex);
+
+	view->data = buffer->data_start;
+	view->length_bytes = buffer->length_bytes;
+	view->sequence = state->next_sequence++;
+	view->transfer = buffer;
+	view->submit_ns = buffer->submit_ns;
+	view->complete_ns = waitEnd;
+	view->start_ioctl_ns = buffer->start_ioctl_ns;
+	view->wait_ns = waitEnd - waitStart;
+
+	// A sent transmit buffer is refilled at the full block length unless written shorter
+	if (state->imdma->direction == IMDMA_DIRECTION_TX)
+	{
+		buffer->length_bytes = state->block_bytes;
+	}
+
+	return 0;
+}
+
+int imdma_stream_done(imdma_stream_t *stream, const imdma_stream_view_t *view)
+{
+	imdma_stream_internal_t *state = (imdma_stream_internal_t *)stream;
+
+	pthread_mutex_lock(&state->mutex);
+	int submitResult = imdma_stream_submit_locked(state, (imdma_buffer_state_t *)view->transfer);
+	state->held--;
+	if (submitResult != 0)
+	{
+		// The buffer is lost to the stream: wake imdma_stream_next() so it cannot wait for it forever
+		if (state->error == 0)
+		{
+			state->error = submitResult;
+		}
+		pthread_cond_broadcast(&state->queued);
+	}
+	pthread_mutex_unlock(&state->mutex);
+
+	return submitResult;
 }
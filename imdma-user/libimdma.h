@@ -5,8 +5,18 @@
 typedef void imdma_t;
 typedef void imdma_transfer_t;
 
+// Direction of the DMA channel
+typedef enum imdma_direction_en
+{
+	IMDMA_DIRECTION_UNKNOWN, // the driver does not report it (older driver)
+	IMDMA_DIRECTION_RX,      // device-to-host (S2MM): the buffers are mapped read-only
+	IMDMA_DIRECTION_TX,      // host-to-device (MM2S): the buffers are mapped read/write
+} imdma_direction_t;
+
 
 /// @brief Create and open the given imdma device (/dev/imdma_...)
+/// @details The buffers are mapped writable only for host-to-device channels (or when the driver
+///          does not report the direction and the device could be opened for writing).
 /// @param devicePath
 /// @return imdma_t pointer on success; or NULL on failure
 /// @note If this function returns non-NULL, the user must call imdma_free() when they are done with it
@@ -16,6 +26,18 @@ imdma_t *imdma_create(const char *devicePath);
 /// @param imdma A pointer to the imdma_t returned by imdma_create()
 void imdma_free(imdma_t *imdma);
 
+/// @brief Get the number of DMA buffers provided by the driver
+/// @param imdma A pointer to the imdma_t returned by imdma_create()
+unsigned int imdma_get_buffer_count(imdma_t *imdma);
+
+/// @brief Get the size (in bytes) of each DMA buffer provided by the driver
+/// @param imdma A pointer to the imdma_t returned by imdma_create()
+unsigned int imdma_get_buffer_size(imdma_t *imdma);
+
+/// @brief Get the direction of the DMA channel
+/// @param imdma A pointer to the imdma_t returned by imdma_create()
+imdma_direction_t imdma_get_direction(imdma_t *imdma);
+
 
 /// @brief Allocate a buffer for a DMA transfer
 /// @details If this function is unable to allocate a transfer buffer, NULL will be returned.
@@ -60,7 +82,90 @@ const void *imdma_transfer_get_data_const(imdma_transfer_t *transfer);
 
 /// @brief Get a pointer to the data
 /// @note For outgoing transfers, this must be called before imdma_transfer_start_async()
+///       The buffer may be write-combining/uncached memory; prefer imdma_transfer_write() for bulk data.
 /// @param transfer A pointer to the imdma_transfer_t returned by imdma_transfer_alloc()
+/// @return A pointer to the data; or NULL if the buffers are not mapped writable (incoming channel)
 void *imdma_transfer_get_data(imdma_transfer_t *transfer);
 
+/// @brief Fill an outgoing transfer and set its length
+/// @details Uses aligned, full-width streaming stores so the writes merge into whole bus bursts.
+/// @note This must be called before imdma_transfer_start_async()
+/// @param transfer A pointer to the imdma_transfer_t returned by imdma_transfer_alloc()
+/// @param src The data to send
+/// @param len The number of bytes to copy (becomes the transfer length)
+/// @return 0 on success; EPERM if the buffers are not mapped writable; or EOVERFLOW if len is larger than a buffer
+int imdma_transfer_write(imdma_transfer_t *transfer, const void *src, unsigned int len);
+
+/// @brief Copy the data of a finished transfer into ordinary (cached) memory
+/// @details Reading the DMA buffer directly may be slow (it is uncached on some platforms);
+///          this uses wide burst loads and non-temporal stores to reach the bus limit.
+/// @note For incoming transfers, imdma_transfer_finish() must be called first
+/// @param transfer A pointer to the imdma_transfer_t returned by imdma_transfer_alloc()
+/// @param dst The destination buffer
+/// @param len The maximum number of bytes to copy (clamped to the transfer length)
+/// @return The number of bytes copied
+unsigned int imdma_transfer_copy_out(imdma_transfer_t *transfer, void *dst, unsigned int len);
+
+
+typedef void imdma_stream_t;
+
+/// @brief A completed block handed out by imdma_stream_next()
+/// @details On a transmit stream this is a buffer that is free to fill (its previous transfer has been sent)
+typedef struct imdma_stream_view_st
+{
+	const void *data;             // start of the block data (may be uncached -- avoid repeated reads)
+	unsigned int length_bytes;    // length of the block in bytes
+	unsigned long long sequence;  // block sequence number (0, 1, 2, ...)
+	imdma_transfer_t *transfer;   // underlying transfer (owned by the stream)
+
+	// Timing (CLOCK_MONOTONIC nanoseconds)
+	unsigned long long submit_ns;   // when the transfer was handed to the driver (start ioctl issued)
+	unsigned long long complete_ns; // when the finish ioctl returned (0 if the buffer was never sent)
+	unsigned int start_ioctl_ns;    // time spent in the start ioctl
+	unsigned int wait_ns;           // time spent in the finish ioctl
+} imdma_stream_view_t;
+
+/// @brief Open a stream that keeps transfers permanently queued
+/// @details The stream reserves depth buffers and starts a transfer on each of them immediately.
+///          Every block returned to the stream with imdma_stream_done() is re-armed right away,
+///          so the hardware always has work queued and nothing is allocated on the hot path.
+///          On a transmit (IMDMA_DIRECTION_TX) channel nothing is started until the user has filled
+///          a buffer: imdma_stream_next() first hands out every unused buffer, then waits for sent ones,
+///          and imdma_stream_done() starts the transfer of a filled buffer (blockBytes long, or the
+///          length given to imdma_transfer_write()).
+/// @param imdma A pointer to the imdma_t returned by imdma_create()
+/// @param depth The number of buffers to keep queued; 0 uses every buffer provided by the driver
+/// @param blockBytes The length of each transfer in bytes; 0 uses the driver buffer size
+/// @note If this function returns non-NULL, the user must call imdma_stream_close() when finished with it
+/// @return imdma_stream_t pointer on success; or NULL on failure
+imdma_stream_t *imdma_stream_open(imdma_t *imdma, unsigned int depth, unsigned int blockBytes);
+
+/// @brief Finish any queued transfers and release every buffer held by the stream
+/// @param stream A pointer to the imdma_stream_t returned by imdma_stream_open()
+/// @note All views must be returned with imdma_stream_done() before calling this function
+void imdma_stream_close(imdma_stream_t *stream);
+
+/// @brief Set the maximum time (milliseconds) imdma_stream_next() waits for a block
+/// @param stream A pointer to the imdma_stream_t returned by imdma_stream_open()
+/// @param timeoutMs The timeout in milliseconds; 0 uses the driver default
+int imdma_stream_set_timeout_ms(imdma_stream_t *stream, unsigned int timeoutMs);
+
+/// @brief Wait for the next block (in order) to complete
+/// @details On a transmit stream the block is a buffer to fill (write it with imdma_transfer_write()).
+///          If every buffer is currently held by the user, this call blocks until
+///          another thread returns one with imdma_stream_done() (at most the stream timeout, if one is set).
+///          Only one thread may call this function at a time.
+/// @param stream A pointer to the imdma_stream_t returned by imdma_stream_open()
+/// @param view Populated with the completed block on success
+/// @return 0 on success; ETIMEDOUT if no buffer was returned in time; the error of the first failed
+///         imdma_stream_done() once every remaining buffer is lost to the stream; or another errno on error
+int imdma_stream_next(imdma_stream_t *stream, imdma_stream_view_t *view);
+
+/// @brief Return a block to the stream so its buffer is re-armed (or, on a transmit stream, sent) immediately
+/// @details This function may be called from any thread.
+/// @param stream A pointer to the imdma_stream_t returned by imdma_stream_open()
+/// @param view The view populated by imdma_stream_next(); its data must not be used afterwards
+/// @return 0 on success; or non-zero (errno) on error (the buffer is then no longer queued by the stream)
+int imdma_stream_done(imdma_stream_t *stream, const imdma_stream_view_t *view);
+
 #endif
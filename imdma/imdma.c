@@ -121,6 +121,7 @@ static long imdma_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
 
 // ioctl implementations
 static long imdma_ioctl_buffer_get_spec(struct imdma_device *device_data, unsigned long arg);
+static long imdma_ioctl_channel_get_direction(struct imdma_device *device_data, unsigned long arg);
 static long imdma_ioctl_buffer_reserve(struct imdma_device *device_data, unsigned long arg);
 static long imdma_ioctl_buffer_release(struct imdma_device *device_data, unsigned long arg);
 static long imdma_ioctl_transfer_start(struct imdma_device *device_data, unsigned long arg);
@@ -295,6 +296,8 @@ static long imdma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	{
 	case IMDMA_BUFFER_GET_SPEC:
 		return imdma_ioctl_buffer_get_spec(device_data, arg);
+	case IMDMA_CHANNEL_GET_DIRECTION:
+		return imdma_ioctl_channel_get_direction(device_data, arg);
 	case IMDMA_BUFFER_RESERVE:
 		return imdma_ioctl_buffer_reserve(device_data, arg);
 	case IMDMA_BUFFER_RELEASE:
@@ -329,6 +332,21 @@ static long imdma_ioctl_buffer_get_spec(struct imdma_device *device_data, unsign
 	return 0;
 }
 
+static long imdma_ioctl_channel_get_direction(struct imdma_device *device_data, unsigned long arg)
+{
+	unsigned int direction = device_data->direction;
+
+	dev_dbg(device_data->device, "imdma_ioctl_channel_get_direction(..., %px)", (void *)arg);
+
+	if (copy_to_user((unsigned int *)arg, &direction, sizeof(direction)))
+	{
+		dev_warn(device_data->device, "copy_to_user failed");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int imdma_buffer_change_state_if(struct imdma_buffer_status *status, enum imdma_buffer_state prev_state,
                                         enum imdma_buffer_state new_state)
 {
@@ -471,8 +489,9 @@ static long imdma_ioctl_transfer_start(struct imdma_device *device_data, unsigne
 	status = &device_data->buffer_statuses[spec.buffer_index];
 
 	spin_lock(&status->buffer_state_spinlock);
-	if (status->buffer_state == IMDMA_BUFFER_RESERVED)
+	if (status->buffer_state == IMDMA_BUFFER_RESERVED || status->buffer_state == IMDMA_BUFFER_DONE)
 	{
+		// A finished buffer may be re-armed directly (no release/reserve round trip required)
 		status->buffer_state = IMDMA_BUFFER_IN_PROGRESS;
 		rc = imdma_transfer_start(device_data, &spec);
 		if (rc)
@@ -65,6 +65,18 @@ struct imdma_buffer_release_spec
 //    size_bytes will be populated with the size of each buffer
 #define IMDMA_BUFFER_GET_SPEC _IOR('a', 'b', struct imdma_buffer_spec *) // get the buffer count, size
 
+// Values returned by IMDMA_CHANNEL_GET_DIRECTION (same as enum dma_transfer_direction)
+#define IMDMA_CHANNEL_DIRECTION_MEM_TO_DEV 1 // host-to-device (MM2S): user space fills the buffers
+#define IMDMA_CHANNEL_DIRECTION_DEV_TO_MEM 2 // device-to-host (S2MM): user space reads the buffers
+
+// Retrieve the direction of the DMA channel (imsar,direction)
+//
+// Return code:
+//    0 on success
+// Argument:
+//    populated with IMDMA_CHANNEL_DIRECTION_MEM_TO_DEV or IMDMA_CHANNEL_DIRECTION_DEV_TO_MEM
+#define IMDMA_CHANNEL_GET_DIRECTION _IOR('a', 'c', unsigned int *)
+
 // #define IMDMA_BUFFER_SET_SPEC _IOW('a', 'd', struct imdma_buffer_spec *) // set the buffer count, size
 
 ///////////////////////////////
@@ -87,6 +99,9 @@ struct imdma_buffer_release_spec
 
 // Start the DMA transfer (non-blocking)
 //
+// The buffer must be reserved (IMDMA_BUFFER_RESERVE) or hold a finished transfer (IMDMA_TRANSFER_FINISH).
+// Starting a finished buffer re-arms it without releasing and reserving it again.
+//
 // Return code:
 //    0 on success
 //    -ENOENT if buffer_index is invalid
@@ -30,14 +30,18 @@
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_irq.h>
 #include <linux/platform_device.h>
 #include <linux/poll.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/version.h>
 #include <linux/wait.h>
 
 #include "imsar-xdma-defs.h"
@@ -69,11 +73,27 @@ static int imsar_xdma_file_release(struct inode *inode, struct file *file);
 static ssize_t imsar_xdma_file_write(struct file *file, const char __user *buf, size_t bytes, loff_t *ppos);
 static ssize_t imsar_xdma_file_read(struct file *file, char __user *buf, size_t bytes, loff_t *off);
 static unsigned int imsar_xdma_file_poll(struct file *file, poll_table *wait);
+static int imsar_xdma_file_mmap(struct file *file, struct vm_area_struct *vma);
 static long imsar_xdma_file_ioctl(struct file *file, unsigned int request, unsigned long arg);
 static long imsar_xdma_ioctl_buffer_get_size(imsar_xdma_channel_t *channel_data, unsigned long arg);
+static long imsar_xdma_ioctl_get_mmap_info(imsar_xdma_channel_t *channel_data, unsigned long arg);
+static long imsar_xdma_ioctl_get_next_transfer(struct file *file, unsigned long arg, int pin);
+static long imsar_xdma_ioctl_release_transfer(struct file *file, unsigned long arg);
+static long imsar_xdma_ioctl_get_tx_buffer(struct file *file, unsigned long arg);
+static long imsar_xdma_ioctl_submit_transfer(struct file *file, unsigned long arg);
+static long imsar_xdma_ioctl_set_read_mode(struct file *file, unsigned long arg);
+static long imsar_xdma_ioctl_get_consumer_stats(struct file *file, unsigned long arg);
 
 // File helpers
 static void imsar_xdma_file_init(imsar_xdma_file_t *file_data, imsar_xdma_channel_t *channel);
+static void imsar_xdma_file_account_read(imsar_xdma_file_t *file_data, unsigned int transfer_id);
+static int imsar_xdma_file_wait_transfer(struct file *file, unsigned int *last_finished_transfer_id);
+static unsigned int imsar_xdma_buffers_bytes(imsar_xdma_channel_t *channel);
+static int imsar_xdma_file_pin(imsar_xdma_file_t *file_data, unsigned int transfer_id);
+static void imsar_xdma_file_unpin_all(imsar_xdma_file_t *file_data);
+static int imsar_xdma_file_wait_tx_space(struct file *file);
+static ssize_t imsar_xdma_file_read_framed(struct file *file, char __user *buf, size_t bytes,
+                                           unsigned int last_finished_transfer_id);
 static ssize_t imsar_xdma_file_copy_transfer(imsar_xdma_channel_t *channel_data, char __user *buf, size_t bytes,
                                              unsigned int requested_transfer_id);
 
@@ -81,6 +101,7 @@ static ssize_t imsar_xdma_file_copy_transfer(imsar_xdma_channel_t *channel_data,
 static int imsar_xdma_channel_consumer_add(imsar_xdma_channel_t *channel, imsar_xdma_file_t *file_data);
 static int imsar_xdma_channel_consumer_remove(imsar_xdma_channel_t *channel, imsar_xdma_file_t *file_data);
 static void imsar_xdma_channel_notify_consumers(imsar_xdma_channel_t *channel);
+static int imsar_xdma_channel_has_consumers(imsar_xdma_channel_t *channel);
 
 // Device character device operations
 static int imsar_xdma_chardev_create(imsar_xdma_dev_t *device_data);
@@ -92,6 +113,20 @@ static void imsar_xdma_channel_chardev_destroy(imsar_xdma_channel_t *channel);
 
 // Transfer operations
 static void imsar_xdma_channel_setup_transfer(imsar_xdma_channel_t *channel, unsigned int transfer_id);
+static imsar_xdma_buffer_meta_t *imsar_xdma_channel_assign_buffer(imsar_xdma_channel_t *channel,
+                                                                  unsigned int transfer_id);
+static unsigned int imsar_xdma_channel_in_flight(imsar_xdma_channel_t *channel);
+static void imsar_xdma_channel_sg_arm(imsar_xdma_channel_t *channel, unsigned int desc_index, unsigned int transfer_id);
+static void imsar_xdma_channel_sg_start(imsar_xdma_channel_t *channel);
+static void imsar_xdma_channel_sg_reap(imsar_xdma_channel_t *channel, u32 status);
+static void imsar_xdma_channel_start_transfers(imsar_xdma_channel_t *channel);
+static void imsar_xdma_device_recover(imsar_xdma_dev_t *device_data);
+static void imsar_xdma_channel_recover_work(struct work_struct *work);
+static void imsar_xdma_channel_setup_tx_transfer(imsar_xdma_channel_t *channel, unsigned int transfer_id);
+static int imsar_xdma_channel_tx_space(imsar_xdma_channel_t *channel);
+static void imsar_xdma_channel_tx_queue(imsar_xdma_channel_t *channel, unsigned int transfer_id, unsigned int length);
+static void imsar_xdma_channel_tx_finish(imsar_xdma_channel_t *channel, unsigned int next_transfer_id);
+static void imsar_xdma_channel_tx_drain(imsar_xdma_channel_t *channel, imsar_xdma_file_t *file_data);
 
 // Channel buffer metadata
 static void imsar_xdma_buffer_meta_init(imsar_xdma_buffer_meta_t *data, unsigned int buffer_size,
@@ -155,6 +190,7 @@ static struct file_operations imsar_xdma_fops = {
     .read = imsar_xdma_file_read,
     .poll = imsar_xdma_file_poll,
     .llseek = noop_llseek,
+    .mmap = imsar_xdma_file_mmap,
     .unlocked_ioctl = imsar_xdma_file_ioctl,
 };
 
@@ -328,16 +364,30 @@ static int imsar_xdma_file_open(struct inode *inode, struct file *file)
 	}
 	file->private_data = file_data;
 
+	file_data->pin_counts = kcalloc(channel_data->buffer_count, sizeof(unsigned int), GFP_KERNEL);
+	if (file_data->pin_counts == NULL)
+	{
+		kfree(file_data);
+		return -ENOMEM;
+	}
+
 	imsar_xdma_file_init(file_data, channel_data);
 
+	mutex_lock(&xdma_device->control_mutex);
 	is_first_consumer = imsar_xdma_channel_consumer_add(channel_data, file_data);
 	if (is_first_consumer)
 	{
-		imsar_xdma_chan_irq_ack(channel_data); // clear any pending IRQs
-		imsar_xdma_chan_start(channel_data);
-		imsar_xdma_channel_setup_transfer(channel_data, channel_data->in_progress_transfer_id);
-		imsar_xdma_chan_irq_enable(channel_data);
+		// The descriptor ring may only be rebuilt once the channel has halted (cleanly: errors need a reset)
+		if (channel_data->sg_depth > 0 && imsar_xdma_chan_wait_halted(channel_data) != 0)
+		{
+			imsar_xdma_device_recover(xdma_device); // starts this channel too
+		}
+		else
+		{
+			imsar_xdma_channel_start_transfers(channel_data);
+		}
 	}
+	mutex_unlock(&xdma_device->control_mutex);
 
 	return 0;
 }
@@ -351,21 +401,114 @@ static int imsar_xdma_file_release(struct inode *inode, struct file *file)
 	file_data = (imsar_xdma_file_t *)file->private_data;
 	channel_data = file_data->channel;
 
+	if (channel_data->direction == IMSAR_XDMA_DIR_MM2S)
+	{
+		mutex_lock(&channel_data->tx_mutex);
+		if (channel_data->tx_reserved_file == file_data)
+		{
+			channel_data->tx_reserved_file = NULL;
+		}
+		mutex_unlock(&channel_data->tx_mutex);
+
+		imsar_xdma_channel_tx_drain(channel_data, file_data);
+	}
+
+	mutex_lock(&channel_data->xdma_device->control_mutex);
 	was_last_consumer = imsar_xdma_channel_consumer_remove(channel_data, file_data);
 	if (was_last_consumer)
 	{
 		imsar_xdma_chan_stop(channel_data);
 		imsar_xdma_chan_irq_disable(channel_data);
+		if (channel_data->direction == IMSAR_XDMA_DIR_MM2S)
+		{
+			imsar_xdma_channel_tx_finish(channel_data, 0); // discard anything left in the queue
+		}
 	}
+	mutex_unlock(&channel_data->xdma_device->control_mutex);
 
+	imsar_xdma_file_unpin_all(file_data);
+	kfree(file_data->pin_counts);
 	kfree(file_data);
 
 	return 0;
 }
 
+// Queue one transfer (of up to buffer_size_bytes) on a transmit channel
 static ssize_t imsar_xdma_file_write(struct file *file, const char __user *buf, size_t bytes, loff_t *ppos)
 {
-	return -EPERM;
+	int status;
+	imsar_xdma_file_t *file_data;
+	imsar_xdma_channel_t *channel_data;
+	imsar_xdma_buffer_meta_t *buffer_info;
+	unsigned int transfer_id;
+	unsigned int length;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+	channel_data = file_data->channel;
+
+	if (channel_data->direction != IMSAR_XDMA_DIR_MM2S)
+	{
+		return -EPERM;
+	}
+	if (bytes == 0)
+	{
+		return 0;
+	}
+	length = (bytes > channel_data->buffer_size_bytes) ? channel_data->buffer_size_bytes : bytes;
+
+	if (mutex_lock_interruptible(&channel_data->tx_mutex))
+	{
+		return -ERESTARTSYS;
+	}
+
+	// The next buffer may be reserved by another file filling it in place
+	if (channel_data->tx_reserved_file && channel_data->tx_reserved_file != file_data)
+	{
+		mutex_unlock(&channel_data->tx_mutex);
+		return -EBUSY;
+	}
+
+	status = imsar_xdma_file_wait_tx_space(file);
+	if (status < 0)
+	{
+		mutex_unlock(&channel_data->tx_mutex);
+		return status;
+	}
+
+	transfer_id = channel_data->queued_transfer_id + 1;
+	buffer_info = imsar_xdma_buffer_meta(channel_data, transfer_id);
+	if (copy_from_user(channel_data->buffer_virt_addr + buffer_info->offset, buf, length))
+	{
+		mutex_unlock(&channel_data->tx_mutex);
+		dev_dbg(channel_data->xdma_device->device, "%s: copy_from_user failed", channel_data->name);
+		return -EFAULT;
+	}
+
+	imsar_xdma_channel_tx_queue(channel_data, transfer_id, length);
+	channel_data->tx_reserved_file = NULL;
+	mutex_unlock(&channel_data->tx_mutex);
+
+	return length;
+}
+
+// Wait for a free transmit buffer (or return if non-blocking)
+static int imsar_xdma_file_wait_tx_space(struct file *file)
+{
+	imsar_xdma_file_t *file_data;
+	imsar_xdma_channel_t *channel_data;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+	channel_data = file_data->channel;
+
+	if (imsar_xdma_channel_tx_space(channel_data))
+	{
+		return 0;
+	}
+	if (file->f_flags & O_NONBLOCK)
+	{
+		return -EAGAIN;
+	}
+	return wait_event_interruptible(file_data->file_waitqueue, imsar_xdma_channel_tx_space(channel_data));
 }
 
 static ssize_t imsar_xdma_file_copy_transfer(imsar_xdma_channel_t *channel_data, char __user *buf, size_t bytes,
@@ -410,12 +553,14 @@ static ssize_t imsar_xdma_file_copy_transfer(imsar_xdma_channel_t *channel_data,
 	return actual_bytes;
 }
 
-static ssize_t imsar_xdma_file_read(struct file *file, char __user *buf, size_t bytes, loff_t *off)
+// Wait for a transfer this file has not read yet (or return if non-blocking), and skip ahead if the file has
+// fallen so far behind that its next transfer may already be overwritten
+static int imsar_xdma_file_wait_transfer(struct file *file, unsigned int *last_finished_transfer_id)
 {
 	int status;
 	imsar_xdma_file_t *file_data;
 	imsar_xdma_channel_t *channel_data;
-	unsigned int last_finished_transfer_id, desired_transfer_id;
+	unsigned int history;
 
 	file_data = (imsar_xdma_file_t *)file->private_data;
 	channel_data = file_data->channel;
@@ -439,13 +584,45 @@ static ssize_t imsar_xdma_file_read(struct file *file, char __user *buf, size_t
 	}
 
 	// Read the most recent transfer ID
-	last_finished_transfer_id = channel_data->last_finished_transfer_id;
+	*last_finished_transfer_id = channel_data->last_finished_transfer_id;
 
-	if (file_data->last_read_transfer_id + channel_data->buffer_count - 1 <= last_finished_transfer_id)
+	// Buffers the hardware holds for upcoming transfers no longer hold old ones
+	history = channel_data->buffer_count - imsar_xdma_channel_in_flight(channel_data) + 1;
+	if (file_data->last_read_transfer_id + history - 1 <= *last_finished_transfer_id)
 	{
 		dev_dbg(channel_data->xdma_device->device, "%s: file transfer ID is too far behind; fast-forwarding\n",
 		        channel_data->name);
-		file_data->last_read_transfer_id = last_finished_transfer_id - channel_data->buffer_count + 2;
+		file_data->transfers_skipped += *last_finished_transfer_id - history + 2 - file_data->last_read_transfer_id;
+		file_data->last_read_transfer_id = *last_finished_transfer_id - history + 2;
+	}
+
+	return 0;
+}
+
+static ssize_t imsar_xdma_file_read(struct file *file, char __user *buf, size_t bytes, loff_t *off)
+{
+	int status;
+	imsar_xdma_file_t *file_data;
+	imsar_xdma_channel_t *channel_data;
+	unsigned int last_finished_transfer_id, desired_transfer_id;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+	channel_data = file_data->channel;
+
+	if (channel_data->direction == IMSAR_XDMA_DIR_MM2S)
+	{
+		return -EPERM;
+	}
+
+	status = imsar_xdma_file_wait_transfer(file, &last_finished_transfer_id);
+	if (status < 0)
+	{
+		return status;
+	}
+
+	if (file_data->read_mode == IMSAR_XDMA_READ_MODE_FRAMED)
+	{
+		return imsar_xdma_file_read_framed(file, buf, bytes, last_finished_transfer_id);
 	}
 
 	desired_transfer_id = file_data->last_read_transfer_id + 1;
@@ -455,7 +632,7 @@ static ssize_t imsar_xdma_file_read(struct file *file, char __user *buf, size_t
 		status = imsar_xdma_file_copy_transfer(channel_data, buf, bytes, desired_transfer_id);
 		if (status >= 0)
 		{ // Successful read (or error during copy_to_user)
-			file_data->last_read_transfer_id = desired_transfer_id;
+			imsar_xdma_file_account_read(file_data, desired_transfer_id);
 			return status;
 		}
 
@@ -472,6 +649,71 @@ static ssize_t imsar_xdma_file_read(struct file *file, char __user *buf, size_t
 	return -EIO;
 }
 
+// Copy as many whole completed transfers as fit, each after a frame header (the first is truncated if needed)
+static ssize_t imsar_xdma_file_read_framed(struct file *file, char __user *buf, size_t bytes,
+                                           unsigned int last_finished_transfer_id)
+{
+	ssize_t status;
+	imsar_xdma_file_t *file_data;
+	imsar_xdma_channel_t *channel_data;
+	imsar_xdma_buffer_meta_t *buffer_info;
+	struct imsar_xdma_frame_header header;
+	unsigned int desired_transfer_id;
+	size_t total_bytes, space_bytes;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+	channel_data = file_data->channel;
+
+	if (bytes <= sizeof(header))
+	{
+		return -EINVAL;
+	}
+
+	total_bytes = 0;
+	for (desired_transfer_id = file_data->last_read_transfer_id + 1;
+	     desired_transfer_id <= last_finished_transfer_id && total_bytes + sizeof(header) < bytes;
+	     desired_transfer_id++)
+	{
+		space_bytes = bytes - total_bytes - sizeof(header);
+		buffer_info = imsar_xdma_buffer_meta(channel_data, desired_transfer_id);
+		header.transfer_id = desired_transfer_id;
+		header.timestamp_ns = buffer_info->timestamp_ns;
+		if (total_bytes > 0 && buffer_info->length > space_bytes)
+		{
+			break; // only whole transfers after the first
+		}
+
+		// The copy re-checks the transfer ID afterwards, so the timestamp read before it is consistent
+		status = imsar_xdma_file_copy_transfer(channel_data, buf + total_bytes + sizeof(header), space_bytes,
+		                                       desired_transfer_id);
+		if (status == -EFAULT)
+		{
+			return total_bytes > 0 ? total_bytes : status;
+		}
+		if (status < 0)
+		{
+			continue; // overwritten; try the next transfer
+		}
+
+		header.length = status;
+		if (copy_to_user(buf + total_bytes, &header, sizeof(header)))
+		{
+			return total_bytes > 0 ? total_bytes : -EFAULT;
+		}
+
+		imsar_xdma_file_account_read(file_data, desired_transfer_id);
+		total_bytes = min_t(size_t, ALIGN(total_bytes + sizeof(header) + header.length, 8), bytes);
+	}
+
+	if (total_bytes == 0)
+	{
+		dev_warn(channel_data->xdma_device->device, "%s: no buffers were available\n", channel_data->name);
+		return -EIO;
+	}
+
+	return total_bytes;
+}
+
 static unsigned int imsar_xdma_file_poll(struct file *file, poll_table *wait)
 {
 	imsar_xdma_file_t *file_data;
@@ -480,6 +722,16 @@ static unsigned int imsar_xdma_file_poll(struct file *file, poll_table *wait)
 	file_data = (imsar_xdma_file_t *)file->private_data;
 	channel_data = file_data->channel;
 
+	if (channel_data->direction == IMSAR_XDMA_DIR_MM2S)
+	{
+		if (!imsar_xdma_channel_tx_space(channel_data))
+		{
+			poll_wait(file, &file_data->file_waitqueue, wait);
+			return 0;
+		}
+		return (POLLOUT | POLLWRNORM);
+	}
+
 	if (channel_data->last_finished_transfer_id == file_data->last_read_transfer_id)
 	{
 		// NOTE: this is NOT a blocking call -- this function (imsar_xdma_file_poll)
@@ -505,21 +757,438 @@ static long imsar_xdma_file_ioctl(struct file *file, unsigned int request, unsig
 	{
 	case IMSAR_XDMA_IOCTL_GET_BUFFER_SIZE:
 		return imsar_xdma_ioctl_buffer_get_size(channel_data, arg);
+	case IMSAR_XDMA_IOCTL_GET_MMAP_INFO:
+		return imsar_xdma_ioctl_get_mmap_info(channel_data, arg);
+	case IMSAR_XDMA_IOCTL_GET_NEXT_TRANSFER:
+		return imsar_xdma_ioctl_get_next_transfer(file, arg, false);
+	case IMSAR_XDMA_IOCTL_ACQUIRE_TRANSFER:
+		return imsar_xdma_ioctl_get_next_transfer(file, arg, true);
+	case IMSAR_XDMA_IOCTL_RELEASE_TRANSFER:
+		return imsar_xdma_ioctl_release_transfer(file, arg);
+	case IMSAR_XDMA_IOCTL_GET_TX_BUFFER:
+		return imsar_xdma_ioctl_get_tx_buffer(file, arg);
+	case IMSAR_XDMA_IOCTL_SUBMIT_TRANSFER:
+		return imsar_xdma_ioctl_submit_transfer(file, arg);
+	case IMSAR_XDMA_IOCTL_SET_READ_MODE:
+		return imsar_xdma_ioctl_set_read_mode(file, arg);
+	case IMSAR_XDMA_IOCTL_GET_CONSUMER_STATS:
+		return imsar_xdma_ioctl_get_consumer_stats(file, arg);
 	default:
 		dev_warn(channel_data->xdma_device->device, "unrecognized ioctl cmd: %u", request);
 		return -EINVAL;
 	}
 }
 
-static long imsar_xdma_ioctl_buffer_get_size(imsar_xdma_channel_t *channel_data, unsigned long arg)
+static long imsar_xdma_ioctl_buffer_get_size(imsar_xdma_channel_t *channel_data, unsigned long arg)
+{
+	if (copy_to_user((unsigned int *)arg, &(channel_data->buffer_size_bytes), sizeof(unsigned int)))
+	{
+		dev_warn(channel_data->xdma_device->device, "copy_to_user failed");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static long imsar_xdma_ioctl_get_mmap_info(imsar_xdma_channel_t *channel_data, unsigned long arg)
+{
+	struct imsar_xdma_mmap_info info;
+
+	info.buffer_count = channel_data->buffer_count;
+	info.buffer_size_bytes = channel_data->buffer_size_bytes;
+	info.buffers_bytes = imsar_xdma_buffers_bytes(channel_data);
+	info.status_offset = info.buffers_bytes;
+
+	if (copy_to_user((struct imsar_xdma_mmap_info *)arg, &info, sizeof(info)))
+	{
+		dev_warn(channel_data->xdma_device->device, "copy_to_user failed");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+// Hand out the next completed transfer in place (the zero-copy equivalent of read()), optionally pinning it
+static long imsar_xdma_ioctl_get_next_transfer(struct file *file, unsigned long arg, int pin)
+{
+	int status;
+	imsar_xdma_file_t *file_data;
+	imsar_xdma_channel_t *channel_data;
+	imsar_xdma_buffer_meta_t *buffer_info;
+	struct imsar_xdma_transfer_info info;
+	unsigned int last_finished_transfer_id, desired_transfer_id;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+	channel_data = file_data->channel;
+
+	if (channel_data->direction == IMSAR_XDMA_DIR_MM2S)
+	{
+		return -EPERM;
+	}
+
+	status = imsar_xdma_file_wait_transfer(file, &last_finished_transfer_id);
+	if (status < 0)
+	{
+		return status;
+	}
+
+	// Skip transfers whose buffer has already been reused (same as read())
+	for (desired_transfer_id = file_data->last_read_transfer_id + 1; desired_transfer_id <= last_finished_transfer_id;
+	     desired_transfer_id++)
+	{
+		buffer_info = imsar_xdma_buffer_meta(channel_data, desired_transfer_id);
+		info.transfer_id = desired_transfer_id;
+		info.offset = buffer_info->offset;
+		info.length = buffer_info->length;
+		if (pin)
+		{
+			status = imsar_xdma_file_pin(file_data, desired_transfer_id);
+			if (status == -EBUSY)
+			{
+				return status;
+			}
+		}
+		else
+		{
+			status = (buffer_info->transfer_id == desired_transfer_id) ? 0 : -EINVAL;
+		}
+
+		if (status == 0)
+		{
+			imsar_xdma_file_account_read(file_data, desired_transfer_id);
+			if (copy_to_user((struct imsar_xdma_transfer_info *)arg, &info, sizeof(info)))
+			{
+				dev_dbg(channel_data->xdma_device->device, "%s: copy_to_user failed", channel_data->name);
+				return -EFAULT;
+			}
+			return 0;
+		}
+	}
+
+	dev_warn(channel_data->xdma_device->device, "%s: no buffers were available\n", channel_data->name);
+	return -EIO;
+}
+
+static long imsar_xdma_ioctl_release_transfer(struct file *file, unsigned long arg)
+{
+	imsar_xdma_file_t *file_data;
+	imsar_xdma_channel_t *channel_data;
+	imsar_xdma_buffer_meta_t *buffer_info;
+	unsigned int transfer_id;
+	unsigned long flags;
+	unsigned int i;
+	long rc;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+	channel_data = file_data->channel;
+
+	if (get_user(transfer_id, (unsigned int *)arg))
+	{
+		return -EFAULT;
+	}
+
+	// The transfer may no longer be the latest one using its ID slot, so look for the buffer this file pinned
+	rc = -EINVAL;
+	spin_lock_irqsave(&channel_data->buffers_spinlock, flags);
+	for (i = 0; i < channel_data->buffer_count; i++)
+	{
+		buffer_info = &channel_data->buffer_metadata[i];
+		if (buffer_info->transfer_id == transfer_id && file_data->pin_counts[i] > 0)
+		{
+			file_data->pin_counts[i]--;
+			buffer_info->pin_count--;
+			if (buffer_info->pin_count == 0)
+			{
+				channel_data->pinned_buffer_count--;
+			}
+			rc = 0;
+			break;
+		}
+	}
+	spin_unlock_irqrestore(&channel_data->buffers_spinlock, flags);
+
+	if (rc)
+	{
+		dev_dbg(channel_data->xdma_device->device, "%s: transfer %u is not pinned by this file\n", channel_data->name,
+		        transfer_id);
+	}
+
+	return rc;
+}
+
+// Wait for a free transmit buffer, reserve it for this file and return where to fill it
+// (IMSAR_XDMA_IOCTL_SUBMIT_TRANSFER queues it)
+static long imsar_xdma_ioctl_get_tx_buffer(struct file *file, unsigned long arg)
+{
+	int status;
+	imsar_xdma_file_t *file_data;
+	imsar_xdma_channel_t *channel_data;
+	struct imsar_xdma_transfer_info info;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+	channel_data = file_data->channel;
+
+	if (channel_data->direction != IMSAR_XDMA_DIR_MM2S)
+	{
+		return -EPERM;
+	}
+
+	if (mutex_lock_interruptible(&channel_data->tx_mutex))
+	{
+		return -ERESTARTSYS;
+	}
+
+	if (channel_data->tx_reserved_file && channel_data->tx_reserved_file != file_data)
+	{
+		mutex_unlock(&channel_data->tx_mutex);
+		return -EBUSY;
+	}
+
+	status = imsar_xdma_file_wait_tx_space(file);
+	if (status < 0)
+	{
+		mutex_unlock(&channel_data->tx_mutex);
+		return status;
+	}
+
+	// Nothing else can be queued until this file submits the buffer (or closes)
+	channel_data->tx_reserved_file = file_data;
+	info.transfer_id = channel_data->queued_transfer_id + 1;
+	info.offset = imsar_xdma_buffer_meta(channel_data, info.transfer_id)->offset;
+	info.length = channel_data->buffer_size_bytes;
+	mutex_unlock(&channel_data->tx_mutex);
+
+	if (copy_to_user((struct imsar_xdma_transfer_info *)arg, &info, sizeof(info)))
+	{
+		dev_dbg(channel_data->xdma_device->device, "%s: copy_to_user failed", channel_data->name);
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+static long imsar_xdma_ioctl_submit_transfer(struct file *file, unsigned long arg)
+{
+	imsar_xdma_file_t *file_data;
+	imsar_xdma_channel_t *channel_data;
+	struct imsar_xdma_transfer_info info;
+	long rc;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+	channel_data = file_data->channel;
+
+	if (channel_data->direction != IMSAR_XDMA_DIR_MM2S)
+	{
+		return -EPERM;
+	}
+
+	if (copy_from_user(&info, (struct imsar_xdma_transfer_info *)arg, sizeof(info)))
+	{
+		return -EFAULT;
+	}
+
+	if (info.length == 0 || info.length > channel_data->buffer_size_bytes)
+	{
+		return -EINVAL;
+	}
+
+	if (mutex_lock_interruptible(&channel_data->tx_mutex))
+	{
+		return -ERESTARTSYS;
+	}
+
+	// The buffer must be the one IMSAR_XDMA_IOCTL_GET_TX_BUFFER reserved for this file
+	rc = 0;
+	if (channel_data->tx_reserved_file != file_data || info.transfer_id != channel_data->queued_transfer_id + 1)
+	{
+		dev_dbg(channel_data->xdma_device->device, "%s: stale transmit transfer %u\n", channel_data->name,
+		        info.transfer_id);
+		rc = -EINVAL;
+	}
+	else
+	{
+		imsar_xdma_channel_tx_queue(channel_data, info.transfer_id, info.length);
+		channel_data->tx_reserved_file = NULL;
+	}
+
+	mutex_unlock(&channel_data->tx_mutex);
+	return rc;
+}
+
+static long imsar_xdma_ioctl_set_read_mode(struct file *file, unsigned long arg)
+{
+	imsar_xdma_file_t *file_data;
+	unsigned int read_mode;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+
+	if (get_user(read_mode, (unsigned int *)arg))
+	{
+		return -EFAULT;
+	}
+
+	if (read_mode != IMSAR_XDMA_READ_MODE_TRANSFER && read_mode != IMSAR_XDMA_READ_MODE_FRAMED)
+	{
+		return -EINVAL;
+	}
+
+	file_data->read_mode = read_mode;
+	return 0;
+}
+
+static long imsar_xdma_ioctl_get_consumer_stats(struct file *file, unsigned long arg)
+{
+	imsar_xdma_file_t *file_data;
+	imsar_xdma_channel_t *channel_data;
+	struct imsar_xdma_consumer_stats stats;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+	channel_data = file_data->channel;
+
+	stats.transfers_read = file_data->transfers_read;
+	stats.transfers_skipped = file_data->transfers_skipped;
+	stats.max_lag = file_data->max_lag;
+	stats.lag = channel_data->last_finished_transfer_id - file_data->last_read_transfer_id;
+
+	if (copy_to_user((struct imsar_xdma_consumer_stats *)arg, &stats, sizeof(stats)))
+	{
+		dev_dbg(channel_data->xdma_device->device, "%s: copy_to_user failed", channel_data->name);
+		return -EFAULT;
+	}
+
+	return 0;
+}
+
+// Pin the buffer of a completed transfer, unless it has been reused (EINVAL) or too few buffers would be left
+// for the hardware (EBUSY)
+static int imsar_xdma_file_pin(imsar_xdma_file_t *file_data, unsigned int transfer_id)
+{
+	imsar_xdma_channel_t *channel;
+	imsar_xdma_buffer_meta_t *buffer_info;
+	unsigned int buffer_index;
+	unsigned long flags;
+	int rc;
+
+	channel = file_data->channel;
+
+	spin_lock_irqsave(&channel->buffers_spinlock, flags);
+	buffer_index = channel->transfer_buffer_index[transfer_id % channel->buffer_count];
+	buffer_info = &channel->buffer_metadata[buffer_index];
+	if (buffer_info->transfer_id != transfer_id)
+	{
+		rc = -EINVAL;
+	}
+	else if (buffer_info->pin_count == 0 &&
+	         channel->pinned_buffer_count + imsar_xdma_channel_in_flight(channel) + 1 > channel->buffer_count)
+	{
+		rc = -EBUSY;
+	}
+	else
+	{
+		if (buffer_info->pin_count == 0)
+		{
+			channel->pinned_buffer_count++;
+		}
+		buffer_info->pin_count++;
+		file_data->pin_counts[buffer_index]++;
+		rc = 0;
+	}
+	spin_unlock_irqrestore(&channel->buffers_spinlock, flags);
+
+	return rc;
+}
+
+static void imsar_xdma_file_unpin_all(imsar_xdma_file_t *file_data)
+{
+	imsar_xdma_channel_t *channel;
+	imsar_xdma_buffer_meta_t *buffer_info;
+	unsigned long flags;
+	unsigned int i;
+
+	channel = file_data->channel;
+
+	spin_lock_irqsave(&channel->buffers_spinlock, flags);
+	for (i = 0; i < channel->buffer_count; i++)
+	{
+		if (file_data->pin_counts[i] == 0)
+		{
+			continue;
+		}
+		buffer_info = &channel->buffer_metadata[i];
+		buffer_info->pin_count -= file_data->pin_counts[i];
+		file_data->pin_counts[i] = 0;
+		if (buffer_info->pin_count == 0)
+		{
+			channel->pinned_buffer_count--;
+		}
+	}
+	spin_unlock_irqrestore(&channel->buffers_spinlock, flags);
+}
+
+// Keep a read-only mapping from being made writable with mprotect (vm_flags is read-only from 6.3)
+static void imsar_xdma_vma_clear_maywrite(struct vm_area_struct *vma)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+}
+
+// Map the buffers (at offset 0, or a part of them) or the status page (at the offset after the buffers)
+// The status page is read-only, and so are receive buffers (the hardware owns them); transmit buffers are
+// filled by user space
+static int imsar_xdma_file_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	imsar_xdma_file_t *file_data;
+	imsar_xdma_channel_t *channel_data;
+	unsigned long size;
+	unsigned int buffers_bytes;
+
+	file_data = (imsar_xdma_file_t *)file->private_data;
+	channel_data = file_data->channel;
+	size = vma->vm_end - vma->vm_start;
+	buffers_bytes = imsar_xdma_buffers_bytes(channel_data);
+
+	if (vma->vm_pgoff == (buffers_bytes >> PAGE_SHIFT) && size == PAGE_SIZE)
+	{
+		if (vma->vm_flags & VM_WRITE)
+		{
+			return -EPERM;
+		}
+		imsar_xdma_vma_clear_maywrite(vma);
+		return remap_pfn_range(vma, vma->vm_start, virt_to_phys(channel_data->status_page) >> PAGE_SHIFT, PAGE_SIZE,
+		                       vma->vm_page_prot);
+	}
+
+	if (vma->vm_pgoff != 0 || size > buffers_bytes)
+	{
+		dev_dbg(channel_data->xdma_device->device, "%s: invalid mmap range (offset %lu pages, %lu bytes)\n",
+		        channel_data->name, vma->vm_pgoff, size);
+		return -EINVAL;
+	}
+
+	if (channel_data->direction != IMSAR_XDMA_DIR_MM2S)
+	{
+		if (vma->vm_flags & VM_WRITE)
+		{
+			return -EPERM;
+		}
+		imsar_xdma_vma_clear_maywrite(vma);
+	}
+
+	return dma_mmap_coherent(channel_data->xdma_device->device, // dev
+	                         vma,                               // vma
+	                         channel_data->buffer_virt_addr,    // cpu_addr
+	                         channel_data->buffer_bus_addr,     // handle
+	                         size                               // size
+	);
+}
+
+// Size of the buffer mapping (the buffers, rounded up to whole pages)
+static unsigned int imsar_xdma_buffers_bytes(imsar_xdma_channel_t *channel)
 {
-	if (copy_to_user((unsigned int *)arg, &(channel_data->buffer_size_bytes), sizeof(unsigned int)))
-	{
-		dev_warn(channel_data->xdma_device->device, "copy_to_user failed");
-		return -EINVAL;
-	}
-
-	return 0;
+	return PAGE_ALIGN(channel->buffer_size_bytes * channel->buffer_count);
 }
 
 static void imsar_xdma_file_init(imsar_xdma_file_t *file_data, imsar_xdma_channel_t *channel)
@@ -528,6 +1197,22 @@ static void imsar_xdma_file_init(imsar_xdma_file_t *file_data, imsar_xdma_channe
 	file_data->last_read_transfer_id = channel->last_finished_transfer_id;
 	init_waitqueue_head(&file_data->file_waitqueue);
 	INIT_LIST_HEAD(&file_data->list);
+	file_data->pid = task_tgid_nr(current);
+	get_task_comm(file_data->comm, current);
+}
+
+// Record that the file got a transfer (any transfers before it that it never got were overwritten)
+static void imsar_xdma_file_account_read(imsar_xdma_file_t *file_data, unsigned int transfer_id)
+{
+	unsigned int lag = file_data->channel->last_finished_transfer_id - transfer_id;
+
+	file_data->transfers_read++;
+	file_data->transfers_skipped += transfer_id - file_data->last_read_transfer_id - 1;
+	if (lag > file_data->max_lag)
+	{
+		file_data->max_lag = lag;
+	}
+	file_data->last_read_transfer_id = transfer_id;
 }
 
 static int imsar_xdma_channel_consumer_add(imsar_xdma_channel_t *channel, imsar_xdma_file_t *file_data)
@@ -552,6 +1237,17 @@ static int imsar_xdma_channel_consumer_remove(imsar_xdma_channel_t *channel, ims
 	return list_is_now_empty;
 }
 
+static int imsar_xdma_channel_has_consumers(imsar_xdma_channel_t *channel)
+{
+	unsigned long flags;
+	int has_consumers;
+
+	spin_lock_irqsave(&channel->consumers_spinlock, flags);
+	has_consumers = !list_empty(&channel->consuming_files);
+	spin_unlock_irqrestore(&channel->consumers_spinlock, flags);
+	return has_consumers;
+}
+
 static void imsar_xdma_channel_notify_consumers(imsar_xdma_channel_t *channel)
 {
 	unsigned long flags;
@@ -633,21 +1329,390 @@ static void imsar_xdma_channel_chardev_destroy(imsar_xdma_channel_t *channel)
 
 static void imsar_xdma_channel_setup_transfer(imsar_xdma_channel_t *channel, unsigned int transfer_id)
 {
-	imsar_xdma_buffer_meta_t *buffer_metadata = imsar_xdma_buffer_meta(channel, transfer_id);
+	imsar_xdma_buffer_meta_t *buffer_metadata;
+	unsigned int buffer_index;
+	unsigned long flags;
+
+	spin_lock_irqsave(&channel->buffers_spinlock, flags);
+
+	// A restarted transfer reuses its buffer
+	if (transfer_id != channel->in_progress_transfer_id)
+	{
+		buffer_metadata = imsar_xdma_channel_assign_buffer(channel, transfer_id);
+	}
+	else
+	{
+		buffer_metadata = &channel->buffer_metadata[channel->in_progress_buffer_index];
+		buffer_metadata->transfer_id = transfer_id;
+		buffer_metadata->length = 0;
+		channel->transfer_buffer_index[transfer_id % channel->buffer_count] = channel->in_progress_buffer_index;
+		WRITE_ONCE(channel->status_page->buffer_transfer_id[channel->in_progress_buffer_index], transfer_id);
+	}
+	buffer_index = channel->in_progress_buffer_index;
+
+	spin_unlock_irqrestore(&channel->buffers_spinlock, flags);
 
 	if (channel->log_transfer_events)
 	{
-		dev_dbg(channel->xdma_device->device, "%s: setup transfer %u (len %u)\n", channel->name, transfer_id,
-		        channel->buffer_size_bytes);
+		dev_dbg(channel->xdma_device->device, "%s: setup transfer %u in buffer %u (len %u)\n", channel->name,
+		        transfer_id, buffer_index, channel->buffer_size_bytes);
+	}
+
+	// Zero-copy readers must see the buffer as taken before the hardware starts writing it
+	WRITE_ONCE(channel->status_page->in_progress_transfer_id, transfer_id);
+	wmb();
+
+	imsar_xdma_chan_set_addr_and_len(channel, channel->buffer_bus_addr + buffer_metadata->offset,
+	                                 channel->buffer_size_bytes);
+
+	channel->in_progress_transfer_id = transfer_id;
+}
+
+// Give a new receive transfer the next buffer that is not pinned
+// Note: buffers_spinlock must be held
+static imsar_xdma_buffer_meta_t *imsar_xdma_channel_assign_buffer(imsar_xdma_channel_t *channel,
+                                                                  unsigned int transfer_id)
+{
+	imsar_xdma_buffer_meta_t *buffer_metadata;
+	unsigned int buffer_index;
+
+	buffer_index = (channel->in_progress_buffer_index + 1) % channel->buffer_count;
+	while (channel->buffer_metadata[buffer_index].pin_count > 0)
+	{
+		channel->pinned_skip_count++;
+		buffer_index = (buffer_index + 1) % channel->buffer_count;
 	}
 
+	buffer_metadata = &channel->buffer_metadata[buffer_index];
 	buffer_metadata->transfer_id = transfer_id;
 	buffer_metadata->length = 0;
+	channel->transfer_buffer_index[transfer_id % channel->buffer_count] = buffer_index;
+	channel->in_progress_buffer_index = buffer_index;
+
+	// Zero-copy readers (of any file, pinned or not) check this after using the buffer
+	WRITE_ONCE(channel->status_page->buffer_transfer_id[buffer_index], transfer_id);
+
+	return buffer_metadata;
+}
+
+// Buffers the hardware may be writing (or is about to)
+static unsigned int imsar_xdma_channel_in_flight(imsar_xdma_channel_t *channel)
+{
+	return channel->sg_depth > 0 ? channel->sg_depth : 1;
+}
+
+// Point a scatter-gather descriptor at a buffer for a new transfer
+// Note: buffers_spinlock must be held
+static void imsar_xdma_channel_sg_arm(imsar_xdma_channel_t *channel, unsigned int desc_index, unsigned int transfer_id)
+{
+	imsar_xdma_sg_desc_t *desc = &channel->sg_descs[desc_index];
+	imsar_xdma_buffer_meta_t *buffer_metadata = imsar_xdma_channel_assign_buffer(channel, transfer_id);
+	dma_addr_t buffer_bus_addr = channel->buffer_bus_addr + buffer_metadata->offset;
+
+	// Zero-copy readers must see the buffer as taken before the hardware can write it
+	WRITE_ONCE(channel->status_page->in_progress_transfer_id, transfer_id);
+
+	desc->buffer_address = lower_32_bits(buffer_bus_addr);
+	desc->buffer_address_msb = upper_32_bits(buffer_bus_addr);
+	desc->control = channel->buffer_size_bytes;
+	desc->status = 0;
+
+	channel->in_progress_transfer_id = transfer_id;
+}
+
+// (Re)build the descriptor ring from the transfer after the last finished one and start the hardware on it
+static void imsar_xdma_channel_sg_start(imsar_xdma_channel_t *channel)
+{
+	unsigned int i;
+	unsigned long flags;
+	dma_addr_t next_bus_addr;
+
+	spin_lock_irqsave(&channel->buffers_spinlock, flags);
+	for (i = 0; i < channel->sg_depth; i++)
+	{
+		next_bus_addr = channel->sg_descs_bus_addr + ((i + 1) % channel->sg_depth) * sizeof(imsar_xdma_sg_desc_t);
+		memset(&channel->sg_descs[i], 0, sizeof(imsar_xdma_sg_desc_t));
+		channel->sg_descs[i].next_desc = lower_32_bits(next_bus_addr);
+		channel->sg_descs[i].next_desc_msb = upper_32_bits(next_bus_addr);
+		imsar_xdma_channel_sg_arm(channel, i, channel->last_finished_transfer_id + 1 + i);
+	}
+	channel->sg_reap_index = 0;
+	spin_unlock_irqrestore(&channel->buffers_spinlock, flags);
+
+	if (channel->log_transfer_events)
+	{
+		dev_dbg(channel->xdma_device->device, "%s: start descriptor ring at transfer %u (%u descriptors)\n",
+		        channel->name, channel->last_finished_transfer_id + 1, channel->sg_depth);
+	}
+
+	wmb();
+	imsar_xdma_chan_set_curdesc(channel, channel->sg_descs_bus_addr);
+	imsar_xdma_chan_start(channel);
+	imsar_xdma_chan_set_taildesc(channel, channel->sg_descs_bus_addr +
+	                                          (channel->sg_depth - 1) * sizeof(imsar_xdma_sg_desc_t));
+}
+
+// Finish every completed descriptor (one interrupt may cover several) and queue each one again at the tail,
+// so the hardware keeps running without waiting for the interrupt
+static void imsar_xdma_channel_sg_reap(imsar_xdma_channel_t *channel, u32 status)
+{
+	imsar_xdma_sg_desc_t *desc;
+	imsar_xdma_buffer_meta_t *buffer_metadata;
+	unsigned int transfer_id;
+	unsigned int tail_index;
+	unsigned int reaped;
+	u32 desc_status;
+
+	reaped = 0;
+	tail_index = 0;
+
+	spin_lock(&channel->buffers_spinlock);
+	while (reaped < channel->sg_depth)
+	{
+		desc = &channel->sg_descs[channel->sg_reap_index];
+		desc_status = READ_ONCE(desc->status);
+		if (!(desc_status & SG_DESC_STATUS_COMPLETE))
+		{
+			break;
+		}
+		dma_rmb(); // read the status before anything the hardware wrote with it
+
+		transfer_id = channel->last_finished_transfer_id + 1;
+		buffer_metadata = imsar_xdma_buffer_meta(channel, transfer_id);
+		buffer_metadata->length = desc_status & SG_DESC_LENGTH_MASK;
+		buffer_metadata->timestamp_ns = ktime_get_ns();
+
+		if (channel->log_transfer_events)
+		{
+			dev_dbg(channel->xdma_device->device, "%s: finished transfer %u (len %u)\n", channel->name,
+			        transfer_id, buffer_metadata->length);
+		}
+
+		channel->last_finished_transfer_id = transfer_id;
+		WRITE_ONCE(channel->status_page->last_finished_transfer_id, transfer_id);
+
+		imsar_xdma_channel_sg_arm(channel, channel->sg_reap_index, channel->in_progress_transfer_id + 1);
+		tail_index = channel->sg_reap_index;
+		channel->sg_reap_index = (channel->sg_reap_index + 1) % channel->sg_depth;
+		reaped++;
+	}
+	spin_unlock(&channel->buffers_spinlock);
+	channel->irq_transfer_count += reaped;
+
+	if (status & FLAG_STATUS_ERR_IRQ)
+	{
+		// The hardware halts on errors; reset it and start over after the completed transfers (sleeps, so not here)
+		dev_warn(channel->xdma_device->device, "%s: Transfer error with status 0x%08x; restarting descriptor ring\n",
+		         channel->name, status);
+		schedule_work(&channel->recover_work);
+	}
+	else if (reaped > 0)
+	{
+		wmb();
+		imsar_xdma_chan_set_taildesc(channel, channel->sg_descs_bus_addr + tail_index * sizeof(imsar_xdma_sg_desc_t));
+	}
+
+	if (reaped > 0)
+	{
+		imsar_xdma_channel_notify_consumers(channel);
+	}
+}
+
+// Start the hardware on the channel's transfers: the first transfer (receive), the descriptor ring
+// (scatter-gather), or the transfer that was being sent (transmit, after a reset)
+// Note: control_mutex must be held
+static void imsar_xdma_channel_start_transfers(imsar_xdma_channel_t *channel)
+{
+	unsigned long flags;
+
+	imsar_xdma_chan_irq_ack(channel); // clear any pending IRQs
+	if (channel->sg_depth > 0)
+	{
+		imsar_xdma_channel_sg_start(channel);
+	}
+	else
+	{
+		imsar_xdma_chan_start(channel);
+		if (channel->direction != IMSAR_XDMA_DIR_MM2S)
+		{
+			imsar_xdma_channel_setup_transfer(channel, channel->in_progress_transfer_id);
+		}
+		else
+		{
+			// Other transmit transfers start when queued
+			spin_lock_irqsave(&channel->buffers_spinlock, flags);
+			if (channel->tx_active)
+			{
+				imsar_xdma_channel_setup_tx_transfer(channel, channel->in_progress_transfer_id);
+			}
+			spin_unlock_irqrestore(&channel->buffers_spinlock, flags);
+		}
+	}
+	imsar_xdma_chan_irq_enable(channel);
+}
+
+// Soft reset the core, which halts both of its channels and clears their errors, and start the channels that
+// have consumers again; the other channel loses the transfer it was in the middle of
+// Note: control_mutex must be held
+static void imsar_xdma_device_recover(imsar_xdma_dev_t *device_data)
+{
+	imsar_xdma_channel_t *channel;
+	imsar_xdma_channel_t *reset_channel;
+	int channel_index;
+	int rc;
+
+	reset_channel = NULL;
+	for (channel_index = 0; channel_index < IMSAR_XDMA_MAX_CHANNELS; channel_index++)
+	{
+		channel = device_data->channels[channel_index];
+		if (channel)
+		{
+			imsar_xdma_chan_irq_disable(channel);
+			synchronize_irq(channel->irq);
+			reset_channel = channel;
+		}
+	}
+	if (!reset_channel)
+	{
+		return;
+	}
+
+	rc = imsar_xdma_chan_reset(reset_channel);
+	if (rc)
+	{
+		dev_err(device_data->device, "DMA core did not halt after a reset (%d); channels left stopped\n", rc);
+		return;
+	}
+
+	for (channel_index = 0; channel_index < IMSAR_XDMA_MAX_CHANNELS; channel_index++)
+	{
+		channel = device_data->channels[channel_index];
+		if (channel && imsar_xdma_channel_has_consumers(channel))
+		{
+			imsar_xdma_channel_start_transfers(channel);
+		}
+	}
+}
+
+static void imsar_xdma_channel_recover_work(struct work_struct *work)
+{
+	imsar_xdma_channel_t *channel = container_of(work, imsar_xdma_channel_t, recover_work);
+
+	mutex_lock(&channel->xdma_device->control_mutex);
+	imsar_xdma_device_recover(channel->xdma_device);
+	mutex_unlock(&channel->xdma_device->control_mutex);
+}
+
+// Program a queued transmit transfer (transfer N is in buffer N % buffer_count)
+// Note: buffers_spinlock must be held
+static void imsar_xdma_channel_setup_tx_transfer(imsar_xdma_channel_t *channel, unsigned int transfer_id)
+{
+	imsar_xdma_buffer_meta_t *buffer_metadata = imsar_xdma_buffer_meta(channel, transfer_id);
+
+	if (channel->log_transfer_events)
+	{
+		dev_dbg(channel->xdma_device->device, "%s: setup transmit transfer %u (len %u)\n", channel->name,
+		        transfer_id, buffer_metadata->length);
+	}
+
+	WRITE_ONCE(channel->status_page->in_progress_transfer_id, transfer_id);
+	wmb();
 
 	imsar_xdma_chan_set_addr_and_len(channel, channel->buffer_bus_addr + buffer_metadata->offset,
-	                                 channel->buffer_size_bytes);
+	                                 buffer_metadata->length);
 
 	channel->in_progress_transfer_id = transfer_id;
+	channel->tx_active = true;
+}
+
+// A transmit buffer is free for the next transfer
+static int imsar_xdma_channel_tx_space(imsar_xdma_channel_t *channel)
+{
+	return READ_ONCE(channel->queued_transfer_id) - READ_ONCE(channel->last_finished_transfer_id) <
+	       channel->buffer_count;
+}
+
+// Queue a filled transmit buffer, starting the hardware if it is idle
+// Note: tx_mutex must be held
+static void imsar_xdma_channel_tx_queue(imsar_xdma_channel_t *channel, unsigned int transfer_id, unsigned int length)
+{
+	imsar_xdma_buffer_meta_t *buffer_metadata;
+	unsigned long flags;
+
+	buffer_metadata = imsar_xdma_buffer_meta(channel, transfer_id);
+
+	spin_lock_irqsave(&channel->buffers_spinlock, flags);
+	buffer_metadata->transfer_id = transfer_id;
+	buffer_metadata->length = length;
+	channel->queued_transfer_id = transfer_id;
+	if (!channel->tx_active)
+	{
+		imsar_xdma_channel_setup_tx_transfer(channel, transfer_id);
+	}
+	spin_unlock_irqrestore(&channel->buffers_spinlock, flags);
+}
+
+// Finish the in-progress transmit transfer (unless next_transfer_id repeats it) and chain the next queued one
+// right away; next_transfer_id 0 discards the queue
+static void imsar_xdma_channel_tx_finish(imsar_xdma_channel_t *channel, unsigned int next_transfer_id)
+{
+	unsigned int in_progress_transfer_id;
+	unsigned long flags;
+	int finished;
+
+	spin_lock_irqsave(&channel->buffers_spinlock, flags);
+	in_progress_transfer_id = channel->in_progress_transfer_id;
+	finished = channel->tx_active && next_transfer_id != in_progress_transfer_id;
+
+	if (next_transfer_id == 0)
+	{
+		channel->queued_transfer_id = channel->last_finished_transfer_id;
+		channel->in_progress_transfer_id = channel->last_finished_transfer_id + 1;
+		channel->tx_active = false;
+		finished = false;
+	}
+	else
+	{
+		if (finished)
+		{
+			channel->irq_transfer_count++;
+			channel->last_finished_transfer_id = in_progress_transfer_id;
+			WRITE_ONCE(channel->status_page->last_finished_transfer_id, in_progress_transfer_id);
+		}
+
+		if (next_transfer_id <= channel->queued_transfer_id)
+		{
+			imsar_xdma_channel_setup_tx_transfer(channel, next_transfer_id);
+		}
+		else
+		{
+			channel->in_progress_transfer_id = next_transfer_id;
+			channel->tx_active = false;
+		}
+	}
+	spin_unlock_irqrestore(&channel->buffers_spinlock, flags);
+
+	if (finished)
+	{
+		imsar_xdma_channel_notify_consumers(channel); // wakes writers waiting for a free buffer
+	}
+}
+
+// Give the transfers queued so far a chance to go out (up to imsar,tx-timeout-ms) before a transmit file is closed
+static void imsar_xdma_channel_tx_drain(imsar_xdma_channel_t *channel, imsar_xdma_file_t *file_data)
+{
+	unsigned int queued_transfer_id = READ_ONCE(channel->queued_transfer_id);
+	long rc;
+
+	rc = wait_event_killable_timeout(file_data->file_waitqueue,
+	                                 READ_ONCE(channel->last_finished_transfer_id) >= queued_transfer_id,
+	                                 msecs_to_jiffies(channel->tx_timeout_ms));
+	if (rc == 0)
+	{
+		dev_warn(channel->xdma_device->device, "%s: %u queued transfers not sent within %u ms of close\n",
+		         channel->name, queued_transfer_id - READ_ONCE(channel->last_finished_transfer_id),
+		         channel->tx_timeout_ms);
+	}
 }
 
 static int imsar_xdma_buffer_alloc(imsar_xdma_channel_t *channel)
@@ -682,9 +1747,42 @@ static int imsar_xdma_buffer_alloc(imsar_xdma_channel_t *channel)
 		goto buffer_alloc_fail;
 	}
 
+	channel->transfer_buffer_index = devm_kcalloc(channel->xdma_device->device, channel->buffer_count,
+	                                              sizeof(unsigned int), GFP_KERNEL);
+	if (!channel->transfer_buffer_index)
+	{
+		dev_err(channel->xdma_device->device, "buffer index allocation error\n");
+		rc = -ENOMEM;
+		goto buffer_alloc_fail;
+	}
+
 	for (i = 0; i < channel->buffer_count; i++)
 	{
 		imsar_xdma_buffer_meta_init(&channel->buffer_metadata[i], channel->buffer_size_bytes, i);
+		channel->transfer_buffer_index[i] = i;
+	}
+	channel->in_progress_buffer_index = channel->in_progress_transfer_id % channel->buffer_count;
+
+	if (channel->sg_depth > 0)
+	{
+		channel->sg_descs = dmam_alloc_coherent(channel->xdma_device->device,                   // dev
+		                                        channel->sg_depth * sizeof(imsar_xdma_sg_desc_t), // size
+		                                        &channel->sg_descs_bus_addr,                    // dma_handle (out)
+		                                        GFP_KERNEL);                                    // flags
+		if (!channel->sg_descs)
+		{
+			dev_err(channel->xdma_device->device, "descriptor ring allocation error\n");
+			rc = -ENOMEM;
+			goto buffer_alloc_fail;
+		}
+	}
+
+	channel->status_page = (struct imsar_xdma_status_page *)get_zeroed_page(GFP_KERNEL);
+	if (!channel->status_page)
+	{
+		dev_err(channel->xdma_device->device, "status page allocation error\n");
+		rc = -ENOMEM;
+		goto buffer_alloc_fail;
 	}
 
 	return 0;
@@ -714,6 +1812,26 @@ static void imsar_xdma_buffer_free(imsar_xdma_channel_t *channel)
 		devm_kfree(channel->xdma_device->device, channel->buffer_metadata);
 		channel->buffer_metadata = 0;
 	}
+
+	if (channel->transfer_buffer_index)
+	{
+		devm_kfree(channel->xdma_device->device, channel->transfer_buffer_index);
+		channel->transfer_buffer_index = 0;
+	}
+
+	if (channel->sg_descs)
+	{
+		dmam_free_coherent(channel->xdma_device->device, channel->sg_depth * sizeof(imsar_xdma_sg_desc_t),
+		                   channel->sg_descs, channel->sg_descs_bus_addr);
+		channel->sg_descs = 0;
+		channel->sg_descs_bus_addr = 0;
+	}
+
+	if (channel->status_page)
+	{
+		free_page((unsigned long)channel->status_page);
+		channel->status_page = 0;
+	}
 }
 
 static void imsar_xdma_buffer_meta_init(imsar_xdma_buffer_meta_t *data, unsigned int buffer_size,
@@ -722,11 +1840,14 @@ static void imsar_xdma_buffer_meta_init(imsar_xdma_buffer_meta_t *data, unsigned
 	data->transfer_id = 0;
 	data->length = 0;
 	data->offset = buffer_size * buffer_index;
+	data->pin_count = 0;
+	data->timestamp_ns = 0;
 }
 
+// Buffer of a recent transfer (callers check its transfer_id, since the buffer may have been reused)
 static imsar_xdma_buffer_meta_t *imsar_xdma_buffer_meta(imsar_xdma_channel_t *channel, unsigned int transfer_id)
 {
-	unsigned int buffer_index = transfer_id % channel->buffer_count;
+	unsigned int buffer_index = READ_ONCE(channel->transfer_buffer_index[transfer_id % channel->buffer_count]);
 	return &channel->buffer_metadata[buffer_index];
 }
 
@@ -743,6 +1864,8 @@ static irqreturn_t imsar_xdma_handle_irq(int num, void *channel_data)
 
 	channel = channel_data;
 	in_progress_transfer_id = channel->in_progress_transfer_id;
+	next_transfer_id = in_progress_transfer_id;
+	buffer_metadata = &channel->buffer_metadata[channel->in_progress_buffer_index];
 	status = imsar_xdma_chan_reg_read(channel, REG_STATUS);
 
 	if (!(status & FLAG_STATUS_ALL_IRQ)) // Not our interrupt
@@ -751,6 +1874,13 @@ static irqreturn_t imsar_xdma_handle_irq(int num, void *channel_data)
 	}
 
 	imsar_xdma_chan_irq_ack(channel);
+	channel->irq_count++;
+
+	if (channel->sg_depth > 0)
+	{
+		imsar_xdma_channel_sg_reap(channel, status);
+		return IRQ_HANDLED;
+	}
 
 	if (status & FLAG_STATUS_ERR_IRQ)
 	{
@@ -798,16 +1928,30 @@ static irqreturn_t imsar_xdma_handle_irq(int num, void *channel_data)
 
 		next_transfer_id = in_progress_transfer_id + 1;
 	}
+	else
+	{
+		// Delay interrupt only: no transfer finished, so leave the one in progress alone
+		return IRQ_HANDLED;
+	}
+
+	if (channel->direction == IMSAR_XDMA_DIR_MM2S)
+	{
+		// Send the next queued transfer (or the same one again after an error)
+		imsar_xdma_channel_tx_finish(channel, next_transfer_id);
+		return IRQ_HANDLED;
+	}
 
 	// Set the address and length for the next transfer (this allows the hardware to continue)
 	imsar_xdma_channel_setup_transfer(channel, next_transfer_id);
 
 	if (length > 0)
 	{
-		buffer_metadata = imsar_xdma_buffer_meta(channel, in_progress_transfer_id);
 		buffer_metadata->length = length;
+		buffer_metadata->timestamp_ns = ktime_get_ns();
+		channel->irq_transfer_count++;
 
 		channel->last_finished_transfer_id = in_progress_transfer_id;
+		WRITE_ONCE(channel->status_page->last_finished_transfer_id, in_progress_transfer_id);
 
 		imsar_xdma_channel_notify_consumers(channel);
 	}
@@ -822,6 +1966,7 @@ static int imsar_xdma_device_data_init(struct platform_device *platform_device,
 	device_data->platform_device = platform_device;
 	device_data->device = &platform_device->dev;
 	device_data->log_register_access = false;
+	mutex_init(&device_data->control_mutex);
 	return 0;
 }
 
@@ -864,6 +2009,10 @@ static imsar_xdma_channel_t *imsar_xdma_channel_create(imsar_xdma_dev_t *device_
 
 	spin_lock_init(&channel_data->consumers_spinlock);
 	INIT_LIST_HEAD(&channel_data->consuming_files);
+	spin_lock_init(&channel_data->buffers_spinlock);
+	spin_lock_init(&channel_data->irq_rate_spinlock);
+	mutex_init(&channel_data->tx_mutex);
+	INIT_WORK(&channel_data->recover_work, imsar_xdma_channel_recover_work);
 
 	// Parse channel device tree node
 	rc = imsar_xdma_channel_parse_dt(channel_data);
@@ -872,6 +2021,17 @@ static imsar_xdma_channel_t *imsar_xdma_channel_create(imsar_xdma_dev_t *device_
 		return ERR_PTR(rc);
 	}
 
+	// Scatter-gather mode needs the hardware to be built with it
+	if (channel_data->sg_depth > 0 &&
+	    !(imsar_xdma_chan_reg_read(channel_data, REG_STATUS) & FLAG_STATUS_SG_INCLUDED))
+	{
+		dev_warn(device_data->device, "%s: no scatter-gather in the core; using simple register mode\n",
+		         channel_data->name);
+		channel_data->sg_depth = 0;
+		channel_data->irq_threshold = 1;
+		channel_data->irq_delay = 0;
+	}
+
 	// Allocate channel DMA and metadata buffers
 	rc = imsar_xdma_buffer_alloc(channel_data);
 	if (rc)
@@ -900,6 +2060,7 @@ static imsar_xdma_channel_t *imsar_xdma_channel_create(imsar_xdma_dev_t *device_
 
 static void imsar_xdma_channel_destroy(imsar_xdma_channel_t *channel_data)
 {
+	cancel_work_sync(&channel_data->recover_work);
 	imsar_xdma_channel_chardev_destroy(channel_data);
 	imsar_xdma_buffer_free(channel_data);
 }
@@ -936,7 +2097,6 @@ static int imsar_xdma_channel_parse_dt(imsar_xdma_channel_t *channel_data)
 	}
 	else if (strcmp(dir, "mm2s") == 0)
 	{
-		dev_err(dev, "mm2s is not currently supported!");
 		channel_data->direction = IMSAR_XDMA_DIR_MM2S;
 	}
 	else
@@ -952,6 +2112,11 @@ static int imsar_xdma_channel_parse_dt(imsar_xdma_channel_t *channel_data)
 		dev_err(dev, "Missing required property: imsar,buffer-count\n");
 		return rc;
 	}
+	if (channel_data->buffer_count > IMSAR_XDMA_STATUS_PAGE_MAX_BUFFERS)
+	{
+		dev_err(dev, "imsar,buffer-count must be at most %zu\n", IMSAR_XDMA_STATUS_PAGE_MAX_BUFFERS);
+		return -EINVAL;
+	}
 
 	// imsar,buffer-size-bytes
 	rc = of_property_read_u32(dev_node, "imsar,buffer-size-bytes", &channel_data->buffer_size_bytes);
@@ -961,6 +2126,45 @@ static int imsar_xdma_channel_parse_dt(imsar_xdma_channel_t *channel_data)
 		return rc;
 	}
 
+	// imsar,sg-depth (optional)
+	rc = of_property_read_u32(dev_node, "imsar,sg-depth", &channel_data->sg_depth);
+	if (rc)
+	{
+		channel_data->sg_depth = 0;
+	}
+	else if (channel_data->direction != IMSAR_XDMA_DIR_S2MM || channel_data->sg_depth < 2 ||
+	         channel_data->sg_depth >= channel_data->buffer_count ||
+	         channel_data->buffer_size_bytes > SG_DESC_LENGTH_MASK)
+	{
+		dev_err(dev, "imsar,sg-depth needs an s2mm channel, 2 <= depth < buffer count and buffers under 64 MiB\n");
+		return -EINVAL;
+	}
+
+	// imsar,tx-timeout-ms (optional)
+	if (of_property_read_u32(dev_node, "imsar,tx-timeout-ms", &channel_data->tx_timeout_ms))
+	{
+		channel_data->tx_timeout_ms = 1000;
+	}
+
+	// imsar,irq-threshold and imsar,irq-delay (optional)
+	if (of_property_read_u32(dev_node, "imsar,irq-threshold", &channel_data->irq_threshold))
+	{
+		channel_data->irq_threshold = 1;
+	}
+	if (of_property_read_u32(dev_node, "imsar,irq-delay", &channel_data->irq_delay))
+	{
+		channel_data->irq_delay = 0;
+	}
+	if (!imsar_xdma_chan_irq_coalesce_valid(channel_data, channel_data->irq_threshold, channel_data->irq_delay))
+	{
+		dev_err(dev, "imsar,irq-threshold/imsar,irq-delay need imsar,sg-depth, threshold <= depth and delay < 256\n");
+		return -EINVAL;
+	}
+	if (channel_data->irq_threshold > 1 && channel_data->irq_delay == 0)
+	{
+		dev_warn(dev, "imsar,irq-threshold without imsar,irq-delay holds back the last transfers of a burst\n");
+	}
+
 	// reg
 	rc = of_property_read_u32(dev_node, "reg", &channel_data->reg_offset);
 	if (rc)
@@ -976,9 +2180,10 @@ static int imsar_xdma_channel_parse_dt(imsar_xdma_channel_t *channel_data)
 		return dev_err_probe(dev, channel_data->irq, "failed to get irq\n");
 	}
 
-	dev_info(dev, "channel %s: dir=%u, reg_offset=0x%x, irq=%u, buffer count=%u, bytes=%u", channel_data->name,
-	         channel_data->direction, channel_data->reg_offset, channel_data->irq, channel_data->buffer_count,
-	         channel_data->buffer_size_bytes);
+	dev_info(dev, "channel %s: dir=%u, reg_offset=0x%x, irq=%u, buffer count=%u, bytes=%u, sg depth=%u, irq %u/%u",
+	         channel_data->name, channel_data->direction, channel_data->reg_offset, channel_data->irq,
+	         channel_data->buffer_count, channel_data->buffer_size_bytes, channel_data->sg_depth,
+	         channel_data->irq_threshold, channel_data->irq_delay);
 
 	return 0;
 }
@@ -29,11 +29,14 @@
 #include <linux/dma-mapping.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/of_irq.h>
 #include <linux/platform_device.h>
+#include <linux/sched.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #define IMSAR_XDMA_DRIVER_NAME "imsar_xdma"
 #define IMSAR_XDMA_MAX_CHANNELS 2
@@ -49,14 +52,31 @@ typedef struct imsar_xdma_dev_st imsar_xdma_dev_t;
 typedef struct imsar_xdma_buffer_meta_st imsar_xdma_buffer_meta_t;
 typedef struct imsar_xdma_chan_st imsar_xdma_channel_t;
 typedef struct imsar_xdma_file_st imsar_xdma_file_t;
+typedef struct imsar_xdma_sg_desc_st imsar_xdma_sg_desc_t;
 
 struct imsar_xdma_buffer_meta_st
 {
 	unsigned int transfer_id;
 	unsigned int length;
 	unsigned int offset;
+	unsigned int pin_count; // pins held by files (new transfers skip the buffer while non-zero)
+	u64 timestamp_ns;       // completion time (ktime_get_ns)
 };
 
+// AXI DMA scatter-gather descriptor (in coherent memory, 64-byte aligned)
+struct imsar_xdma_sg_desc_st
+{
+	u32 next_desc;
+	u32 next_desc_msb;
+	u32 buffer_address;
+	u32 buffer_address_msb;
+	u32 reserved[2];
+	u32 control; // buffer length
+	u32 status;  // transferred length and completion/error flags (written by the hardware)
+	u32 app[5];
+	u32 padding[3];
+} __aligned(64);
+
 struct imsar_xdma_dev_st
 {
 	struct platform_device *platform_device;
@@ -74,6 +94,7 @@ struct imsar_xdma_dev_st
 	struct cdev char_dev;
 
 	// State
+	struct mutex control_mutex; // held when starting, stopping or resetting channels (a reset covers the core)
 	imsar_xdma_channel_t *channels[IMSAR_XDMA_MAX_CHANNELS];
 };
 
@@ -90,11 +111,24 @@ struct imsar_xdma_chan_st
 	imsar_xdma_dir_t direction;     // imsar,direction
 	unsigned int buffer_count;      // imsar,buffer-count
 	unsigned int buffer_size_bytes; // imsar,buffer-size-bytes
+	unsigned int sg_depth;          // imsar,sg-depth (0 = simple register mode)
+	unsigned int irq_threshold;     // imsar,irq-threshold (completions per interrupt; scatter-gather mode)
+	unsigned int irq_delay;         // imsar,irq-delay (delay timer ticks, 0 = off; scatter-gather mode)
+	unsigned int tx_timeout_ms;     // imsar,tx-timeout-ms (close() waits this long for queued transmit transfers)
 
 	// DMA buffer addresses
 	void *buffer_virt_addr;
 	dma_addr_t buffer_bus_addr;
 
+	// Scatter-gather descriptor ring (sg_depth descriptors, all queued in hardware)
+	imsar_xdma_sg_desc_t *sg_descs;
+	dma_addr_t sg_descs_bus_addr;
+	unsigned int sg_reap_index;      // next descriptor to complete
+	struct work_struct recover_work; // soft reset and restart after a transfer error (scheduled by the IRQ handler)
+
+	// Transfer IDs for zero-copy readers (one page, mapped read-only into user space)
+	struct imsar_xdma_status_page *status_page;
+
 	// Character device
 	struct device *char_dev_device;
 
@@ -102,9 +136,31 @@ struct imsar_xdma_chan_st
 	unsigned int channel_index;
 	unsigned int last_finished_transfer_id;
 	unsigned int in_progress_transfer_id;
+	unsigned int in_progress_buffer_index;
 	imsar_xdma_buffer_meta_t *buffer_metadata; // kzalloc'd array for each buffer
+	unsigned int *transfer_buffer_index;       // kzalloc'd array; buffer of each transfer ID (by ID % buffer_count)
 	unsigned int log_transfer_events;
 
+	// Interrupt statistics
+	unsigned long irq_count;          // interrupts handled
+	unsigned long irq_transfer_count; // transfers finished by them
+	unsigned long irq_rate_count;     // irq_count at the last rate read (sysfs irq/rate)
+	unsigned long irq_rate_transfers; // irq_transfer_count at the last rate read
+	u64 irq_rate_ns;                  // time of the last rate read
+	spinlock_t irq_rate_spinlock;     // held when reading and resetting the rate counters
+
+	// Pinned buffers
+	spinlock_t buffers_spinlock;      // held when changing pins or choosing the buffer for a transfer
+	unsigned int pinned_buffer_count; // buffers with a non-zero pin_count
+	unsigned long pinned_skip_count;  // times a new transfer skipped a pinned buffer
+
+	// Transmit (MM2S) queue: transfers after last_finished_transfer_id up to queued_transfer_id are waiting
+	// or in progress (transfer N in buffer N % buffer_count)
+	struct mutex tx_mutex;               // held by the file queueing a transfer
+	unsigned int queued_transfer_id;     // the last transfer queued by user space
+	unsigned int tx_active;              // the hardware is sending in_progress_transfer_id
+	imsar_xdma_file_t *tx_reserved_file; // file filling the buffer of queued_transfer_id + 1 (GET_TX_BUFFER)
+
 	// Consumers
 	spinlock_t consumers_spinlock;    // held when changing consuming_files
 	struct list_head consuming_files; // points at imsar_user_interrupt_file_t entries
@@ -114,8 +170,17 @@ struct imsar_xdma_file_st
 {
 	imsar_xdma_channel_t *channel;
 	unsigned int last_read_transfer_id;
+	unsigned int *pin_counts; // kzalloc'd array; pins this file holds on each buffer
+	unsigned int read_mode;   // IMSAR_XDMA_READ_MODE_*
 	wait_queue_head_t file_waitqueue;
 	struct list_head list; // used to link pointers for consuming_files
+
+	// Consumer statistics (IMSAR_XDMA_IOCTL_GET_CONSUMER_STATS, sysfs info/consumers)
+	pid_t pid;                            // process that opened the file
+	char comm[TASK_COMM_LEN];             // and its name
+	unsigned long long transfers_read;    // transfers returned
+	unsigned long long transfers_skipped; // transfers overwritten before the file got to them
+	unsigned int max_lag;                 // most completed transfers behind a returned one
 };
 
 #endif
\ No newline at end of file
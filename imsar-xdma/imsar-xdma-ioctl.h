@@ -1,6 +1,93 @@
 #ifndef __IMSAR_XDMA_IOCTL_H
 #define __IMSAR_XDMA_IOCTL_H
 
+// Zero-copy receive (instead of read()):
+//   1. mmap() the channel buffers read-only at offset 0 (buffers_bytes from IMSAR_XDMA_IOCTL_GET_MMAP_INFO),
+//      and the status page at status_offset.
+//   2. IMSAR_XDMA_IOCTL_GET_NEXT_TRANSFER waits for the next completed transfer (like read(), including
+//      O_NONBLOCK and skipping ahead when the file falls behind) and returns where its data is in the mapping.
+//   3. Process the data in place. A buffer is only written by the transfer it was last given to, so the data
+//      was intact if afterwards (status page) buffer_transfer_id[offset / buffer_size_bytes] == transfer_id.
+//
+// Pinned zero-copy receive (no check needed afterwards):
+//   2. IMSAR_XDMA_IOCTL_ACQUIRE_TRANSFER is GET_NEXT_TRANSFER that also pins the buffer: new transfers skip it
+//      (counted in sysfs info/pinned_skips) until IMSAR_XDMA_IOCTL_RELEASE_TRANSFER or close().
+//      Buffers for the hardware always stay unpinned (two, or imsar,sg-depth + 1 in scatter-gather mode),
+//      so acquiring fails with EBUSY when the rest are in use.
+//   3. The status page check above stays valid for every file while any file has buffers pinned (a pinned
+//      buffer keeps its transfer, the others rotate).
+
+// Framed read (IMSAR_XDMA_IOCTL_SET_READ_MODE IMSAR_XDMA_READ_MODE_FRAMED): read() returns as many whole
+// completed transfers as fit (at least one, truncated if the buffer is too small for it), each as a
+// struct imsar_xdma_frame_header followed by its data, padded to a multiple of 8 bytes.
+
+// Transmit (MM2S channels): write() queues one transfer of up to buffer_size_bytes, waiting for a free buffer
+// (poll() reports POLLOUT when one is free). Queued transfers are sent back to back. Zero-copy transmit:
+//   1. mmap() the channel buffers read-write at offset 0.
+//   2. IMSAR_XDMA_IOCTL_GET_TX_BUFFER waits for a free buffer, reserves it for the calling file and returns
+//      the next transfer ID and its offset. Until the file submits it (or closes), GET_TX_BUFFER and write()
+//      from other files fail with EBUSY.
+//   3. Fill the buffer, then queue it with IMSAR_XDMA_IOCTL_SUBMIT_TRANSFER (the same transfer ID and offset,
+//      and the length to send). A transfer ID this file has not reserved fails with EINVAL.
+// close() waits up to imsar,tx-timeout-ms (default 1000) for the queued transfers to be sent.
+
+// Returned by IMSAR_XDMA_IOCTL_GET_MMAP_INFO
+struct imsar_xdma_mmap_info
+{
+	unsigned int buffer_count;      // number of buffers
+	unsigned int buffer_size_bytes; // size of each buffer
+	unsigned int buffers_bytes;     // size of the buffer mapping (at mmap offset 0)
+	unsigned int status_offset;     // mmap offset of the status page (one page, struct imsar_xdma_status_page)
+};
+
+// Returned by IMSAR_XDMA_IOCTL_GET_NEXT_TRANSFER and IMSAR_XDMA_IOCTL_GET_TX_BUFFER
+struct imsar_xdma_transfer_info
+{
+	unsigned int transfer_id; // the transfer (increments by one per completed transfer)
+	unsigned int offset;      // offset of its data in the buffer mapping
+	unsigned int length;      // length of its data in bytes
+};
+
+// Returned by IMSAR_XDMA_IOCTL_GET_CONSUMER_STATS (for the calling file)
+struct imsar_xdma_consumer_stats
+{
+	unsigned long long transfers_read;    // transfers returned by read(), GET_NEXT_TRANSFER or ACQUIRE_TRANSFER
+	unsigned long long transfers_skipped; // transfers overwritten before this file got to them (dropped)
+	unsigned int max_lag;                 // most completed transfers that were newer than a returned one
+	unsigned int lag;                     // completed transfers not returned yet
+};
+
+// Precedes each transfer in a framed read
+struct imsar_xdma_frame_header
+{
+	unsigned int transfer_id;        // the transfer
+	unsigned int length;             // bytes of data after the header (before padding)
+	unsigned long long timestamp_ns; // completion time (CLOCK_MONOTONIC)
+};
+
+#define IMSAR_XDMA_READ_MODE_TRANSFER 0 // read() returns the data of one transfer (default)
+#define IMSAR_XDMA_READ_MODE_FRAMED 1   // read() returns framed transfers
+
+// Read-only status page (updated by the driver as transfers start and finish)
+struct imsar_xdma_status_page
+{
+	unsigned int in_progress_transfer_id;   // the newest transfer the hardware may be writing
+	unsigned int last_finished_transfer_id; // the most recent completed transfer
+	unsigned int buffer_transfer_id[];      // by buffer index: the transfer last given the buffer (0 = none yet);
+	                                        // receive channels set it before the hardware may write the buffer
+};
+
+// The status page is one page, which limits the buffers of a channel
+#define IMSAR_XDMA_STATUS_PAGE_MAX_BUFFERS ((4096 - sizeof(struct imsar_xdma_status_page)) / sizeof(unsigned int))
+
 #define IMSAR_XDMA_IOCTL_GET_BUFFER_SIZE _IOR('a', 's', unsigned int *)
+#define IMSAR_XDMA_IOCTL_GET_MMAP_INFO _IOR('a', 'm', struct imsar_xdma_mmap_info)
+#define IMSAR_XDMA_IOCTL_GET_NEXT_TRANSFER _IOR('a', 'n', struct imsar_xdma_transfer_info)
+#define IMSAR_XDMA_IOCTL_ACQUIRE_TRANSFER _IOR('a', 'p', struct imsar_xdma_transfer_info)
+#define IMSAR_XDMA_IOCTL_RELEASE_TRANSFER _IOW('a', 'r', unsigned int)
+#define IMSAR_XDMA_IOCTL_GET_TX_BUFFER _IOR('a', 't', struct imsar_xdma_transfer_info)
+#define IMSAR_XDMA_IOCTL_SUBMIT_TRANSFER _IOW('a', 'x', struct imsar_xdma_transfer_info)
+#define IMSAR_XDMA_IOCTL_SET_READ_MODE _IOW('a', 'f', unsigned int)
+#define IMSAR_XDMA_IOCTL_GET_CONSUMER_STATS _IOR('a', 'c', struct imsar_xdma_consumer_stats)
 
-#endif
\ No newline at end of file
+#endif
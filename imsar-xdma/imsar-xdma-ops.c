@@ -23,6 +23,9 @@
 
 #include "imsar-xdma-ops.h"
 
+#include <linux/bitfield.h>
+#include <linux/iopoll.h>
+
 u32 imsar_xdma_reg_read(imsar_xdma_dev_t *xdma_dev, unsigned int reg)
 {
 	u32 val = readl(xdma_dev->regs + reg);
@@ -72,7 +75,44 @@ void imsar_xdma_chan_irq_enable(imsar_xdma_channel_t *channel)
 	{
 		dev_dbg(channel->xdma_device->device, "%s: irq enable", channel->name);
 	}
-	imsar_xdma_chan_reg_bit_clr_set(channel, REG_CONTROL, FLAG_CONTROL_ALL_IRQ_EN, FLAG_CONTROL_ALL_IRQ_EN);
+	imsar_xdma_chan_irq_coalesce(channel);
+	imsar_xdma_chan_reg_bit_clr_set(channel, REG_CONTROL, FLAG_CONTROL_ALL_IRQ_EN | FLAG_CONTROL_DLY_IRQ_EN,
+	                                FLAG_CONTROL_ALL_IRQ_EN | (channel->irq_delay > 0 ? FLAG_CONTROL_DLY_IRQ_EN : 0));
+}
+
+// Program the interrupt threshold and delay timer
+void imsar_xdma_chan_irq_coalesce(imsar_xdma_channel_t *channel)
+{
+	u32 value;
+
+	value = FIELD_PREP(FLAG_CONTROL_IRQ_THRESHOLD, channel->irq_threshold) |
+	        FIELD_PREP(FLAG_CONTROL_IRQ_DELAY, channel->irq_delay);
+	imsar_xdma_chan_reg_bit_clr_set(channel, REG_CONTROL, FLAG_CONTROL_IRQ_THRESHOLD | FLAG_CONTROL_IRQ_DELAY, value);
+}
+
+// Enable the delay interrupt when there is a delay, but only while the channel interrupts are enabled
+void imsar_xdma_chan_irq_delay_update(imsar_xdma_channel_t *channel)
+{
+	u32 control;
+
+	control = imsar_xdma_chan_reg_read(channel, REG_CONTROL);
+	if (!(control & FLAG_CONTROL_IOC_IRQ_EN))
+	{
+		return;
+	}
+	imsar_xdma_chan_reg_bit_clr_set(channel, REG_CONTROL, FLAG_CONTROL_DLY_IRQ_EN,
+	                                channel->irq_delay > 0 ? FLAG_CONTROL_DLY_IRQ_EN : 0);
+}
+
+// Coalescing needs scatter-gather mode, and the threshold cannot exceed the descriptors in the ring
+int imsar_xdma_chan_irq_coalesce_valid(imsar_xdma_channel_t *channel, unsigned int threshold, unsigned int delay)
+{
+	if (channel->sg_depth == 0)
+	{
+		return threshold == 1 && delay == 0;
+	}
+	return threshold >= 1 && threshold <= FIELD_MAX(FLAG_CONTROL_IRQ_THRESHOLD) && threshold <= channel->sg_depth &&
+	       delay <= FIELD_MAX(FLAG_CONTROL_IRQ_DELAY);
 }
 
 void imsar_xdma_chan_irq_disable(imsar_xdma_channel_t *channel)
@@ -81,7 +121,7 @@ void imsar_xdma_chan_irq_disable(imsar_xdma_channel_t *channel)
 	{
 		dev_dbg(channel->xdma_device->device, "%s irq disable", channel->name);
 	}
-	imsar_xdma_chan_reg_bit_clr_set(channel, REG_CONTROL, FLAG_CONTROL_ALL_IRQ_EN, 0);
+	imsar_xdma_chan_reg_bit_clr_set(channel, REG_CONTROL, FLAG_CONTROL_ALL_IRQ_EN | FLAG_CONTROL_DLY_IRQ_EN, 0);
 }
 
 void imsar_xdma_chan_irq_ack(imsar_xdma_channel_t *channel)
@@ -111,6 +151,45 @@ void imsar_xdma_chan_stop(imsar_xdma_channel_t *channel)
 	imsar_xdma_chan_reg_bit_clr_set(channel, REG_CONTROL, FLAG_CONTROL_RUNSTOP, 0);
 }
 
+// Wait (sleeping) for a stopped channel to halt; returns -ETIMEDOUT if it does not, or -EIO if it halted on an
+// error (only a reset clears those)
+int imsar_xdma_chan_wait_halted(imsar_xdma_channel_t *channel)
+{
+	u32 status;
+	int rc;
+
+	rc = read_poll_timeout(imsar_xdma_chan_reg_read, status, status & FLAG_STATUS_HALTED, 10,
+	                       IMSAR_XDMA_HALT_TIMEOUT_US, false, channel, REG_STATUS);
+	if (rc)
+	{
+		return rc;
+	}
+	return (status & FLAG_STATUS_DMA_ALL_ERRS) ? -EIO : 0;
+}
+
+// Soft reset the core (both of its channels: registers, interrupt enables and errors) and wait (sleeping) for
+// this channel to halt; returns -ETIMEDOUT if it does not
+int imsar_xdma_chan_reset(imsar_xdma_channel_t *channel)
+{
+	u32 control;
+	int rc;
+
+	if (channel->log_transfer_events)
+	{
+		dev_dbg(channel->xdma_device->device, "%s channel reset", channel->name);
+	}
+	imsar_xdma_chan_reg_write(channel, REG_CONTROL, FLAG_CONTROL_RESET);
+
+	// The reset bit clears itself when the reset is done
+	rc = read_poll_timeout(imsar_xdma_chan_reg_read, control, !(control & FLAG_CONTROL_RESET), 10,
+	                       IMSAR_XDMA_HALT_TIMEOUT_US, false, channel, REG_CONTROL);
+	if (rc)
+	{
+		return rc;
+	}
+	return imsar_xdma_chan_wait_halted(channel);
+}
+
 void imsar_xdma_chan_set_addr_and_len(imsar_xdma_channel_t *channel, u32 address, u32 length)
 {
 	imsar_xdma_chan_reg_write(channel, REG_ADDR_LSB, address);
@@ -121,3 +200,13 @@ u32 imsar_xdma_chan_read_len(imsar_xdma_channel_t *channel)
 {
 	return imsar_xdma_chan_reg_read(channel, REG_LENGTH);
 }
+
+void imsar_xdma_chan_set_curdesc(imsar_xdma_channel_t *channel, u32 address)
+{
+	imsar_xdma_chan_reg_write(channel, REG_CURDESC_LSB, address); // only while halted
+}
+
+void imsar_xdma_chan_set_taildesc(imsar_xdma_channel_t *channel, u32 address)
+{
+	imsar_xdma_chan_reg_write(channel, REG_TAILDESC_LSB, address); // hardware runs up to this descriptor
+}
@@ -29,6 +29,8 @@
 // Registers
 #define REG_CONTROL 0x00
 #define REG_STATUS 0x04
+#define REG_CURDESC_LSB 0x08  // scatter-gather mode
+#define REG_TAILDESC_LSB 0x10 // scatter-gather mode
 #define REG_ADDR_LSB 0x18
 #define REG_ADDR_MSB 0x1C
 #define REG_LENGTH 0x28
@@ -37,12 +39,16 @@
 #define FLAG_CONTROL_RUNSTOP BIT(0)
 #define FLAG_CONTROL_RESET BIT(2)
 #define FLAG_CONTROL_IOC_IRQ_EN BIT(12)
+#define FLAG_CONTROL_DLY_IRQ_EN BIT(13) // scatter-gather mode
 #define FLAG_CONTROL_ERR_IRQ_EN BIT(14)
 #define FLAG_CONTROL_ALL_IRQ_EN (FLAG_CONTROL_IOC_IRQ_EN | FLAG_CONTROL_ERR_IRQ_EN)
+#define FLAG_CONTROL_IRQ_THRESHOLD GENMASK(23, 16) // scatter-gather mode: completions per IOC interrupt
+#define FLAG_CONTROL_IRQ_DELAY GENMASK(31, 24)     // scatter-gather mode: idle ticks before a delay interrupt
 
 // Status flags
 #define FLAG_STATUS_HALTED BIT(0)
 #define FLAG_STATUS_IDLE BIT(1)
+#define FLAG_STATUS_SG_INCLUDED BIT(3)
 
 #define FLAG_STATUS_DMA_INT_ERR BIT(4)
 #define FLAG_STATUS_DMA_SLV_ERR BIT(5)
@@ -50,8 +56,16 @@
 #define FLAG_STATUS_DMA_ALL_ERRS (FLAG_STATUS_DMA_INT_ERR | FLAG_STATUS_DMA_SLV_ERR | FLAG_STATUS_DMA_DEC_ERR)
 
 #define FLAG_STATUS_IOC_IRQ BIT(12)
+#define FLAG_STATUS_DLY_IRQ BIT(13)
 #define FLAG_STATUS_ERR_IRQ BIT(14)
-#define FLAG_STATUS_ALL_IRQ (FLAG_STATUS_IOC_IRQ | FLAG_STATUS_ERR_IRQ)
+#define FLAG_STATUS_ALL_IRQ (FLAG_STATUS_IOC_IRQ | FLAG_STATUS_DLY_IRQ | FLAG_STATUS_ERR_IRQ)
+
+// Scatter-gather descriptor control and status words
+#define SG_DESC_LENGTH_MASK GENMASK(25, 0)
+#define SG_DESC_STATUS_COMPLETE BIT(31)
+
+// Longest wait for a channel to halt (or a soft reset to finish)
+#define IMSAR_XDMA_HALT_TIMEOUT_US 10000
 
 u32 imsar_xdma_reg_read(imsar_xdma_dev_t *xdma_dev, unsigned int reg);
 void imsar_xdma_reg_write(imsar_xdma_dev_t *xdma_dev, unsigned int reg, u32 value);
@@ -64,9 +78,16 @@ void imsar_xdma_chan_reg_bit_clr_set(imsar_xdma_channel_t *channel, unsigned int
 void imsar_xdma_chan_irq_enable(imsar_xdma_channel_t *channel);
 void imsar_xdma_chan_irq_disable(imsar_xdma_channel_t *channel);
 void imsar_xdma_chan_irq_ack(imsar_xdma_channel_t *channel);
+void imsar_xdma_chan_irq_coalesce(imsar_xdma_channel_t *channel);
+void imsar_xdma_chan_irq_delay_update(imsar_xdma_channel_t *channel);
+int imsar_xdma_chan_irq_coalesce_valid(imsar_xdma_channel_t *channel, unsigned int threshold, unsigned int delay);
 void imsar_xdma_chan_start(imsar_xdma_channel_t *channel);
 void imsar_xdma_chan_stop(imsar_xdma_channel_t *channel);
+int imsar_xdma_chan_wait_halted(imsar_xdma_channel_t *channel);
+int imsar_xdma_chan_reset(imsar_xdma_channel_t *channel);
 void imsar_xdma_chan_set_addr_and_len(imsar_xdma_channel_t *channel, u32 address, u32 length);
 u32 imsar_xdma_chan_read_len(imsar_xdma_channel_t *channel);
+void imsar_xdma_chan_set_curdesc(imsar_xdma_channel_t *channel, u32 address);
+void imsar_xdma_chan_set_taildesc(imsar_xdma_channel_t *channel, u32 address);
 
 #endif
\ No newline at end of file
@@ -33,7 +33,9 @@
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
@@ -66,10 +68,16 @@ static struct attribute_group imsar_xdma_sysfs_top_attr_group = {.attrs = imsar_
 static DEVICE_ATTR(buffer_count, S_IRUGO, imsar_xdma_sysfs_buffer_count_show, NULL);
 static DEVICE_ATTR(buffer_size, S_IRUGO, imsar_xdma_sysfs_buffer_size_show, NULL);
 static DEVICE_ATTR(transfer_id, S_IRUGO, imsar_xdma_sysfs_transfer_id_show, NULL);
+static DEVICE_ATTR(pinned_buffers, S_IRUGO, imsar_xdma_sysfs_pinned_buffers_show, NULL);
+static DEVICE_ATTR(pinned_skips, S_IRUGO, imsar_xdma_sysfs_pinned_skips_show, NULL);
+static DEVICE_ATTR(consumers, S_IRUGO, imsar_xdma_sysfs_consumers_show, NULL);
 static struct attribute *imsar_xdma_sysfs_info_attrs[] = { //
     &dev_attr_buffer_count.attr,                           //
     &dev_attr_buffer_size.attr,                            //
     &dev_attr_transfer_id.attr,                            //
+    &dev_attr_pinned_buffers.attr,                         //
+    &dev_attr_pinned_skips.attr,                           //
+    &dev_attr_consumers.attr,                              //
     NULL};
 
 static struct attribute_group imsar_xdma_sysfs_info_attr_group = {
@@ -77,6 +85,26 @@ static struct attribute_group imsar_xdma_sysfs_info_attr_group = {
     .attrs = imsar_xdma_sysfs_info_attrs,
 };
 
+// irq group
+static DEVICE_ATTR(threshold, (S_IRUGO | S_IWUSR | S_IWGRP), imsar_xdma_sysfs_irq_threshold_show,
+                   imsar_xdma_sysfs_irq_threshold_store);
+static DEVICE_ATTR(delay, (S_IRUGO | S_IWUSR | S_IWGRP), imsar_xdma_sysfs_irq_delay_show,
+                   imsar_xdma_sysfs_irq_delay_store);
+static DEVICE_ATTR(count, S_IRUGO, imsar_xdma_sysfs_irq_count_show, NULL);
+static DEVICE_ATTR(transfers, S_IRUGO, imsar_xdma_sysfs_irq_transfers_show, NULL);
+static DEVICE_ATTR(rate, S_IRUGO, imsar_xdma_sysfs_irq_rate_show, NULL);
+static struct attribute *imsar_xdma_sysfs_irq_attrs[] = { //
+    &dev_attr_threshold.attr,                             //
+    &dev_attr_delay.attr,                                 //
+    &dev_attr_count.attr,                                 //
+    &dev_attr_transfers.attr,                             //
+    &dev_attr_rate.attr,                                  //
+    NULL};
+static struct attribute_group imsar_xdma_sysfs_irq_attr_group = {
+    .name = "irq",
+    .attrs = imsar_xdma_sysfs_irq_attrs,
+};
+
 // log group
 static DEVICE_ATTR(log_register_access, (S_IRUGO | S_IWUSR | S_IWGRP), imsar_xdma_sysfs_log_register_access_show,
                    imsar_xdma_sysfs_log_register_access_store);
@@ -158,6 +186,7 @@ static struct attribute_group imsar_xdma_sysfs_register_attr_group = {
 const struct attribute_group *imsar_xdma_sysfs_attr_groups[] = {
     &imsar_xdma_sysfs_top_attr_group,      //
     &imsar_xdma_sysfs_info_attr_group,     //
+    &imsar_xdma_sysfs_irq_attr_group,      //
     &imsar_xdma_sysfs_log_attr_group,      //
     &imsar_xdma_sysfs_status_attr_group,   //
     &imsar_xdma_sysfs_control_attr_group,  //
@@ -221,6 +250,178 @@ ssize_t imsar_xdma_sysfs_transfer_id_show(struct device *dev, struct device_attr
 	return snprintf(buf, PAGE_SIZE, "%u\n", channel->last_finished_transfer_id);
 }
 
+ssize_t imsar_xdma_sysfs_pinned_buffers_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	imsar_xdma_channel_t *channel = (imsar_xdma_channel_t *)dev_get_drvdata(dev);
+	if (!channel)
+	{
+		return 0;
+	}
+	return snprintf(buf, PAGE_SIZE, "%u\n", channel->pinned_buffer_count);
+}
+
+ssize_t imsar_xdma_sysfs_pinned_skips_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	imsar_xdma_channel_t *channel = (imsar_xdma_channel_t *)dev_get_drvdata(dev);
+	if (!channel)
+	{
+		return 0;
+	}
+	return snprintf(buf, PAGE_SIZE, "%lu\n", channel->pinned_skip_count);
+}
+
+// One line per open file: reads, drops and lag (see struct imsar_xdma_consumer_stats)
+ssize_t imsar_xdma_sysfs_consumers_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	ssize_t length;
+	unsigned long flags;
+	imsar_xdma_file_t *entry;
+	imsar_xdma_channel_t *channel = (imsar_xdma_channel_t *)dev_get_drvdata(dev);
+	if (!channel)
+	{
+		return 0;
+	}
+
+	length = scnprintf(buf, PAGE_SIZE, "%8s %-16s %12s %12s %8s %8s\n", "pid", "name", "read", "skipped", "max_lag",
+	                   "lag");
+
+	spin_lock_irqsave(&channel->consumers_spinlock, flags);
+	list_for_each_entry(entry, &channel->consuming_files, list)
+	{
+		length += scnprintf(buf + length, PAGE_SIZE - length, "%8d %-16s %12llu %12llu %8u %8u\n", entry->pid,
+		                    entry->comm, entry->transfers_read, entry->transfers_skipped, entry->max_lag,
+		                    channel->last_finished_transfer_id - entry->last_read_transfer_id);
+	}
+	spin_unlock_irqrestore(&channel->consumers_spinlock, flags);
+
+	return length;
+}
+
+ssize_t imsar_xdma_sysfs_irq_threshold_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	imsar_xdma_channel_t *channel = (imsar_xdma_channel_t *)dev_get_drvdata(dev);
+	if (!channel)
+	{
+		return 0;
+	}
+	return snprintf(buf, PAGE_SIZE, "%u\n", channel->irq_threshold);
+}
+
+ssize_t imsar_xdma_sysfs_irq_threshold_store(struct device *dev, struct device_attribute *attr, const char *buf,
+                                             size_t size)
+{
+	char *end;
+	unsigned long value;
+	imsar_xdma_channel_t *channel;
+	channel = (imsar_xdma_channel_t *)dev_get_drvdata(dev);
+	if (!channel)
+	{
+		return -ENODEV;
+	}
+	value = simple_strtoul(buf, &end, 0);
+	if (end == buf || !imsar_xdma_chan_irq_coalesce_valid(channel, value, channel->irq_delay))
+	{
+		return -EINVAL;
+	}
+	mutex_lock(&channel->xdma_device->control_mutex);
+	channel->irq_threshold = value;
+	imsar_xdma_chan_irq_coalesce(channel);
+	imsar_xdma_chan_irq_delay_update(channel);
+	mutex_unlock(&channel->xdma_device->control_mutex);
+	return size;
+}
+
+ssize_t imsar_xdma_sysfs_irq_delay_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	imsar_xdma_channel_t *channel = (imsar_xdma_channel_t *)dev_get_drvdata(dev);
+	if (!channel)
+	{
+		return 0;
+	}
+	return snprintf(buf, PAGE_SIZE, "%u\n", channel->irq_delay);
+}
+
+ssize_t imsar_xdma_sysfs_irq_delay_store(struct device *dev, struct device_attribute *attr, const char *buf,
+                                         size_t size)
+{
+	char *end;
+	unsigned long value;
+	imsar_xdma_channel_t *channel;
+	channel = (imsar_xdma_channel_t *)dev_get_drvdata(dev);
+	if (!channel)
+	{
+		return -ENODEV;
+	}
+	value = simple_strtoul(buf, &end, 0);
+	if (end == buf || !imsar_xdma_chan_irq_coalesce_valid(channel, channel->irq_threshold, value))
+	{
+		return -EINVAL;
+	}
+	mutex_lock(&channel->xdma_device->control_mutex);
+	channel->irq_delay = value;
+	imsar_xdma_chan_irq_coalesce(channel);
+	imsar_xdma_chan_irq_delay_update(channel);
+	mutex_unlock(&channel->xdma_device->control_mutex);
+	return size;
+}
+
+ssize_t imsar_xdma_sysfs_irq_count_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	imsar_xdma_channel_t *channel = (imsar_xdma_channel_t *)dev_get_drvdata(dev);
+	if (!channel)
+	{
+		return 0;
+	}
+	return snprintf(buf, PAGE_SIZE, "%lu\n", channel->irq_count);
+}
+
+ssize_t imsar_xdma_sysfs_irq_transfers_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	imsar_xdma_channel_t *channel = (imsar_xdma_channel_t *)dev_get_drvdata(dev);
+	if (!channel)
+	{
+		return 0;
+	}
+	return snprintf(buf, PAGE_SIZE, "%lu\n", channel->irq_transfer_count);
+}
+
+// Interrupt and transfer rates since the previous read
+ssize_t imsar_xdma_sysfs_irq_rate_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	u64 now_ns, elapsed_ns;
+	unsigned long irqs, transfers;
+	unsigned long irq_count, transfer_count;
+	unsigned long per_irq_x100;
+	imsar_xdma_channel_t *channel = (imsar_xdma_channel_t *)dev_get_drvdata(dev);
+	if (!channel)
+	{
+		return 0;
+	}
+
+	spin_lock(&channel->irq_rate_spinlock);
+	now_ns = ktime_get_ns();
+	irq_count = READ_ONCE(channel->irq_count);
+	transfer_count = READ_ONCE(channel->irq_transfer_count);
+	elapsed_ns = now_ns - channel->irq_rate_ns;
+	irqs = irq_count - channel->irq_rate_count;
+	transfers = transfer_count - channel->irq_rate_transfers;
+
+	channel->irq_rate_ns = now_ns;
+	channel->irq_rate_count = irq_count;
+	channel->irq_rate_transfers = transfer_count;
+	spin_unlock(&channel->irq_rate_spinlock);
+
+	if (elapsed_ns == 0)
+	{
+		return snprintf(buf, PAGE_SIZE, "0 irq/s, 0 transfers/s, 0.00 transfers/irq\n");
+	}
+
+	per_irq_x100 = irqs ? transfers * 100 / irqs : 0;
+	return snprintf(buf, PAGE_SIZE, "%llu irq/s, %llu transfers/s, %lu.%02lu transfers/irq\n",
+	                div64_u64((u64)irqs * NSEC_PER_SEC, elapsed_ns),
+	                div64_u64((u64)transfers * NSEC_PER_SEC, elapsed_ns), per_irq_x100 / 100, per_irq_x100 % 100);
+}
+
 ssize_t imsar_xdma_sysfs_register_show(const char *fmt, unsigned int reg, struct device *dev, char *buf)
 {
 	u32 value;
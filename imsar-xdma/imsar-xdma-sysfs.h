@@ -33,6 +33,19 @@ ssize_t imsar_xdma_sysfs_name_show(struct device *dev, struct device_attribute *
 ssize_t imsar_xdma_sysfs_buffer_count_show(struct device *dev, struct device_attribute *attr, char *buf);
 ssize_t imsar_xdma_sysfs_buffer_size_show(struct device *dev, struct device_attribute *attr, char *buf);
 ssize_t imsar_xdma_sysfs_transfer_id_show(struct device *dev, struct device_attribute *attr, char *buf);
+ssize_t imsar_xdma_sysfs_pinned_buffers_show(struct device *dev, struct device_attribute *attr, char *buf);
+ssize_t imsar_xdma_sysfs_pinned_skips_show(struct device *dev, struct device_attribute *attr, char *buf);
+ssize_t imsar_xdma_sysfs_consumers_show(struct device *dev, struct device_attribute *attr, char *buf);
+
+ssize_t imsar_xdma_sysfs_irq_threshold_show(struct device *dev, struct device_attribute *attr, char *buf);
+ssize_t imsar_xdma_sysfs_irq_threshold_store(struct device *dev, struct device_attribute *attr, const char *buf,
+                                             size_t size);
+ssize_t imsar_xdma_sysfs_irq_delay_show(struct device *dev, struct device_attribute *attr, char *buf);
+ssize_t imsar_xdma_sysfs_irq_delay_store(struct device *dev, struct device_attribute *attr, const char *buf,
+                                         size_t size);
+ssize_t imsar_xdma_sysfs_irq_count_show(struct device *dev, struct device_attribute *attr, char *buf);
+ssize_t imsar_xdma_sysfs_irq_transfers_show(struct device *dev, struct device_attribute *attr, char *buf);
+ssize_t imsar_xdma_sysfs_irq_rate_show(struct device *dev, struct device_attribute *attr, char *buf);
 
 ssize_t imsar_xdma_sysfs_log_register_access_show(struct device *dev, struct device_attribute *attr, char *buf);
 ssize_t imsar_xdma_sysfs_log_register_access_store(struct device *dev, struct device_attribute *attr, const char *buf,